@@ -7,7 +7,28 @@
 */
 
 #include <JuceHeader.h>
+#include "typhon_protocol.h"
+#include "typhon_spectral.h"
+#include "typhon_resample.h"
+#include "typhon_reblock.h"
+#include "typhon_features.h"
+#include "typhon_oversampling.h"
+#include "typhon_effects.h"
+#include "typhon_control.h"
+#include "typhon_sidecar.h"
+#include "typhon_batch.h"
+#include "typhon_session.h"
+#include "typhon_cache.h"
+#include "typhon_freeze.h"
+#include "typhon_capture.h"
+#include "typhon_shm.h"
+#include "typhon_warmup.h"
+#include "typhon_quality.h"
 #include "typhon_utils.h"
+#include "typhon_params.h"
+#include "typhon_convolution.h"
+#include "typhon_embedded.h"
+#include "typhon_inference.h"
 #include "VSTyphon.h"
 
 //==============================================================================
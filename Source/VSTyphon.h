@@ -12,7 +12,7 @@
 
  dependencies:          juce_audio_basics, juce_audio_devices, juce_audio_formats,
                         juce_audio_plugin_client, juce_audio_processors,
-                        juce_audio_utils, juce_core, juce_data_structures,
+                        juce_audio_utils, juce_core, juce_data_structures, juce_dsp,
                         juce_events, juce_graphics, juce_gui_basics, juce_gui_extra
  exporters:             xcode_mac, vs2017, vs2019, linux_make, xcode_iphone, androidstudio
 
@@ -173,17 +173,49 @@ public:
             server->saveTimecodeInfo(info);
         }
 
-        void run() override
+        void setHandshakeCallback(std::function<void(const WorkerConfig&)> callback)
+        {
+            server->setHandshakeCallback(callback);
+        }
+
+        void setBlockLayout(int numChannels, int sidechainChannels, int auxChannels, int maxBlockSize, double sampleRate)
         {
+            server->setBlockLayout(numChannels, sidechainChannels, auxChannels, maxBlockSize, sampleRate);
+        }
 
+        // Binds the socket the first time it's wanted rather than when the
+        // plugin is made, so a scan or an instance that never plays costs nothing.
+        void start()
+        {
+            if (isThreadRunning()) return;
+            stop_signal.reset();
+            startThread();
+        }
 
+        // stops listening and drops the worker, it reconnects after the next start()
+        void stop()
+        {
+            signalThreadShouldExit();
+            stop_signal.signal();
+            stopThread(1000);
+            server->disconnectWorker();
+        }
+
+        bool isListening() const
+        {
+            return isThreadRunning();
+        }
+
+        void run() override
+        {
             while (!threadShouldExit())
             {
                 if (server->beginWaitingForSocket(11586)) {
-                    while (!stop_signal.wait(1)) {
-                        // safe to do nothing here but have to reconnect python side
-                    }
-                    server->stop();
+                    // safe to do nothing here but have to reconnect python side
+                    stop_signal.wait(-1);
+                } else {
+                    // port taken, try again in a bit rather than spinning
+                    stop_signal.wait(500);
                 }
                 server->stop();
             }
@@ -194,18 +226,51 @@ public:
             return server->gotMsg();
         }
 
+        bool renderReplyAudio(AudioBuffer<float>& buffer, int numChannels, int numSamples) {
+            return server->renderReplyAudio(buffer, numChannels, numSamples);
+        }
+
+        bool missedDeadline() {
+            return server->missedDeadline();
+        }
+
+        bool repliesWithMidi() {
+            return server->repliesWithMidi();
+        }
+
         bool getPanic() {
             return last_note == -1;
         }
         template <typename FloatType>
-        void transmit(AudioBuffer<FloatType>& buffer, MidiBuffer& midiBuffer) {
-            if (server->isConnected()) {
-                server->transmit(buffer, midiBuffer);
+        void transmit(AudioBuffer<FloatType>& buffer, MidiBuffer& midiBuffer, const TransportInfo& transport) {
+            if (server->isActive()) {
+                server->transmit(buffer, midiBuffer, &transport);
             }
         }
         bool isConnected() {
             return server->isConnected();
         }
+        bool isActive() {
+            return server->isActive();
+        }
+        uint64 getVersionTag() {
+            return server->getVersionTag();
+        }
+        void requestKeyframe() {
+            server->requestKeyframe();
+        }
+        void setCapture(const File& directory, bool headersOnly) {
+            server->setCapture(directory, headersOnly);
+        }
+        const Warmup* getWarmup() {
+            return server->getWarmup();
+        }
+        WorkerConfig setQualityLevel(int level) {
+            return server->setQualityLevel(level);
+        }
+        double takeRoundTripMs() {
+            return server->takeRoundTripMs();
+        }
 
     private:
         int last_note = 0;
@@ -219,44 +284,35 @@ public:
                  { std::make_unique<AudioParameterFloat> ("gain",  "Gain",           NormalisableRange<float> (0.0f, 1.0f), 0.9f),
                    std::make_unique<AudioParameterFloat> ("delay", "Delay Feedback", NormalisableRange<float> (0.0f, 1.0f), 0.5f),
                    std::make_unique<AudioParameterBool>("midiProcess", "Process MIDI", true),
-                   std::make_unique<AudioParameterBool>("internalSynth", "Built-in Synth", true) })
+                   std::make_unique<AudioParameterBool>("internalSynth", "Built-in Synth", true),
+                   std::make_unique<AudioParameterFloat> ("mix",   "Delay Mix",      NormalisableRange<float> (0.0f, 1.0f), 1.0f),
+                   std::make_unique<AudioParameterBool>("nativeChain", "Native Effects", true),
+                   std::make_unique<AudioParameterFloat> ("convMix", "Convolution Mix", NormalisableRange<float> (0.0f, 1.0f), 1.0f) })
     {
         // Add a sub-tree to store the state of our UI
         state.state.addChild ({ "uiState", { { "width",  460 }, { "height", 300 } }, {} }, -1, nullptr);
 
         initialiseSynth();
 
-        std::string timeInfo = "";
-        AudioPlayHead::CurrentPositionInfo result;
-        if (auto* ph = getPlayHead())
-        {
-            if (ph->getCurrentPosition(result)) {
-                timeInfo = std::to_string(result.bpm);
-            }
-        }
-        if (timeInfo == "") {
-            AudioPlayHead::CurrentPositionInfo result;
-            result.resetToDefault();
-            timeInfo = std::to_string(result.bpm);
-        }
+        gainParam  = params.add (state.getRawParameterValue ("gain"));
+        delayParam = params.add (state.getRawParameterValue ("delay"));
+        mixParam   = params.add (state.getRawParameterValue ("mix"));
+        convMixParam = params.add (state.getRawParameterValue ("convMix"));
 
-        // If the host fails to provide the current time, we'll just use default values
-        
-        tomThread.setInfo(timeInfo.substr(0, 5));
-        tomThread.startThread();
-        
-        
+        // the socket isn't opened until prepareToPlay, see startWorkerServer()
+        tomThread.setHandshakeCallback([this](const WorkerConfig& config) { handshakeReceived(config); });
 
+        quality.onChange = [this] (const QualityController::Level& level) { applyQualityLevel (level); };
+        quality.takeRoundTripMs = [this] { return tomThread.takeRoundTripMs(); };
     }
     ~JuceDemoPluginAudioProcessor() override {
-        tomThread.stop_signal.signal();
-        tomThread.stopThread(1000);
+        tomThread.stop();
     }
 
     //==============================================================================
     bool isBusesLayoutSupported (const BusesLayout& layouts) const override
     {
-        // Only mono/stereo and input/output must have same layout
+        // Any main layout up to maxChannels, input and output must have same layout
         const auto& mainOutput = layouts.getMainOutputChannelSet();
         const auto& mainInput  = layouts.getMainInputChannelSet();
 
@@ -268,10 +324,17 @@ public:
         if (mainOutput.isDisabled())
             return false;
 
-        // only allow stereo and mono
-        if (mainOutput.size() > 2)
+        if (mainOutput.size() > maxChannels)
             return false;
 
+        // sidechain and aux come after the main input, so they need one
+        for (int bus = 1; bus < layouts.inputBuses.size(); ++bus)
+        {
+            const auto& set = layouts.getChannelSet (true, bus);
+            if (! set.isDisabled() && (mainInput.isDisabled() || set.size() > maxChannels))
+                return false;
+        }
+
         return true;
     }
 
@@ -281,7 +344,23 @@ public:
         // initialisation that you need..
         synth.setCurrentPlaybackSampleRate (newSampleRate);
         keyboardState.reset();
-        delayBufferFloat .setSize (2, 12000);
+        delayBufferFloat .setSize (jmax (2, getTotalNumOutputChannels()), 12000);
+        params.prepare (samplesPerBlock);
+        preparedSampleRate = newSampleRate;
+        preparedBlockSize = samplesPerBlock;
+        tomThread.setBlockLayout (getTotalNumOutputChannels(), getChannelCountOfBus (true, sidechainBus),
+                                  getChannelCountOfBus (true, auxBus), samplesPerBlock, newSampleRate);
+        rebuildChain();
+        loadImpulseResponse();
+        loadModel();
+        startEmbeddedPython();
+        joinBatchHub();
+        openFreeze();
+        applyWireCapture();
+        quality.prepare (newSampleRate);
+        applyQualityLevels();
+        if (wantsWorkerServer())
+            startWorkerServer();
         reset();
     }
 
@@ -290,6 +369,7 @@ public:
         // When playback stops, you can use this as an opportunity to free up any
         // spare memory, etc.
         keyboardState.reset();
+        tomThread.stop();
     }
 
     void reset() override
@@ -341,6 +421,159 @@ public:
         // method.
         if (auto xmlState = getXmlFromBinary (data, sizeInBytes))
             state.replaceState (ValueTree::fromXml (*xmlState));
+
+        newFreezeId = {};
+        rebuildChain();
+        loadImpulseResponse();
+        loadModel();
+        startEmbeddedPython();
+        joinBatchHub();
+        openFreeze();
+        applyWireCapture();
+        applyQualityLevels();
+    }
+
+    //==============================================================================
+    // The native effect chain replaces what the Python workers were doing with
+    // torchaudio. Its spec and oversampling factor are saved with the plugin
+    // state and a worker can set them from its handshake with "chain=..." and
+    // "oversample=2|4|8".
+    void setChainSpec (const String& spec, int oversampling)
+    {
+        state.state.setProperty ("nativeChain", spec, nullptr);
+        state.state.setProperty ("oversampling", oversampling, nullptr);
+        rebuildChain();
+    }
+
+    // Convolution with an IR file, "ir=/path/to/file.wav" from the handshake.
+    void setImpulseResponse (const String& path)
+    {
+        state.state.setProperty ("impulseResponse", path, nullptr);
+        loadImpulseResponse();
+    }
+
+    // A model exported from the training notebook, run natively instead of
+    // in torch behind the socket. "model=/path/net.tynn" and "int8=1" from the
+    // handshake.
+    void setModel (const String& path, bool int8Weights)
+    {
+        state.state.setProperty ("model", path, nullptr);
+        state.state.setProperty ("modelInt8", int8Weights, nullptr);
+        loadModel();
+    }
+
+    // A script to run in-process instead of talking to a worker over the
+    // socket. Only does anything when built with TYPHON_EMBED_PYTHON=1.
+    void setPythonScript (const String& path)
+    {
+        state.state.setProperty ("pythonScript", path, nullptr);
+        startEmbeddedPython();
+    }
+
+    // Listen for a worker on localhost:11586. Done from prepareToPlay unless the
+    // "workerServer" state property is off or the instance is batching; call
+    // it directly to listen anyway.
+    void startWorkerServer()
+    {
+        tomThread.setInfo (getTempoInfo());
+        tomThread.start();
+    }
+
+    void setWorkerServer (bool shouldListen)
+    {
+        state.state.setProperty ("workerServer", shouldListen, nullptr);
+        if (shouldListen && preparedSampleRate > 0.0 && wantsWorkerServer())
+            startWorkerServer();
+        else if (! shouldListen)
+            tomThread.stop();
+    }
+
+    // Share one worker with every other instance in this process that has
+    // this on, see typhon_batch.h. Audio only: the instance's own worker
+    // server stops, and MIDI and transport go nowhere while it's on. Saved
+    // with the plugin state.
+    void setBatching (bool shouldBatch)
+    {
+        state.state.setProperty ("batchHub", shouldBatch, nullptr);
+        joinBatchHub();
+        if (shouldBatch)
+            tomThread.stop();
+        else if (preparedSampleRate > 0.0 && wantsWorkerServer())
+            startWorkerServer();
+    }
+
+    // Record what the worker plays against the timeline and play it back from
+    // disk where nothing has changed, see typhon_freeze.h. Saved with the state.
+    void setFreeze (bool shouldFreeze)
+    {
+        state.state.setProperty ("freeze", shouldFreeze, nullptr);
+        openFreeze();
+    }
+
+    // everything frozen so far goes, the next pass records it again
+    void clearFreeze()
+    {
+        if (auto* freeze = freezeStatus.load())
+            freeze->clear();
+    }
+
+    bool isPlayingFrozen() const { return playingFrozen.load(); }
+
+    // Log every message to and from the worker into a new file in this
+    // directory, for typhon_replay.py; empty turns it off. headersOnly keeps
+    // just the frame headers for long sessions. Saved with the state.
+    void setWireCapture (const String& directory, bool headersOnly)
+    {
+        state.state.setProperty ("wireCapture", directory, nullptr);
+        state.state.setProperty ("wireCaptureHeaders", headersOnly, nullptr);
+        applyWireCapture();
+    }
+
+    // What to give up, in order, when the machine can't keep up, see
+    // typhon_quality.h, e.g. "worker|polyphony:4|model,convolution|native".
+    // Empty keeps full quality whatever happens. Saved with the state.
+    void setQualityLevels (const String& spec)
+    {
+        state.state.setProperty ("qualityLevels", spec, nullptr);
+        applyQualityLevels();
+    }
+
+    const QualityController& getQuality() const { return quality; }
+
+    String getBatchStatus()
+    {
+        if (auto* member = batchStatus.load())
+            return member->isConnected() ? "Batched on localhost:" + String ((int) BatchHub::port)
+                                         : "Batch hub, connect to localhost:" + String ((int) BatchHub::port);
+        return {};
+    }
+
+    String getEmbeddedStatus()
+    {
+       #if TYPHON_EMBED_PYTHON
+        if (auto* python = embeddedStatus.get())
+            return python->hasFailed() ? "Script failed: " + python->getScriptName()
+                                       : "In-process: " + python->getScriptName();
+       #endif
+        return {};
+    }
+
+    void handshakeReceived (const WorkerConfig& config)
+    {
+        if (config.has ("chain") || config.has ("oversample"))
+            setChainSpec (config.get ("chain", state.state.getProperty ("nativeChain").toString()),
+                          config.getInt ("oversample", (int) state.state.getProperty ("oversampling", 1)));
+
+        if (config.has ("ir"))
+            setImpulseResponse (config.get ("ir"));
+
+        // v2 lookahead and the STFT mode hold the output back
+        transportLatency = Connection::getLatencySamples (config, preparedBlockSize, preparedSampleRate);
+        updateLatency();
+
+        if (config.has ("model") || config.has ("int8"))
+            setModel (config.get ("model", state.state.getProperty ("model").toString()),
+                      config.getInt ("int8", (bool) state.state.getProperty ("modelInt8", false) ? 1 : 0) != 0);
     }
 
     //==============================================================================
@@ -406,6 +639,7 @@ private:
             midiKeyboard(owner.keyboardState, MidiKeyboardComponent::horizontalKeyboard),
             gainAttachment(owner.state, "gain", gainSlider),
             delayAttachment(owner.state, "delay", delaySlider),
+            mixAttachment(owner.state, "mix", mixSlider),
             midiProcessAttachment(owner.state, "midiProcess", midiProcessSlider),
             internalSynthSliderAttachment(owner.state, "internalSynth", internalSynthSlider)
 
@@ -417,6 +651,9 @@ private:
             addAndMakeVisible (delaySlider);
             delaySlider.setSliderStyle (Slider::Rotary);
 
+            addAndMakeVisible (mixSlider);
+            mixSlider.setSliderStyle (Slider::Rotary);
+
             addAndMakeVisible(midiProcessSlider);
             addAndMakeVisible(internalSynthSlider);
             midiProcessLabel.attachToComponent(&midiProcessSlider, false);
@@ -431,10 +668,18 @@ private:
             delayLabel.attachToComponent (&delaySlider, false);
             delayLabel.setFont (Font (11.0f));
 
+            mixLabel.attachToComponent (&mixSlider, false);
+            mixLabel.setFont (Font (11.0f));
+
             addAndMakeVisible (midiKeyboard);
             addAndMakeVisible (timecodeDisplayLabel);
             timecodeDisplayLabel.setFont (Font (Font::getDefaultMonospacedFontName(), 15.0f, Font::plain));
 
+           #if TYPHON_EMBED_PYTHON
+            addAndMakeVisible (scriptButton);
+            scriptButton.onClick = [this] { chooseScript(); };
+           #endif
+
             setResizeLimits (460, 300, 1024, 700);
             setResizable (true, owner.wrapperType != wrapperType_AudioUnitv3);
 
@@ -462,13 +707,18 @@ private:
         void resized() override
         {
             auto r = getLocalBounds().reduced (8);
-            timecodeDisplayLabel.setBounds (r.removeFromTop (26));
+            auto topRow = r.removeFromTop (26);
+           #if TYPHON_EMBED_PYTHON
+            scriptButton.setBounds (topRow.removeFromRight (110));
+           #endif
+            timecodeDisplayLabel.setBounds (topRow);
             midiKeyboard        .setBounds (r.removeFromBottom (70));
 
             r.removeFromTop (20);
             auto sliderArea = r.removeFromTop (60);
-            gainSlider.setBounds  (sliderArea.removeFromLeft (jmin (180, sliderArea.getWidth() / 3)));
-            delaySlider.setBounds (sliderArea.removeFromLeft (jmin (180, sliderArea.getWidth() / 2)));
+            gainSlider.setBounds  (sliderArea.removeFromLeft (jmin (180, sliderArea.getWidth() / 4)));
+            delaySlider.setBounds (sliderArea.removeFromLeft (jmin (180, sliderArea.getWidth() / 3)));
+            mixSlider.setBounds   (sliderArea.removeFromLeft (jmin (180, sliderArea.getWidth() / 2)));
             midiProcessSlider.setBounds(sliderArea.removeFromLeft(jmin(120, sliderArea.getWidth())));
             internalSynthSlider.setBounds(8, jmin(sliderArea.getHeight()*3, 120), jmax(sliderArea.getWidth(), 120), jmin(sliderArea.getHeight(), 180));
 
@@ -500,6 +750,9 @@ private:
             if (&control == &midiProcessSlider)
                 return 3;
 
+            if (&control == &mixSlider)
+                return 4;
+
             return -1;
         }
 
@@ -518,14 +771,31 @@ private:
         Label timecodeDisplayLabel,
             gainLabel{ {}, "Throughput level:" },
             delayLabel{ {}, "Delay:" },
+            mixLabel{ {}, "Delay Mix:" },
             midiProcessLabel{ {}, "Process Midi: " },
             internalSynthLabel{ {}, "Built-in Synth: " };
 
-        Slider gainSlider, delaySlider, midiProcessSlider, internalSynthSlider;
-        AudioProcessorValueTreeState::SliderAttachment gainAttachment, delayAttachment, midiProcessAttachment, internalSynthSliderAttachment;
+        Slider gainSlider, delaySlider, mixSlider, midiProcessSlider, internalSynthSlider;
+        AudioProcessorValueTreeState::SliderAttachment gainAttachment, delayAttachment, mixAttachment, midiProcessAttachment, internalSynthSliderAttachment;
         Colour backgroundColour;
         Value lastUIWidth, lastUIHeight;
 
+       #if TYPHON_EMBED_PYTHON
+        TextButton scriptButton { "Python script..." };
+        std::unique_ptr<FileChooser> scriptChooser;
+
+        void chooseScript()
+        {
+            scriptChooser = std::make_unique<FileChooser> ("Run a script in-process", File(), "*.py");
+            scriptChooser->launchAsync (FileBrowserComponent::openMode | FileBrowserComponent::canSelectFiles,
+                                        [this] (const FileChooser& chooser)
+                                        {
+                                            // cancelling clears it and goes back to the socket
+                                            getProcessor().setPythonScript (chooser.getResult().getFullPathName());
+                                        });
+        }
+       #endif
+
         JuceDemoPluginAudioProcessor& getProcessor() const
         {
             return static_cast<JuceDemoPluginAudioProcessor&> (processor);
@@ -538,14 +808,54 @@ private:
 
             displayText << String(pos.bpm, 2) << " bpm | ";
                 
-            if (getProcessor().tomThread.isConnected()) {
-                displayText << "Connected";
+            auto embedded = getProcessor().getEmbeddedStatus();
+            auto batch = getProcessor().getBatchStatus();
+            if (embedded.isNotEmpty()) {
+                displayText << embedded;
+            } else if (batch.isNotEmpty()) {
+                displayText << batch;
+            } else if (getProcessor().isPlayingFrozen()) {
+                displayText << "Playing frozen";
+            } else if (getProcessor().tomThread.isConnected()) {
+                displayText << "Connected" << getWarmupText();
+            } else if (getProcessor().tomThread.isActive()) {
+                displayText << "Reconnecting";
+            } else if (! getProcessor().tomThread.isListening()) {
+                displayText << "Not listening";
             } else {
                 displayText << "Connect to localhost:11586";
             }
+            displayText << getQualityText();
             timecodeDisplayLabel.setText(displayText.toString(), dontSendNotification);
         }
 
+        // whether the worker has done its first-run compiling yet, see typhon_warmup.h
+        String getWarmupText()
+        {
+            auto* warmup = getProcessor().tomThread.getWarmup();
+            if (warmup == nullptr)
+                return {};
+
+            switch (warmup->getStatus())
+            {
+                case Warmup::warming: return " | warming up " + String (warmup->getNumAnswered()) + "/" + String (warmup->getNumSent());
+                case Warmup::warm:    return " | warm";
+                case Warmup::cold:    return " | cold";
+                case Warmup::none:    break;
+            }
+            return {};
+        }
+
+        // how far the quality controller has stepped down, see typhon_quality.h
+        String getQualityText()
+        {
+            const auto& quality = getProcessor().getQuality();
+            if (quality.getLevel() == 0)
+                return {};
+
+            return " | quality down " + String (quality.getLevel()) + "/" + String (quality.getNumLevels());
+        }
+
         // called when the stored window size changes
         void valueChanged(Value&) override
         {
@@ -556,58 +866,139 @@ private:
     template <typename FloatType>
     void process(AudioBuffer<FloatType>& buffer, MidiBuffer& midiMessages, AudioBuffer<FloatType>& delayBuffer)
     {
-        auto gainParamValue = state.getParameter("gain")->getValue();
-        auto delayParamValue = state.getParameter("delay")->getValue();
         auto midiProcessParamValue = state.getParameter("midiProcess")->getValue();
         auto internalSynthParamValue = state.getParameter("internalSynth")->getValue();
+        auto nativeChainParamValue = state.getParameter("nativeChain")->getValue();
         int numSamples = buffer.getNumSamples();
         int numChannels = buffer.getNumChannels();
+        // the buffer also holds the sidechain and aux inputs, replies only fill the outputs
+        int numOutputChannels = jmin(numChannels, getTotalNumOutputChannels());
+        params.beginBlock(numSamples);
+        auto posInfo = updateCurrentTimeInfoFromHost();
+        // how long this takes and whether the worker kept up, see typhon_quality.h
+        auto started = Time::getHighResolutionTicks();
+        auto bypass = quality.getBypass();
+        auto sentToWorker = false, unanswered = false;
+
+        // only a moving timeline can be frozen
+        auto* freeze = posInfo.isPlaying ? freezeCache.get() : nullptr;
+        auto frozen = false;
+        if (freeze != nullptr && tomThread.isConnected()) {
+            freeze->setWorkerVersion(tomThread.getVersionTag());
+        }
 
         keyboardState.processNextMidiBuffer(midiMessages, 0, numSamples, true);
         if (!midiProcessParamValue) {
             synth.renderNextBlock(buffer, midiMessages, 0, numSamples);
         }
 
-        if (tomThread.isConnected()) {
-            tomThread.transmit(buffer, midiMessages);
-            Pyaudio* audioAndMidi = tomThread.getAudioAndMidi();
-
-            float* memory_block = reinterpret_cast<float*>(audioAndMidi->getAudio()->getData());
-            auto **data = buffer.getArrayOfWritePointers();
-            for (int ch = 0; ch < numChannels; ch++) {
-                for (auto i = 0; i < numSamples; i++) {
-                    data[ch][i] = (float)memory_block[i + (ch * numSamples)];
-                }
-            }
-            uint8* midi_memory_block = reinterpret_cast<uint8*>(audioAndMidi->getMidi()->getData());
+       #if TYPHON_EMBED_PYTHON
+        if (auto* python = embeddedPython.get()) {
+            // the block we hand over now comes back next time round
+            python->push(buffer, midiMessages, numChannels, numSamples);
             MidiBuffer x = MidiBuffer();
-            for (int i = 0; i < 300; i+=3) {
-                MidiMessage xm = MidiMessage(midi_memory_block[i], midi_memory_block[i + 1], midi_memory_block[i + 2], 0);
-                x.addEvent(xm, 0); // just add sequentially, it *is* missing precise timing offset info.
+            if (!python->pull(buffer, x, numOutputChannels, numSamples)) {
+                buffer.clear();
             }
             if (midiProcessParamValue && internalSynthParamValue) {
                 synth.renderNextBlock(buffer, x, 0, numSamples);
             }
+        } else
+       #endif
+        if (auto* member = batchMember.get()) {
+            // audio only, and a fixed two blocks behind
+            member->push(buffer, numChannels, numSamples);
+            if (!member->pull(buffer, numOutputChannels, numSamples)) {
+                buffer.clear();
+            }
+        } else if (freeze != nullptr
+                   && freeze->play(posInfo.timeInSamples, buffer, numSamples, midiMessages, getFreezeTag(midiProcessParamValue, internalSynthParamValue))) {
+            // all of it heard before, nothing goes to the worker
+            frozen = true;
+            skippedTransport = true;
+        } else if (tomThread.isActive() && quality.isNativeOnly()) {
+            // shedding load, the worker sits out until there's room again
+            skippedTransport = true;
+        } else if (tomThread.isActive()) {
+            if (std::exchange(skippedTransport, false)) {
+                // the worker missed what was played frozen or without it
+                tomThread.requestKeyframe();
+            }
+            tomThread.transmit(buffer, midiMessages, TransportInfo::from(posInfo));
+            Pyaudio* audioAndMidi = tomThread.getAudioAndMidi();
+            sentToWorker = true;
+            unanswered = tomThread.isConnected() && tomThread.missedDeadline();
+
+            auto handled = tomThread.renderReplyAudio(buffer, numOutputChannels, numSamples);
+            if (!handled && audioAndMidi->silent) {
+                buffer.clear();
+            } else if (!handled) {
+                float* memory_block = reinterpret_cast<float*>(audioAndMidi->getAudio()->getData());
+                auto **data = buffer.getArrayOfWritePointers();
+                auto replyChannels = jmin(numOutputChannels, (int)(audioAndMidi->getAudio()->getSize() / sizeof(float)) / jmax(1, numSamples));
+                for (int ch = 0; ch < replyChannels; ch++) {
+                    for (auto i = 0; i < numSamples; i++) {
+                        data[ch][i] = (float)memory_block[i + (ch * numSamples)];
+                    }
+                }
+            }
+            if (tomThread.repliesWithMidi()) {
+                uint8* midi_memory_block = reinterpret_cast<uint8*>(audioAndMidi->getMidi()->getData());
+                MidiBuffer x = MidiBuffer();
+                for (int i = 0; i < 300; i+=3) {
+                    MidiMessage xm = MidiMessage(midi_memory_block[i], midi_memory_block[i + 1], midi_memory_block[i + 2], 0);
+                    x.addEvent(xm, 0); // just add sequentially, it *is* missing precise timing offset info.
+                }
+                if (midiProcessParamValue && internalSynthParamValue) {
+                    synth.renderNextBlock(buffer, x, 0, numSamples);
+                }
+            }
+            // only blocks the worker really answered, a gap shouldn't be frozen
+            if (freeze != nullptr && tomThread.isConnected() && audioAndMidi->seqnum >= 0) {
+                freeze->record(buffer);
+            }
         }
+        playingFrozen = frozen;
         seqnum++;
-        applyGain(buffer, delayBuffer, gainParamValue);
-        applyDelay (buffer, delayBuffer, delayParamValue);
-        updateCurrentTimeInfoFromHost();
-    }
 
-    template <typename FloatType>
-    void applyGain (AudioBuffer<FloatType>& buffer, AudioBuffer<FloatType>& delayBuffer, float gainLevel)
-    {
-        ignoreUnused (delayBuffer);
+        if (auto* model = nativeModel.get()) {
+            if ((bypass & QualityController::modelStage) == 0) {
+                model->process(buffer, numOutputChannels, numSamples);
+            }
+        }
 
-        for (auto channel = 0; channel < getTotalNumOutputChannels(); ++channel)
-            buffer.applyGain (channel, 0, buffer.getNumSamples(), gainLevel);
+        if (auto* chain = nativeChain.get()) {
+            if (nativeChainParamValue && !chain->isEmpty() && (bypass & QualityController::chainStage) == 0) {
+                chain->process(buffer, numOutputChannels, numSamples);
+            } else {
+                // chainLatency is still reported, so the dry path waits as long
+                chain->bypass(buffer, numOutputChannels, numSamples);
+            }
+        }
+
+        if (auto* convolution = nativeConvolution.get()) {
+            if ((bypass & QualityController::convolutionStage) == 0) {
+                convolution->process(buffer, numOutputChannels, numSamples, params.getValue(convMixParam),
+                                     params.isSteady(convMixParam) ? nullptr : params.getRamp(convMixParam, numSamples));
+            }
+        }
+
+        applyGainAndDelay (buffer, delayBuffer);
+        quality.blockDone(Time::getHighResolutionTicks() - started, numSamples, sentToWorker, unanswered);
     }
 
+    // gain, delay feedback and delay mix are fused into one pass per channel,
+    // smoothed per sample whenever any of them is being automated
     template <typename FloatType>
-    void applyDelay (AudioBuffer<FloatType>& buffer, AudioBuffer<FloatType>& delayBuffer, float delayLevel)
+    void applyGainAndDelay (AudioBuffer<FloatType>& buffer, AudioBuffer<FloatType>& delayBuffer)
     {
         auto numSamples = buffer.getNumSamples();
+        auto delaySize = delayBuffer.getNumSamples();
+        auto steady = params.allSteady();
+
+        const float* gainRamp  = steady ? nullptr : params.getRamp (gainParam,  numSamples);
+        const float* delayRamp = steady ? nullptr : params.getRamp (delayParam, numSamples);
+        const float* mixRamp   = steady ? nullptr : params.getRamp (mixParam,   numSamples);
 
         auto delayPos = 0;
 
@@ -617,13 +1008,22 @@ private:
             auto delayData = delayBuffer.getWritePointer (jmin (channel, delayBuffer.getNumChannels() - 1));
             delayPos = delayPosition;
 
-            for (auto i = 0; i < numSamples; ++i)
+            for (auto done = 0; done < numSamples;)
             {
-                auto in = channelData[i];
-                channelData[i] += delayData[delayPos];
-                delayData[delayPos] = (delayData[delayPos] + in) * delayLevel;
+                // run up to the point where the delay line wraps
+                auto n = jmin (numSamples - done, delaySize - delayPos);
 
-                if (++delayPos >= delayBuffer.getNumSamples())
+                if (steady)
+                    GainDelayMix::process (channelData + done, delayData + delayPos, n,
+                                           params.getValue (gainParam), params.getValue (delayParam), params.getValue (mixParam));
+                else
+                    GainDelayMix::process (channelData + done, delayData + delayPos, n,
+                                           gainRamp + done, delayRamp + done, mixRamp + done);
+
+                done += n;
+                delayPos += n;
+
+                if (delayPos >= delaySize)
                     delayPos = 0;
             }
         }
@@ -636,7 +1036,252 @@ private:
     int delayPosition = 0;
     int seqnum = 0;
 
-    Synthesiser synth;
+    ParamEngine params;
+    int gainParam = 0, delayParam = 0, mixParam = 0, convMixParam = 0;
+
+    Handoff<EffectChain> nativeChain;
+    double preparedSampleRate = 0.0;
+    int preparedBlockSize = 0;
+
+    int chainLatency = 0;
+
+    // builds off the audio thread, process() picks it up at the next block
+    void rebuildChain()
+    {
+        auto chain = EffectChain::fromSpec (state.state.getProperty ("nativeChain").toString(),
+                                            state.state.getProperty ("oversampling", 1));
+
+        if (preparedSampleRate > 0.0)
+            chain->prepare (preparedSampleRate, preparedBlockSize, getTotalNumOutputChannels());
+
+        chainLatency = chain->getLatencySamples();
+        nativeChain.set (std::move (chain));
+        updateLatency();
+    }
+
+    // reading files, the FFTs of the IR partitions and folding the model
+    // weights all happen on loader, declared after what its jobs hand over
+    // to so they finish before that goes away
+    Handoff<PartitionedConvolution> nativeConvolution;
+    Handoff<NativeInference> nativeModel;
+    int modelLatency = 0;
+    ThreadPool loader { 1 };
+
+    void loadImpulseResponse()
+    {
+        if (preparedSampleRate <= 0.0)
+            return;
+
+        auto path = state.state.getProperty ("impulseResponse").toString();
+        auto sampleRate = preparedSampleRate;
+        auto blockSize = preparedBlockSize;
+        auto numChannels = getTotalNumOutputChannels();
+
+        loader.addJob ([this, path, sampleRate, blockSize, numChannels]
+        {
+            if (path.isEmpty())
+                nativeConvolution.set (nullptr);
+            else if (auto convolution = PartitionedConvolution::fromFile (File (path), sampleRate, numChannels, blockSize))
+                nativeConvolution.set (std::move (convolution));
+        });
+    }
+
+    void loadModel()
+    {
+        if (preparedSampleRate <= 0.0)
+            return;
+
+        auto path = state.state.getProperty ("model").toString();
+        auto int8Weights = (bool) state.state.getProperty ("modelInt8", false);
+        auto blockSize = preparedBlockSize;
+        auto numChannels = getTotalNumOutputChannels();
+
+        loader.addJob ([this, path, int8Weights, blockSize, numChannels]
+        {
+            std::unique_ptr<NativeInference> inference;
+
+            if (path.isNotEmpty())
+                if (auto model = AttentionDenoiser::fromFile (File (path), int8Weights))
+                    inference = std::make_unique<NativeInference> (std::move (model), numChannels, blockSize);
+
+            if (inference != nullptr)
+                inference->startThread();
+
+            auto latency = inference != nullptr ? inference->getLatencySamples() : 0;
+            nativeModel.set (std::move (inference));
+
+            // the latencies are the message thread's, and the processor may
+            // be gone by the time it gets there
+            MessageManager::callAsync ([processor = WeakReference<JuceDemoPluginAudioProcessor> (this), latency]
+            {
+                if (auto* p = processor.get())
+                {
+                    p->modelLatency = latency;
+                    p->updateLatency();
+                }
+            });
+        });
+    }
+
+   #if TYPHON_EMBED_PYTHON
+    // the interpreter thread goes away with the Handoff, which stops it
+    Handoff<EmbeddedPython> embeddedPython;
+    std::atomic<EmbeddedPython*> embeddedStatus { nullptr };
+   #endif
+    int embeddedLatency = 0;
+    int transportLatency = 0;
+
+    bool wantsWorkerServer()
+    {
+        // a batching instance only talks to the hub
+        return (bool) state.state.getProperty ("workerServer", true)
+            && ! (bool) state.state.getProperty ("batchHub", false);
+    }
+
+    // the tempo sent in EHLO. If the host fails to provide the current time,
+    // we'll just use default values
+    std::string getTempoInfo()
+    {
+        AudioPlayHead::CurrentPositionInfo result;
+        auto* ph = getPlayHead();
+        if (ph == nullptr || ! ph->getCurrentPosition (result))
+            result.resetToDefault();
+        return std::to_string (result.bpm).substr (0, 5);
+    }
+
+    // the seat is given up when the Handoff lets go of it
+    Handoff<BatchMember> batchMember;
+    std::atomic<BatchMember*> batchStatus { nullptr };
+    int batchLatency = 0;
+
+    void joinBatchHub()
+    {
+        std::unique_ptr<BatchMember> member;
+
+        if ((bool) state.state.getProperty ("batchHub", false) && preparedSampleRate > 0.0)
+            member = std::make_unique<BatchMember> (getTotalNumOutputChannels(), preparedBlockSize, preparedSampleRate);
+
+        batchStatus = member.get();
+        // two calls behind, exact only for full blocks, see typhon_batch.h
+        batchLatency = member != nullptr ? BatchMember::blocksBehind * preparedBlockSize : 0;
+        batchMember.set (std::move (member));
+        updateLatency();
+    }
+
+    void startEmbeddedPython()
+    {
+       #if TYPHON_EMBED_PYTHON
+        auto path = state.state.getProperty ("pythonScript").toString();
+        std::unique_ptr<EmbeddedPython> python;
+
+        if (path.isNotEmpty() && preparedSampleRate > 0.0)
+        {
+            python = std::make_unique<EmbeddedPython> (File (path), getTotalNumOutputChannels(),
+                                                       preparedBlockSize, preparedSampleRate);
+            python->startThread();
+        }
+
+        embeddedStatus = python.get();
+        embeddedLatency = python != nullptr ? preparedBlockSize : 0;
+        embeddedPython.set (std::move (python));
+        updateLatency();
+       #endif
+    }
+
+    // the handoff deletes the old file mapping once the audio thread has moved on
+    Handoff<FreezeCache> freezeCache;
+    std::atomic<FreezeCache*> freezeStatus { nullptr };
+    String newFreezeId; // until the state has it, so a second openFreeze picks the same file
+    std::atomic<bool> playingFrozen { false };
+    bool skippedTransport = false;
+    QualityController quality;
+
+    void applyQualityLevels()
+    {
+        quality.setLevels (state.state.getProperty ("qualityLevels").toString());
+    }
+
+    // message thread, whenever the controller steps
+    void applyQualityLevel (const QualityController::Level& level)
+    {
+        synth.setVoiceLimit (level.polyphony);
+
+        // a lower rate or bigger quanta change how far behind the worker plays
+        auto config = tomThread.setQualityLevel (level.workerLevel);
+        if (config.getInt ("proto", 1) >= 2)
+        {
+            transportLatency = Connection::getLatencySamples (config, preparedBlockSize, preparedSampleRate);
+            updateLatency();
+        }
+    }
+
+    void openFreeze()
+    {
+        std::unique_ptr<FreezeCache> freeze;
+
+        if ((bool) state.state.getProperty ("freeze", false) && preparedSampleRate > 0.0)
+        {
+            auto id = state.state.getProperty ("freezeId").toString();
+
+            if (id.isEmpty())
+            {
+                if (newFreezeId.isEmpty())
+                    newFreezeId = Uuid().toString();
+
+                id = newFreezeId;
+                storeFreezeId (id);
+            }
+
+            auto file = File::getSpecialLocation (File::userApplicationDataDirectory)
+                            .getChildFile ("VSTyphon").getChildFile ("freeze").getChildFile (id + ".tyfz");
+            freeze = std::make_unique<FreezeCache> (file, preparedSampleRate, getTotalNumInputChannels(),
+                                                    getTotalNumOutputChannels(), preparedBlockSize,
+                                                    (double) state.state.getProperty ("freezeSeconds", 600.0));
+        }
+
+        freezeStatus = freeze.get();
+        freezeCache.set (std::move (freeze));
+    }
+
+    // prepareToPlay and setStateInformation aren't always called on the message
+    // thread, and the state tree is the message thread's
+    void storeFreezeId (const String& id)
+    {
+        if (MessageManager::existsAndIsCurrentThread())
+        {
+            state.state.setProperty ("freezeId", id, nullptr);
+            return;
+        }
+
+        MessageManager::callAsync ([processor = WeakReference<JuceDemoPluginAudioProcessor> (this), id]
+        {
+            if (auto* p = processor.get())
+                if (p->state.state.getProperty ("freezeId").toString().isEmpty())
+                    p->state.state.setProperty ("freezeId", id, nullptr);
+        });
+    }
+
+    void applyWireCapture()
+    {
+        auto directory = state.state.getProperty ("wireCapture").toString();
+        tomThread.setCapture (File::isAbsolutePath (directory) ? File (directory) : File(),
+                              (bool) state.state.getProperty ("wireCaptureHeaders", false));
+    }
+
+    // the parameters the worker branch depends on; the worker's own go in its version
+    static uint64 getFreezeTag (float midiProcess, float internalSynth)
+    {
+        const float values[] = { midiProcess, internalSynth };
+        return BlockCache::hash (values, sizeof (values), 0);
+    }
+
+    // everything in the signal path that delays the output, reported to the host
+    void updateLatency()
+    {
+        setLatencySamples (chainLatency + embeddedLatency + batchLatency + modelLatency + transportLatency);
+    }
+
+    LimitedSynthesiser synth;
 
     CriticalSection trackPropertiesLock;
     TrackProperties trackProperties;
@@ -649,7 +1294,7 @@ private:
         synth.addSound (new SineWaveSound());
     }
 
-    void updateCurrentTimeInfoFromHost()
+    AudioPlayHead::CurrentPositionInfo updateCurrentTimeInfoFromHost()
     {
         const auto newInfo = [&]
         {
@@ -668,13 +1313,22 @@ private:
         }();
 
         lastPosInfo.set (newInfo);
+        return newInfo;
     }
 
+    // the main bus can be anything up to maxChannels; the sidechain and aux
+    // inputs are off until the host turns them on, and only go to a worker
+    // that subscribes to them
+    enum { sidechainBus = 1, auxBus = 2, maxChannels = 32 };
+
     static BusesProperties getBusesProperties()
     {
-        return BusesProperties().withInput  ("Input",  AudioChannelSet::stereo(), true)
-                                .withOutput ("Output", AudioChannelSet::stereo(), true);
+        return BusesProperties().withInput  ("Input",     AudioChannelSet::stereo(), true)
+                                .withOutput ("Output",    AudioChannelSet::stereo(), true)
+                                .withInput  ("Sidechain", AudioChannelSet::stereo(), false)
+                                .withInput  ("Aux",       AudioChannelSet::stereo(), false);
     }
 
+    JUCE_DECLARE_WEAK_REFERENCEABLE (JuceDemoPluginAudioProcessor)
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (JuceDemoPluginAudioProcessor)
 };
@@ -0,0 +1,356 @@
+#pragma once
+
+// Cross-instance batching. Instances that opt in (the "batchHub" state
+// property) don't get a worker each; they take a seat at one hub per host
+// process, and the hub talks to a single worker on its own port:
+//
+//   kind batch, channels = rows * channelsPerRow, samples, current = rows,
+//   windowOffset = period, int16 [rows][channelsPerRow][samples]
+//
+// A row is a seat and keeps its number for as long as the instance holds it,
+// so a stateful model can keep per-row state. Rows that had nothing for this
+// period are zeros. The worker answers with the same layout (int16, or float32
+// with the flag) and the same windowOffset, and each row goes back to its
+// instance. A period goes out once every seat that's playing has queued a
+// block, or after half a block if some are late. Each instance gets its block
+// back exactly two blocks later, half a block for the other seats to catch up
+// and the rest for the worker; a block that isn't back by then is silence and
+// is thrown away when it comes, or given up on at the next block if it never
+// does. The delay is two process() calls, reported to the host as two of the
+// blocks prepareToPlay promised; a host that sends shorter blocks hears it
+// that much earlier than it was told.
+//
+// Batching is audio only. A batched instance has no worker socket of its own:
+// no MIDI or transport goes out, and there's no MIDI back to drive the
+// internal synth with the MIDI-processing mode on.
+
+class BatchHub;
+
+// one instance's seat, made and dropped off the audio thread
+class BatchMember {
+public:
+    enum { numSlots = 8, blocksBehind = 2 };
+
+    BatchMember(int numChannels_, int maxBlockSize_, double sampleRate)
+        : numChannels(numChannels_), maxBlockSize(maxBlockSize_),
+          blockMs(1000.0 * maxBlockSize_ / jmax(1.0, sampleRate)) {
+        for (auto& slot : slots) {
+            slot.audio.allocate((size_t)(numChannels * maxBlockSize), true);
+        }
+        join();
+    }
+
+    ~BatchMember() { leave(); }
+
+    bool isConnected() const;
+
+    // audio thread: queue this block for the next period, dropped if the
+    // ring is full. It's due blocksBehind pull()s from now
+    void push(const AudioBuffer<float>& buffer, int channels, int numSamples);
+
+    // audio thread, once per block after push(): the block pushed
+    // blocksBehind blocks ago, false if the worker hasn't answered it. Blocks
+    // due earlier are dropped on the way, answered late or not at all.
+    bool pull(AudioBuffer<float>& buffer, int channels, int numSamples) {
+        auto now = blockCount++;
+        for (;;) {
+            auto& slot = slots[readIndex];
+            auto state = slot.state.load(std::memory_order_acquire);
+            // nothing was pushed for this block, or it isn't due yet
+            if (state == slotFree || slot.due > now) {
+                return false;
+            }
+            if (slot.due == now) {
+                if (state != slotDone) return false;
+                break;
+            }
+            // one the worker has is taken back unless its reply is being
+            // written right now; one the hub hasn't sent yet goes out first
+            if (state == slotDone) {
+                slot.state.store(slotFree, std::memory_order_release);
+            } else if (state != slotSent || !slot.state.compare_exchange_strong(state, slotFree, std::memory_order_acq_rel)) {
+                return false;
+            }
+            readIndex = (readIndex + 1) % numSlots;
+        }
+        auto& slot = slots[readIndex];
+        auto n = jmin(numSamples, slot.numSamples);
+        for (int ch = 0; ch < jmin(channels, numChannels); ch++) {
+            FloatVectorOperations::copy(buffer.getWritePointer(ch), slot.audio.get() + ch * maxBlockSize, n);
+            if (n < numSamples) FloatVectorOperations::clear(buffer.getWritePointer(ch) + n, numSamples - n);
+        }
+        slot.state.store(slotFree, std::memory_order_release);
+        readIndex = (readIndex + 1) % numSlots;
+        return true;
+    }
+
+private:
+    friend class BatchHub;
+    // free and done are the seat's, queued and receiving the hub's; sent is
+    // the hub's until the seat takes it back
+    enum { slotFree, slotQueued, slotSent, slotReceiving, slotDone };
+
+    struct Slot {
+        std::atomic<int> state{ slotFree };
+        int numSamples = 0;
+        int64 period = -1;
+        int64 due = 0;            // the pull() it's played at, audio thread only
+        double queuedAt = 0.0;
+        HeapBlock<float> audio;
+    };
+
+    void join();
+    void leave();
+
+    SharedResourcePointer<BatchHub> hub;
+    int numChannels, maxBlockSize;
+    double blockMs;
+    int row = -1;
+    Slot slots[numSlots];
+    int writeIndex = 0, readIndex = 0;      // audio thread
+    int64 blockCount = 0;                   // audio thread, pull() calls so far
+    int sendIndex = 0;                      // hub thread
+    std::atomic<double> lastPush{ 0.0 };
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(BatchMember)
+};
+
+class BatchHub : private juce::Thread {
+public:
+    enum { port = 11587, maxRows = 64, periodsInFlight = 16 };
+
+    // SharedResourcePointer makes this when the first seat is taken and
+    // deletes it with the last one
+    BatchHub() : Thread("typhon batch"), server(*this) {
+        for (auto& period : inFlight) {
+            for (auto& index : period) index = -1;
+        }
+        if (!server.beginWaitingForSocket(port)) {
+            DBG("Batch hub couldn't listen on " << (int)port);
+        }
+        startThread();
+    }
+
+    ~BatchHub() override {
+        stopThread(1000);
+        server.stop();
+        std::shared_ptr<Connection> last;
+        {
+            const ScopedLock sl(lock);
+            last = std::move(connection);
+        }
+        // its thread takes the lock to deliver a reply, so not while we hold it
+        if (last != nullptr) last->disconnect();
+    }
+
+    bool isConnected() const { return connected.load(); }
+
+    int join(BatchMember* member) {
+        const ScopedLock sl(lock);
+        for (int r = 0; r < maxRows; r++) {
+            if (rows[r] == nullptr) {
+                rows[r] = member;
+                return r;
+            }
+        }
+        return -1;
+    }
+
+    // once this returns the hub won't touch the member again
+    void leave(int row) {
+        const ScopedLock sl(lock);
+        if (row >= 0) rows[row] = nullptr;
+    }
+
+private:
+    class Connection : public juce::InterprocessConnection {
+    public:
+        // callbacks on the connection's own thread so replies don't queue behind the UI
+        Connection(BatchHub& hub_) : InterprocessConnection(false, 15), hub(hub_) {}
+        ~Connection() override { disconnect(); }
+        void connectionMade() override { hub.connected = true; }
+        void connectionLost() override { hub.connected = false; }
+        void messageReceived(const MemoryBlock& msg) override { hub.receive(msg); }
+    private:
+        BatchHub& hub;
+    };
+
+    class Server : public juce::InterprocessConnectionServer {
+    public:
+        Server(BatchHub& hub_) : hub(hub_) {}
+    protected:
+        InterprocessConnection* createConnectionObject() override { return hub.createConnection(); }
+    private:
+        BatchHub& hub;
+    };
+
+    // the server's thread
+    InterprocessConnection* createConnection() {
+        auto next = std::make_shared<Connection>(*this);
+        std::shared_ptr<Connection> previous;
+        {
+            const ScopedLock sl(lock);
+            previous = std::move(connection);
+            connection = next;
+        }
+        // one worker at a time, a new one takes over. Disconnecting waits
+        // for its thread, which may want the lock for a reply; a period going
+        // out on it keeps it alive until sendMessage returns
+        if (previous != nullptr) previous->disconnect();
+        return next.get();
+    }
+
+    // polls rather than being woken, so push() doesn't signal from the
+    // audio thread
+    void run() override {
+        while (!threadShouldExit()) {
+            if (!sendPeriod()) wait(1);
+        }
+    }
+
+    // gathers one queued block from every seat that has one, false if it's
+    // not time yet. The seats are read under the lock, the socket is written
+    // outside it
+    bool sendPeriod() {
+        std::shared_ptr<Connection> target;
+        {
+            const ScopedLock sl(lock);
+            if (connection == nullptr || !connected || !gatherPeriod()) return false;
+            target = connection;
+        }
+        target->sendMessage(message);
+        return true;
+    }
+
+    // under the lock: builds the next period in `message`, false if it's not
+    // time yet
+    bool gatherPeriod() {
+        auto now = Time::getMillisecondCounterHiRes();
+        int ready = 0, playing = 0, numRows = 0, channelsPerRow = 1, numSamples = 0;
+        double oldest = now, patience = 1.0e9;
+        for (int r = 0; r < maxRows; r++) {
+            auto* member = rows[r];
+            if (member == nullptr) continue;
+            numRows = r + 1;
+            channelsPerRow = jmax(channelsPerRow, member->numChannels);
+            auto& slot = member->slots[member->sendIndex];
+            auto queued = slot.state.load(std::memory_order_acquire) == BatchMember::slotQueued;
+            // seats that stopped calling process (bypassed, transport stopped) don't hold anyone up
+            if (queued || now - member->lastPush.load() < 2.0 * member->blockMs) {
+                playing++;
+                patience = jmin(patience, 0.5 * member->blockMs);
+            }
+            if (queued) {
+                ready++;
+                oldest = jmin(oldest, slot.queuedAt);
+                numSamples = jmax(numSamples, slot.numSamples);
+            }
+        }
+        if (ready == 0 || (ready < playing && now - oldest < patience)) return false;
+
+        FrameHeader header;
+        header.kind = FrameHeader::batch;
+        header.seq = (uint32)period;
+        header.channels = (uint16)(numRows * channelsPerRow);
+        header.samples = (uint32)numSamples;
+        header.current = (uint32)numRows;
+        header.windowOffset = period;
+        message.setSize(FrameHeader::size + header.getPayloadBytes());
+        message.fillWith(0);
+        header.write((uint8*)message.getData());
+
+        auto samples = (int16*)((uint8*)message.getData() + FrameHeader::size);
+        auto& sent = inFlight[period % periodsInFlight];
+        for (auto& index : sent) index = -1;
+        for (int r = 0; r < numRows; r++) {
+            auto* member = rows[r];
+            if (member == nullptr) continue;
+            auto& slot = member->slots[member->sendIndex];
+            if (slot.state.load(std::memory_order_acquire) != BatchMember::slotQueued) continue;
+            for (int ch = 0; ch < member->numChannels; ch++) {
+                auto dest = samples + ((size_t)r * channelsPerRow + ch) * numSamples;
+                SampleConversion::toInt16(dest, slot.audio.get() + ch * member->maxBlockSize, slot.numSamples);
+            }
+            slot.period = period;
+            slot.state.store(BatchMember::slotSent, std::memory_order_release);
+            sent[r] = member->sendIndex;
+            member->sendIndex = (member->sendIndex + 1) % BatchMember::numSlots;
+        }
+        period++;
+        return true;
+    }
+
+    // the connection's thread: scatter the rows back to their seats
+    void receive(const MemoryBlock& msg) {
+        FrameHeader header;
+        if (!FrameHeader::read(msg, header) || header.kind != FrameHeader::batch
+            || header.current == 0 || header.windowOffset < 0) return;
+        auto numRows = jmin((int)header.current, (int)maxRows);
+        auto channelsPerRow = (int)(header.channels / header.current);
+        auto numSamples = (int)header.samples;
+        auto src = (const uint8*)msg.getData() + header.headerBytes;
+        auto isFloat = (header.flags & FrameHeader::float32) != 0;
+
+        const ScopedLock sl(lock);
+        auto& sent = inFlight[header.windowOffset % periodsInFlight];
+        for (int r = 0; r < numRows; r++) {
+            auto* member = rows[r];
+            auto index = sent[r];
+            sent[r] = -1;
+            if (member == nullptr || index < 0) continue;
+            auto& slot = member->slots[index];
+            // the seat may have given up on it already, see pull()
+            int expected = BatchMember::slotSent;
+            if (slot.period != header.windowOffset
+                || !slot.state.compare_exchange_strong(expected, BatchMember::slotReceiving, std::memory_order_acq_rel)) continue;
+
+            auto n = jmin(numSamples, slot.numSamples);
+            for (int ch = 0; ch < member->numChannels; ch++) {
+                auto dest = slot.audio.get() + ch * member->maxBlockSize;
+                if (ch >= channelsPerRow) {
+                    FloatVectorOperations::clear(dest, slot.numSamples);
+                    continue;
+                }
+                auto offset = ((size_t)r * channelsPerRow + ch) * numSamples;
+                if (isFloat) memcpy(dest, (const float*)src + offset, (size_t)n * sizeof(float));
+                else SampleConversion::toFloat(dest, (const int16*)src + offset, n);
+                if (n < slot.numSamples) FloatVectorOperations::clear(dest + n, slot.numSamples - n);
+            }
+            slot.state.store(BatchMember::slotDone, std::memory_order_release);
+        }
+    }
+
+    CriticalSection lock;
+    BatchMember* rows[maxRows] = {};
+    int inFlight[periodsInFlight][maxRows];
+    int64 period = 0;
+    MemoryBlock message;
+    std::atomic<bool> connected{ false };
+    std::shared_ptr<Connection> connection;
+    Server server;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(BatchHub)
+};
+
+inline void BatchMember::join() { row = hub->join(this); }
+inline void BatchMember::leave() { hub->leave(row); }
+inline bool BatchMember::isConnected() const { return hub->isConnected(); }
+
+inline void BatchMember::push(const AudioBuffer<float>& buffer, int channels, int numSamples) {
+    lastPush = Time::getMillisecondCounterHiRes();
+    auto& slot = slots[writeIndex];
+    if (row < 0 || !hub->isConnected() || numSamples > maxBlockSize
+        || slot.state.load(std::memory_order_acquire) != slotFree) {
+        return;
+    }
+    slot.numSamples = numSamples;
+    slot.due = blockCount + blocksBehind;
+    slot.queuedAt = lastPush.load();
+    for (int ch = 0; ch < numChannels; ch++) {
+        auto dest = slot.audio.get() + ch * maxBlockSize;
+        if (ch < channels) FloatVectorOperations::copy(dest, buffer.getReadPointer(ch), numSamples);
+        else FloatVectorOperations::clear(dest, numSamples);
+    }
+    slot.state.store(slotQueued, std::memory_order_release);
+    writeIndex = (writeIndex + 1) % numSlots;
+}
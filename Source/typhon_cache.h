@@ -0,0 +1,201 @@
+#pragma once
+
+// Reply cache. Loops and repeated bounces send the same blocks over and over;
+// a worker whose answer depends only on the frame can say so
+//   HELO proto=2;deterministic=1;version=plate-v3;cache=64
+// and every frame is then hashed (XXH64 of its samples and MIDI, plus the
+// version tag) before it goes out. A frame heard before isn't sent at all:
+// the reply it got last time is played in its place, one block later, just
+// as if it had come back. The cache holds up to `cache` MB of replies
+// (default 64) and drops the least recently played first.
+//
+// The tag is whatever the worker wants it to be (a model hash, its parameter
+// state..); when it changes, the worker sends
+//   VERS <tag>
+// and from then on only replies made under the new tag are played. Old ones
+// age out, or come back if the tag does.
+//
+// Only plain audio frames are cached: not with a context window, quanta,
+// transport or a sidecar, where the reply depends on more than the frame.
+// Frames answered from the cache never go out, so the worker sees gaps in seq.
+
+class BlockCache {
+public:
+    enum { keysInFlight = 256 };
+
+    explicit BlockCache(size_t budgetBytes_) : budget(budgetBytes_) {
+        for (auto& key : pending) {
+            key.seq = 0;
+            key.valid = false;
+        }
+    }
+
+    // "VERS <tag>" from the worker, false for anything else
+    static bool isVersion(const MemoryBlock& msg, String& tag) {
+        auto size = msg.getSize();
+        if (size < 5 || size > 1024 || memcmp(msg.getData(), "VERS ", 5) != 0) return false;
+        tag = String::fromUTF8((const char*)msg.getData() + 5, (int)size - 5).trim();
+        return true;
+    }
+
+    static uint64 hashTag(const String& tag) {
+        return hash(tag.toRawUTF8(), tag.getNumBytesAsUTF8(), 0);
+    }
+
+    // what the worker would see, minus the things that change every frame
+    // (seq, windowOffset, keyframe)
+    static uint64 keyFor(FrameRef frame, uint64 tag) {
+        FrameHeader header;
+        if (!FrameHeader::read(frame, header)) return 0;
+        uint32 shape[4] = { header.channels, (uint32)(header.flags & ~FrameHeader::keyframe), header.samples, header.current };
+        auto seed = hash(shape, sizeof(shape), tag);
+        return hash((const uint8*)frame.getData() + header.headerBytes, frame.getSize() - header.headerBytes, seed);
+    }
+
+    // audio thread: the reply for `key` into audio/midi, false if there isn't
+    // one or the message thread has the cache right now
+    bool lookup(uint64 key, MemoryBlock& audio, MemoryBlock& midi, bool& silent) {
+        const SpinLock::ScopedTryLockType sl(lock);
+        if (!sl.isLocked()) return false;
+        auto found = index.find(key);
+        if (found == index.end()) {
+            misses++;
+            return false;
+        }
+        // most recently played goes to the front, nothing allocated
+        entries.splice(entries.begin(), entries, found->second);
+        auto& entry = *found->second;
+        audio.replaceWith(entry.audio.getData(), entry.audio.getSize());
+        midi.replaceWith(entry.midi.getData(), entry.midi.getSize());
+        silent = entry.silent;
+        hits++;
+        return true;
+    }
+
+    // audio thread: frame `seq` went out with this key, its reply goes in under it
+    void expect(uint32 seq, uint64 key) {
+        auto& slot = pending[seq % keysInFlight];
+        slot.valid.store(false, std::memory_order_release);
+        slot.key = key;
+        slot.seq = seq;
+        slot.valid.store(true, std::memory_order_release);
+    }
+
+    // message thread: the reply to frame `seq`, if it was one we're waiting on
+    void store(uint32 seq, const MemoryBlock& audio, const MemoryBlock& midi, bool silent) {
+        auto& slot = pending[seq % keysInFlight];
+        if (!slot.valid.exchange(false, std::memory_order_acq_rel) || slot.seq != seq) return;
+        auto key = slot.key;
+
+        auto cost = audio.getSize() + midi.getSize() + entryOverhead;
+        if (cost > budget) return;
+        std::list<Entry> evicted;
+        {
+            const SpinLock::ScopedLockType sl(lock);
+            auto found = index.find(key);
+            if (found != index.end()) {
+                used -= found->second->cost;
+                evicted.splice(evicted.end(), entries, found->second);
+                index.erase(found);
+            }
+            entries.emplace_front();
+            auto& entry = entries.front();
+            entry.key = key;
+            entry.audio = audio;
+            entry.midi = midi;
+            entry.silent = silent;
+            entry.cost = cost;
+            index[key] = entries.begin();
+            used += cost;
+            while (used > budget) {
+                auto last = std::prev(entries.end());
+                used -= last->cost;
+                index.erase(last->key);
+                evicted.splice(evicted.end(), entries, last);
+            }
+        }
+        // freed out here so the audio thread never waits on it
+    }
+
+    uint32 getNumHits() const { return hits.load(); }
+    uint32 getNumMisses() const { return misses.load(); }
+
+    // XXH64, enough of it for one contiguous buffer
+    static uint64 hash(const void* data, size_t length, uint64 seed) {
+        auto p = (const uint8*)data;
+        auto end = p + length;
+        uint64 h;
+        if (length >= 32) {
+            uint64 v1 = seed + prime1 + prime2, v2 = seed + prime2, v3 = seed, v4 = seed - prime1;
+            do {
+                v1 = round(v1, read64(p));
+                v2 = round(v2, read64(p + 8));
+                v3 = round(v3, read64(p + 16));
+                v4 = round(v4, read64(p + 24));
+                p += 32;
+            } while (p + 32 <= end);
+            h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+            h = merge(h, v1);
+            h = merge(h, v2);
+            h = merge(h, v3);
+            h = merge(h, v4);
+        } else {
+            h = seed + prime5;
+        }
+        h += (uint64)length;
+        for (; p + 8 <= end; p += 8) {
+            h ^= round(0, read64(p));
+            h = rotl(h, 27) * prime1 + prime4;
+        }
+        if (p + 4 <= end) {
+            h ^= (uint64)read32(p) * prime1;
+            h = rotl(h, 23) * prime2 + prime3;
+            p += 4;
+        }
+        for (; p < end; p++) {
+            h ^= (uint64)*p * prime5;
+            h = rotl(h, 11) * prime1;
+        }
+        h ^= h >> 33;
+        h *= prime2;
+        h ^= h >> 29;
+        h *= prime3;
+        h ^= h >> 32;
+        return h;
+    }
+
+private:
+    static constexpr uint64 prime1 = 0x9E3779B185EBCA87ULL, prime2 = 0xC2B2AE3D27D4EB4FULL,
+                            prime3 = 0x165667B19E3779F9ULL, prime4 = 0x85EBCA77C2B2AE63ULL,
+                            prime5 = 0x27D4EB2F165667C5ULL;
+    // the list node, the map's share and the two MemoryBlocks, roughly
+    static constexpr size_t entryOverhead = 128;
+
+    static uint64 rotl(uint64 x, int r) { return (x << r) | (x >> (64 - r)); }
+    static uint64 round(uint64 acc, uint64 input) { return rotl(acc + input * prime2, 31) * prime1; }
+    static uint64 merge(uint64 acc, uint64 v) { return (acc ^ round(0, v)) * prime1 + prime4; }
+    static uint64 read64(const uint8* p) { uint64 v; memcpy(&v, p, 8); return ByteOrder::swapIfBigEndian(v); }
+    static uint32 read32(const uint8* p) { uint32 v; memcpy(&v, p, 4); return ByteOrder::swapIfBigEndian(v); }
+
+    struct Entry {
+        uint64 key = 0;
+        MemoryBlock audio, midi;
+        bool silent = false;
+        size_t cost = 0;
+    };
+
+    struct PendingKey {
+        std::atomic<bool> valid;
+        uint32 seq;
+        uint64 key;
+    };
+
+    SpinLock lock;
+    size_t budget, used = 0;
+    std::list<Entry> entries;                                   // most recently played first
+    std::unordered_map<uint64, std::list<Entry>::iterator> index;
+    PendingKey pending[keysInFlight];
+    std::atomic<uint32> hits{ 0 }, misses{ 0 };
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(BlockCache)
+};
@@ -0,0 +1,221 @@
+#pragma once
+
+// Wire capture. With a capture directory set (the "wireCapture" state
+// property) every message a worker connection sends or receives is logged to
+// <dir>/typhon-<date>-<time>.tycap, one file per worker, for typhon_replay.py
+// to play back against the plugin or a worker. All little-endian:
+//
+//   file header, 64 bytes
+//     0  "TYCP"
+//     4  u32 format (1)
+//     8  i64 start, ms since 1970
+//    16  u32 flags (headersOnly 1)
+//    20  reserved
+//   records from 64, each 8-byte aligned
+//     0  u32 storedBytes   (what follows, the whole message or just its header)
+//     4  u32 wireBytes     (how big it was on the wire)
+//     8  i64 micros        (since start)
+//    16  u32 seq           v2 frames only, else 0
+//    20  u16 kind          v2 frames only, else 0xffff
+//    22  u16 flags         v2 frames only
+//    24  u8  direction     (toWorker 0, fromWorker 1)
+//    25  reserved to 32, then storedBytes of message, padded to 8
+//   index, written when the log closes
+//     u64 offset of every record, then
+//     "TYIX", u32 count, u64 offset of the index, u32 dropped, u32 reserved
+//
+// A log that wasn't closed (the host crashed) has no index and is read by
+// walking the records. Messages are copied into one ring per sending thread
+// and this thread writes them out in time order; when a ring is full the
+// message is dropped and counted, the audio thread never waits.
+
+class WireLog : private juce::Thread {
+public:
+    enum Direction { toWorker = 0, fromWorker = 1 };
+    enum { headerBytes = 64, recordBytes = 32, format = 1, headersOnlyFlag = 1, ringBytes = 4 << 20 };
+
+    WireLog(const File& file_, bool headersOnly_)
+        : Thread("typhon capture"), file(file_), headersOnly(headersOnly_),
+          start(Time::getMillisecondCounterHiRes()) {
+        for (auto& ring : rings) {
+            ring.data.allocate((size_t)ringBytes, false);
+        }
+        startThread();
+    }
+
+    ~WireLog() override {
+        close();
+    }
+
+    // message thread: writes the index and closes the file. The audio thread
+    // can still be adding to it until it lets go, that's dropped
+    void close() {
+        stopThread(2000);
+        out.reset();
+    }
+
+    // one producer per ring: the audio thread sends frames, the message thread
+    // receives everything and sends the odd EHLO/RSUM
+    void audioThread(Direction direction, FrameRef message) { add(rings[0], direction, message); }
+    void messageThread(Direction direction, FrameRef message) { add(rings[1], direction, message); }
+
+    uint32 getNumDropped() const { return dropped.load(); }
+
+private:
+    struct Ring {
+        HeapBlock<uint8> data;
+        AbstractFifo fifo{ ringBytes };
+    };
+
+    struct Record {
+        uint32 storedBytes = 0, wireBytes = 0;
+        int64 micros = 0;
+        uint32 seq = 0;
+        uint16 kind = 0xffff, flags = 0;
+        uint8 direction = 0;
+    };
+
+    void add(Ring& ring, Direction direction, FrameRef message) {
+        Record record;
+        record.wireBytes = (uint32)message.getSize();
+        record.storedBytes = record.wireBytes;
+        record.micros = (int64)((Time::getMillisecondCounterHiRes() - start) * 1000.0);
+        record.direction = (uint8)direction;
+        FrameHeader header;
+        if (FrameHeader::read(message, header)) {
+            record.seq = header.seq;
+            record.kind = header.kind;
+            record.flags = header.flags;
+            if (headersOnly) record.storedBytes = jmin(record.wireBytes, (uint32)header.headerBytes);
+        }
+        uint8 head[recordBytes] = {};
+        writeRecord(head, record);
+        auto total = recordBytes + (int)record.storedBytes;
+        if (ring.fifo.getFreeSpace() < total) {
+            dropped++;
+            return;
+        }
+        // in one go, so the reader never sees a record without its message
+        int start1, size1, start2, size2;
+        ring.fifo.prepareToWrite(total, start1, size1, start2, size2);
+        auto copy = [&](int at, const void* src, int bytes) {
+            auto first = jlimit(0, bytes, size1 - at);
+            memcpy(ring.data.get() + start1 + at, src, (size_t)first);
+            memcpy(ring.data.get() + start2 + jmax(0, at - size1), (const uint8*)src + first, (size_t)(bytes - first));
+        };
+        copy(0, head, recordBytes);
+        copy(recordBytes, message.getData(), (int)record.storedBytes);
+        ring.fifo.finishedWrite(total);
+        notify();
+    }
+
+    static void peek(Ring& ring, void* dest, int bytes) {
+        int start1, size1, start2, size2;
+        ring.fifo.prepareToRead(bytes, start1, size1, start2, size2);
+        memcpy(dest, ring.data.get() + start1, (size_t)size1);
+        memcpy((uint8*)dest + size1, ring.data.get() + start2, (size_t)size2);
+    }
+
+    static void writeRecord(uint8* dest, const Record& r) {
+        put(dest, r.storedBytes);
+        put(dest + 4, r.wireBytes);
+        put(dest + 8, r.micros);
+        put(dest + 16, r.seq);
+        put(dest + 20, r.kind);
+        put(dest + 22, r.flags);
+        dest[24] = r.direction;
+    }
+
+    void run() override {
+        file.getParentDirectory().createDirectory();
+        out = std::make_unique<FileOutputStream>(file);
+        if (out->failedToOpen()) {
+            DBG("Couldn't open the capture file " << file.getFullPathName());
+            return;
+        }
+        out->setPosition(0);
+        out->truncate();
+        uint8 header[headerBytes] = {};
+        memcpy(header, "TYCP", 4);
+        put(header + 4, (uint32)format);
+        put(header + 8, Time::currentTimeMillis() - (int64)(Time::getMillisecondCounterHiRes() - start));
+        put(header + 16, (uint32)(headersOnly ? headersOnlyFlag : 0));
+        out->write(header, headerBytes);
+        written = headerBytes;
+
+        while (!threadShouldExit()) {
+            drain();
+            out->flush();
+            wait(50);
+        }
+        drain();
+
+        // the index, so a reader can jump straight to any record
+        auto indexOffset = written;
+        for (auto offset : offsets) out->writeInt64((int64)offset);
+        out->write("TYIX", 4);
+        out->writeInt((int)offsets.size());
+        out->writeInt64((int64)indexOffset);
+        out->writeInt((int)dropped.load());
+        out->writeInt(0);
+        out->flush();
+    }
+
+    // everything queued so far, oldest first across both rings
+    void drain() {
+        uint8 heads[2][recordBytes];
+        for (;;) {
+            int next = -1;
+            int64 earliest = 0;
+            for (int r = 0; r < 2; r++) {
+                if (rings[r].fifo.getNumReady() < recordBytes) continue;
+                peek(rings[r], heads[r], recordBytes);
+                int64 micros;
+                memcpy(&micros, heads[r] + 8, sizeof(micros));
+                micros = ByteOrder::swapIfBigEndian(micros);
+                if (next < 0 || micros < earliest) {
+                    next = r;
+                    earliest = micros;
+                }
+            }
+            if (next < 0) return;
+
+            auto& ring = rings[next];
+            uint32 stored;
+            memcpy(&stored, heads[next], sizeof(stored));
+            stored = ByteOrder::swapIfBigEndian(stored);
+            ring.fifo.finishedRead(recordBytes);
+            payload.ensureSize(stored);
+            peek(ring, payload.getData(), (int)stored);
+            ring.fifo.finishedRead((int)stored);
+
+            static const uint8 padding[8] = {};
+            offsets.push_back(written);
+            out->write(heads[next], recordBytes);
+            out->write(payload.getData(), stored);
+            auto pad = (8 - (stored & 7)) & 7;
+            out->write(padding, pad);
+            written += recordBytes + stored + pad;
+        }
+    }
+
+    template <typename T>
+    static void put(uint8* dest, T value) {
+        value = ByteOrder::swapIfBigEndian(value);
+        memcpy(dest, &value, sizeof(T));
+    }
+
+    File file;
+    bool headersOnly;
+    double start;
+    Ring rings[2];
+    std::atomic<uint32> dropped{ 0 };
+
+    // this thread only, then close()
+    std::unique_ptr<FileOutputStream> out;
+    uint64 written = 0;
+    std::vector<uint64> offsets;
+    MemoryBlock payload;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(WireLog)
+};
@@ -0,0 +1,172 @@
+#pragma once
+
+// Control-rate replies. A worker that only steers a gain or a filter doesn't
+// have to send audio back; it answers each frame with a few numbers and the
+// plugin renders them at full rate on the audio it already has:
+//   HELO proto=2;produces=control,midi;controls=gain,lowpass,peaking
+// The reply is kind control, float32, channels 1, with the values for each
+// entry of `controls` one after another:
+//   gain                     linear gain
+//   biquad                   b0 b1 b2 a1 a2, already divided by a0
+//   lowpass/highpass/bandpass  frequency in Hz, Q
+//   peaking                  frequency in Hz, gain in dB, Q
+// A shorter reply only updates the entries it reaches. Until the first one
+// arrives everything is unity. Each new target is ramped to per sample over
+// the next block, filters by their coefficients (a straight line between two
+// stable biquads stays stable). Control replaces audio in the reply: the
+// block's own audio is what gets processed.
+
+class ControlRenderer {
+public:
+    enum { maxValues = 256, slots = 8 };
+
+    static std::unique_ptr<ControlRenderer> fromSpec(const String& spec) {
+        auto renderer = std::make_unique<ControlRenderer>();
+        for (auto& token : StringArray::fromTokens(spec, ",", "")) {
+            auto name = token.trim().toLowerCase();
+            Entry entry;
+            if (name == "gain") entry = { Entry::gain, 1 };
+            else if (name == "biquad") entry = { Entry::biquad, 5 };
+            else if (name == "lowpass") entry = { Entry::lowpass, 2 };
+            else if (name == "highpass") entry = { Entry::highpass, 2 };
+            else if (name == "bandpass") entry = { Entry::bandpass, 2 };
+            else if (name == "peaking") entry = { Entry::peaking, 3 };
+            else {
+                DBG("Unknown control: " << token);
+                continue;
+            }
+            if (renderer->numValues + entry.numValues > maxValues) break;
+            renderer->numValues += entry.numValues;
+            renderer->entries.push_back(entry);
+        }
+        return renderer;
+    }
+
+    void prepare(double sampleRate_, int numChannels_) {
+        sampleRate = sampleRate_;
+        numChannels = numChannels_;
+        for (auto& entry : entries) {
+            entry.current = entry.target = Coeffs();
+            entry.state.assign((size_t)numChannels * 4, 0.0f);
+        }
+        incoming.allocate((size_t)(slots * maxValues), true);
+        incomingCounts.allocate((size_t)slots, true);
+        fifo.setTotalSize(slots);
+    }
+
+    int getNumValues() const { return numValues; }
+
+    // message thread: queue a reply, dropped if the audio thread is that far behind
+    void receive(const float* values, int count) {
+        int start1, size1, start2, size2;
+        fifo.prepareToWrite(1, start1, size1, start2, size2);
+        if (size1 == 0) return;
+        count = jmin(count, numValues);
+        memcpy(incoming.get() + (size_t)start1 * maxValues, values, (size_t)count * sizeof(float));
+        incomingCounts[start1] = count;
+        fifo.finishedWrite(1);
+    }
+
+    // audio thread: take whatever came in since last block, ramp to it
+    void process(AudioBuffer<float>& buffer, int channels, int numSamples) {
+        if (numSamples <= 0) return;
+        channels = jmin(channels, numChannels);
+        int start1, size1, start2, size2;
+        fifo.prepareToRead(fifo.getNumReady(), start1, size1, start2, size2);
+        for (int i = 0; i < size1; i++) apply(start1 + i);
+        for (int i = 0; i < size2; i++) apply(start2 + i);
+        fifo.finishedRead(size1 + size2);
+
+        for (auto& entry : entries) {
+            if (entry.type == Entry::gain) processGain(entry, buffer, channels, numSamples);
+            else processBiquad(entry, buffer, channels, numSamples);
+            entry.current = entry.target;
+        }
+    }
+
+private:
+    // a gain is just b0, so every entry ramps the same five numbers
+    struct Coeffs {
+        float b0 = 1.0f, b1 = 0.0f, b2 = 0.0f, a1 = 0.0f, a2 = 0.0f;
+    };
+
+    struct Entry {
+        enum Type { gain, biquad, lowpass, highpass, bandpass, peaking };
+        Type type = gain;
+        int numValues = 1;
+        Coeffs current, target;
+        std::vector<float> state; // x1 x2 y1 y2 per channel
+
+        Entry() = default;
+        Entry(Type type_, int numValues_) : type(type_), numValues(numValues_) {}
+    };
+
+    void apply(int slot) {
+        auto values = incoming.get() + (size_t)slot * maxValues;
+        auto count = incomingCounts[slot];
+        int offset = 0;
+        for (auto& entry : entries) {
+            if (offset + entry.numValues > count) break;
+            entry.target = toCoeffs(entry.type, values + offset);
+            offset += entry.numValues;
+        }
+    }
+
+    Coeffs toCoeffs(Entry::Type type, const float* v) const {
+        Coeffs result;
+        if (type == Entry::gain) {
+            result.b0 = v[0];
+            return result;
+        }
+        if (type == Entry::biquad) {
+            result.b0 = v[0]; result.b1 = v[1]; result.b2 = v[2]; result.a1 = v[3]; result.a2 = v[4];
+            return result;
+        }
+        auto freq = jlimit(10.0, sampleRate * 0.49, (double)v[0]);
+        auto q = jmax(0.01, (double)v[type == Entry::peaking ? 2 : 1]);
+        BiquadCoeffs c;
+        if (type == Entry::lowpass) c = BiquadCoeffs::lowpass(sampleRate, freq, q);
+        else if (type == Entry::highpass) c = BiquadCoeffs::highpass(sampleRate, freq, q);
+        else if (type == Entry::bandpass) c = BiquadCoeffs::bandpass(sampleRate, freq, q);
+        else c = BiquadCoeffs::peaking(sampleRate, freq, v[1], q);
+        result.b0 = c.b0; result.b1 = c.b1; result.b2 = c.b2; result.a1 = c.a1; result.a2 = c.a2;
+        return result;
+    }
+
+    static void processGain(const Entry& entry, AudioBuffer<float>& buffer, int channels, int numSamples) {
+        auto from = entry.current.b0, to = entry.target.b0;
+        for (int ch = 0; ch < channels; ch++) {
+            if (from == to) buffer.applyGain(ch, 0, numSamples, to);
+            else buffer.applyGainRamp(ch, 0, numSamples, from, to);
+        }
+    }
+
+    static void processBiquad(Entry& entry, AudioBuffer<float>& buffer, int channels, int numSamples) {
+        auto c = entry.current;
+        auto t = entry.target;
+        auto step = 1.0f / numSamples;
+        Coeffs d{ (t.b0 - c.b0) * step, (t.b1 - c.b1) * step, (t.b2 - c.b2) * step, (t.a1 - c.a1) * step, (t.a2 - c.a2) * step };
+        for (int ch = 0; ch < channels; ch++) {
+            auto data = buffer.getWritePointer(ch);
+            auto st = entry.state.data() + ch * 4;
+            auto x1 = st[0], x2 = st[1], y1 = st[2], y2 = st[3];
+            auto k = c;
+            for (int i = 0; i < numSamples; i++) {
+                k.b0 += d.b0; k.b1 += d.b1; k.b2 += d.b2; k.a1 += d.a1; k.a2 += d.a2;
+                auto x = data[i];
+                auto y = k.b0 * x + k.b1 * x1 + k.b2 * x2 - k.a1 * y1 - k.a2 * y2;
+                x2 = x1; x1 = x;
+                y2 = y1; y1 = y;
+                data[i] = y;
+            }
+            st[0] = x1; st[1] = x2; st[2] = y1; st[3] = y2;
+        }
+    }
+
+    double sampleRate = 44100.0;
+    int numChannels = 0, numValues = 0;
+    std::vector<Entry> entries;
+    HeapBlock<float> incoming;
+    HeapBlock<int> incomingCounts;
+    AbstractFifo fifo{ slots };
+};
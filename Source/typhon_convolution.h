@@ -0,0 +1,365 @@
+#pragma once
+
+// Partitioned FFT convolution for impulse responses (cabs, reverbs).
+// The IR is split three ways:
+//   [0, headSize)            direct-form FIR, so nothing is added to latency
+//   [headSize, tailOffset)   uniform partitions of headSize, on the audio thread
+//   [tailOffset, end)        uniform partitions of tailSize, on a background
+//                            thread, which gets a whole tailSize of slack
+// Every FFT segment adds its output into one shared ring, at the position
+// where that part of the IR lands. Only the audio thread touches the ring: the
+// background thread's output is picked up when it's due, and if it isn't
+// finished by then that stretch of tail is dropped rather than waited for.
+
+// Uniformly partitioned overlap-save over one stretch of IR. Each call takes
+// blockSize new input samples and returns blockSize samples of input * segment,
+// lined up with that input block.
+class UniformConvolver {
+public:
+    void prepare(const float* ir, int irLength, int blockSize_) {
+        blockSize = blockSize_;
+        fftSize = 2 * blockSize;
+        specSize = fftSize + 2; // bins 0..N/2, interleaved re/im
+        fft = std::make_unique<dsp::FFT>(roundToInt(std::log2(fftSize)));
+        numPartitions = jmax(1, (irLength + blockSize - 1) / blockSize);
+
+        partitions.allocate((size_t)(numPartitions * specSize), true);
+        fdl.allocate((size_t)(numPartitions * specSize), true);
+        input.allocate((size_t)fftSize, true);
+        work.allocate((size_t)(2 * fftSize), true);
+        acc.allocate((size_t)specSize, true);
+        fdlPos = 0;
+
+        for (int p = 0; p < numPartitions; p++) {
+            FloatVectorOperations::clear(work.get(), 2 * fftSize);
+            auto n = jmin(blockSize, irLength - p * blockSize);
+            if (n > 0) {
+                FloatVectorOperations::copy(work.get(), ir + p * blockSize, n);
+            }
+            fft->performRealOnlyForwardTransform(work.get(), true);
+            FloatVectorOperations::copy(partitions.get() + p * specSize, work.get(), specSize);
+        }
+    }
+
+    void reset() {
+        FloatVectorOperations::clear(fdl.get(), numPartitions * specSize);
+        FloatVectorOperations::clear(input.get(), fftSize);
+        fdlPos = 0;
+    }
+
+    void process(const float* in, float* out) {
+        // slide the input window: [previous block | this block]
+        FloatVectorOperations::copy(input.get(), input.get() + blockSize, blockSize);
+        FloatVectorOperations::copy(input.get() + blockSize, in, blockSize);
+
+        FloatVectorOperations::copy(work.get(), input.get(), fftSize);
+        fft->performRealOnlyForwardTransform(work.get(), true);
+        fdlPos = fdlPos == 0 ? numPartitions - 1 : fdlPos - 1;
+        FloatVectorOperations::copy(fdl.get() + fdlPos * specSize, work.get(), specSize);
+
+        // newest input spectrum pairs with partition 0, the oldest with the last
+        FloatVectorOperations::clear(acc.get(), specSize);
+        for (int p = 0; p < numPartitions; p++) {
+            auto slot = (fdlPos + p) % numPartitions;
+            complexMultiplyAdd(acc.get(), fdl.get() + slot * specSize, partitions.get() + p * specSize, specSize / 2);
+        }
+
+        FloatVectorOperations::copy(work.get(), acc.get(), specSize);
+        fft->performRealOnlyInverseTransform(work.get());
+        FloatVectorOperations::copy(out, work.get() + blockSize, blockSize);
+    }
+
+    int getBlockSize() const { return blockSize; }
+
+private:
+    static void complexMultiplyAdd(float* __restrict acc, const float* __restrict a, const float* __restrict b, int numBins) {
+        for (int i = 0; i < numBins; i++) {
+            auto ar = a[2 * i], ai = a[2 * i + 1];
+            auto br = b[2 * i], bi = b[2 * i + 1];
+            acc[2 * i] += ar * br - ai * bi;
+            acc[2 * i + 1] += ar * bi + ai * br;
+        }
+    }
+
+    int blockSize = 0, fftSize = 0, specSize = 0, numPartitions = 0, fdlPos = 0;
+    std::unique_ptr<dsp::FFT> fft;
+    HeapBlock<float> partitions, fdl, input, work, acc;
+};
+
+class PartitionedConvolution {
+public:
+    enum { headSize = 128, tailSize = 2048, tailOffset = 2 * tailSize };
+
+    PartitionedConvolution() : tailThread(*this) {}
+
+    ~PartitionedConvolution() {
+        tailThread.signalThreadShouldExit();
+        tailThread.notify();
+        tailThread.stopThread(2000);
+    }
+
+    // not on the audio thread; channel c uses IR channel min(c, irChannels - 1)
+    void prepare(const AudioBuffer<float>& ir, int numChannels_, int maxBlockSize) {
+        numChannels = numChannels_;
+        auto irLength = ir.getNumSamples();
+        hasBody = irLength > headSize;
+        hasTail = irLength > tailOffset;
+
+        channels.clear();
+        for (int ch = 0; ch < numChannels; ch++) {
+            auto c = std::make_unique<Channel>();
+            auto h = ir.getReadPointer(jmin(ch, ir.getNumChannels() - 1));
+
+            c->headTaps.allocate(headSize, true);
+            FloatVectorOperations::copy(c->headTaps.get(), h, jmin(irLength, (int)headSize));
+            c->headInput.allocate((size_t)(headSize - 1 + maxBlockSize), true);
+
+            if (hasBody) {
+                c->body.prepare(h + headSize, jmin(irLength, (int)tailOffset) - headSize, headSize);
+            }
+            if (hasTail) {
+                c->tail.prepare(h + tailOffset, irLength - tailOffset, tailSize);
+            }
+            c->bodyInput.allocate(headSize, true);
+            c->bodyOutput.allocate(headSize, true);
+            c->tailInput.allocate(tailSize, true);
+            c->tailJob.allocate(tailSize, true);
+            c->tailOutput.allocate(tailSize, true);
+            c->ring.allocate(ringSize, true);
+            channels.push_back(std::move(c));
+        }
+        wet.setSize(numChannels, maxBlockSize);
+        capacity = maxBlockSize;
+        position = 0;
+        bodyFill = 0;
+        tailFill = 0;
+        tailJobPosition = -1;
+
+        if (hasTail && !tailThread.isThreadRunning()) {
+            tailThread.startThread(8);
+        }
+    }
+
+    // mixRamp is per sample when the mix is moving, nullptr when it's steady at mix
+    void process(AudioBuffer<float>& buffer, int numCh, int numSamples, float mix, const float* mixRamp = nullptr) {
+        numCh = jmin(numCh, numChannels);
+        for (int start = 0; start < numSamples; start += capacity) {
+            processChunk(buffer, numCh, start, jmin(capacity, numSamples - start), mix, mixRamp != nullptr ? mixRamp + start : nullptr);
+        }
+    }
+
+    // stretches of tail the background thread didn't finish in time
+    uint32 getNumTailsDropped() const { return tailsDropped.load(); }
+
+    // reads an IR file and builds a convolution for it, off the audio thread.
+    // The IR is resampled if it wasn't recorded at the host rate.
+    static std::unique_ptr<PartitionedConvolution> fromFile(const File& file, double sampleRate,
+                                                            int numChannels, int maxBlockSize) {
+        AudioFormatManager formats;
+        formats.registerBasicFormats();
+        std::unique_ptr<AudioFormatReader> reader(formats.createReaderFor(file));
+        if (reader == nullptr || reader->lengthInSamples <= 0) {
+            DBG("Couldn't read impulse response " << file.getFullPathName());
+            return nullptr;
+        }
+
+        // ten seconds is plenty for any reverb we'd use
+        auto length = (int)jmin(reader->lengthInSamples, (int64)(reader->sampleRate * 10.0));
+        auto irChannels = jmin((int)reader->numChannels, numChannels);
+        AudioBuffer<float> ir(irChannels, length);
+        reader->read(&ir, 0, length, 0, true, irChannels > 1);
+
+        if (reader->sampleRate != sampleRate) {
+            ir = resample(ir, reader->sampleRate, sampleRate);
+        }
+
+        auto convolution = std::make_unique<PartitionedConvolution>();
+        convolution->prepare(ir, numChannels, maxBlockSize);
+        return convolution;
+    }
+
+    // band-limited, so a 96 kHz IR doesn't fold its top octaves down into a
+    // 44.1 kHz session; fed silence past the end until the filter lets go
+    static AudioBuffer<float> resample(const AudioBuffer<float>& ir, double irRate, double sampleRate) {
+        enum { chunk = 4096 };
+        auto numCh = ir.getNumChannels();
+        auto length = ir.getNumSamples();
+        auto resampledLength = jmax(1, (int)(length * sampleRate / irRate));
+        auto pad = (int)std::ceil(Resampler::getHalfWidth(irRate, sampleRate)) + 2;
+
+        AudioBuffer<float> padded(numCh, length + pad);
+        padded.clear();
+        for (int ch = 0; ch < numCh; ch++) {
+            padded.copyFrom(ch, 0, ir, ch, 0, length);
+        }
+
+        Resampler resampler;
+        resampler.prepare(numCh, irRate, sampleRate, chunk);
+        AudioBuffer<float> out(numCh, resampledLength), block(numCh, resampler.getMaxOutput(chunk));
+        out.clear();
+        std::vector<const float*> in((size_t)numCh);
+        std::vector<float*> dest((size_t)numCh);
+        int written = 0;
+        for (int start = 0; start < padded.getNumSamples() && written < resampledLength; start += chunk) {
+            for (int ch = 0; ch < numCh; ch++) {
+                in[(size_t)ch] = padded.getReadPointer(ch, start);
+                dest[(size_t)ch] = block.getWritePointer(ch);
+            }
+            auto produced = resampler.process(in.data(), jmin((int)chunk, padded.getNumSamples() - start), dest.data());
+            auto keep = jmin(produced, resampledLength - written);
+            for (int ch = 0; ch < numCh; ch++) {
+                out.copyFrom(ch, written, block, ch, 0, keep);
+            }
+            written += keep;
+        }
+        return out;
+    }
+
+private:
+    struct Channel {
+        HeapBlock<float> headTaps, headInput;
+        UniformConvolver body, tail;
+        HeapBlock<float> bodyInput, bodyOutput, tailInput, tailJob, tailOutput;
+        HeapBlock<float> ring;
+    };
+
+    class TailThread : public juce::Thread {
+    public:
+        TailThread(PartitionedConvolution& owner_) : Thread("ir tail"), owner(owner_) {}
+        void run() override {
+            while (!threadShouldExit()) {
+                wait(-1);
+                if (owner.tailPending.load(std::memory_order_acquire)) {
+                    owner.runTail();
+                    owner.tailPending.store(false, std::memory_order_release);
+                }
+            }
+        }
+    private:
+        PartitionedConvolution& owner;
+    };
+
+    void processChunk(AudioBuffer<float>& buffer, int numCh, int start, int numSamples, float mix, const float* mixRamp) {
+        for (int ch = 0; ch < numCh; ch++) {
+            head(*channels[(size_t)ch], buffer.getReadPointer(ch, start), wet.getWritePointer(ch), numSamples);
+        }
+
+        // step through the block at the body's partition boundaries, adding
+        // whatever the FFT segments have left in the ring
+        for (int i = 0; i < numSamples;) {
+            auto n = jmin(numSamples - i, headSize - bodyFill);
+            for (int ch = 0; ch < numCh; ch++) {
+                auto& c = *channels[(size_t)ch];
+                auto x = buffer.getReadPointer(ch, start + i);
+                auto w = wet.getWritePointer(ch, i);
+                FloatVectorOperations::copy(c.bodyInput.get() + bodyFill, x, n);
+                FloatVectorOperations::copy(c.tailInput.get() + tailFill, x, n);
+                for (int k = 0; k < n; k++) {
+                    auto& r = c.ring[(position + k) & (ringSize - 1)];
+                    w[k] += r;
+                    r = 0.0f;
+                }
+            }
+            i += n;
+            position += n;
+            bodyFill += n;
+            tailFill += n;
+
+            if (tailFill == tailSize) {
+                if (hasTail) {
+                    startTail(numCh);
+                }
+                tailFill = 0;
+            }
+            if (bodyFill == headSize) {
+                if (hasBody) {
+                    for (int ch = 0; ch < numCh; ch++) {
+                        auto& c = *channels[(size_t)ch];
+                        c.body.process(c.bodyInput.get(), c.bodyOutput.get());
+                        addToRing(c, position, c.bodyOutput.get(), headSize);
+                    }
+                }
+                bodyFill = 0;
+            }
+        }
+
+        for (int ch = 0; ch < numCh; ch++) {
+            auto out = buffer.getWritePointer(ch, start);
+            auto w = wet.getReadPointer(ch);
+            if (mixRamp != nullptr) {
+                for (int i = 0; i < numSamples; i++) {
+                    out[i] += (w[i] - out[i]) * mixRamp[i];
+                }
+            } else if (mix >= 1.0f) {
+                FloatVectorOperations::copy(out, w, numSamples);
+            } else {
+                FloatVectorOperations::multiply(out, 1.0f - mix, numSamples);
+                FloatVectorOperations::addWithMultiply(out, w, mix, numSamples);
+            }
+        }
+    }
+
+    // direct form over the first headSize taps, vectorised across the block
+    void head(Channel& c, const float* x, float* out, int numSamples) {
+        auto in = c.headInput.get();
+        auto history = headSize - 1;
+        FloatVectorOperations::copy(in + history, x, numSamples);
+        auto newest = in + history;
+        FloatVectorOperations::copyWithMultiply(out, newest, c.headTaps[0], numSamples);
+        for (int j = 1; j < headSize; j++) {
+            FloatVectorOperations::addWithMultiply(out, newest - j, c.headTaps[j], numSamples);
+        }
+        FloatVectorOperations::copy(in, in + numSamples, history);
+    }
+
+    void addToRing(Channel& c, int64 pos, const float* src, int n) {
+        for (int k = 0; k < n; k++) {
+            c.ring[(pos + k) & (ringSize - 1)] += src[k];
+        }
+    }
+
+    // At a tail boundary. The job posted one tailSize ago lands right here
+    // (tailOffset - tailSize after its input), so its output goes into the
+    // ring now and the next job starts. A job still running has had its whole
+    // tailSize of slack: it's left to finish and thrown away, along with the
+    // block that would have followed it, instead of the audio thread waiting.
+    void startTail(int numCh) {
+        if (tailPending.load(std::memory_order_acquire)) {
+            tailsDropped++;
+            return;
+        }
+        for (int ch = 0; ch < numCh; ch++) {
+            auto& c = *channels[(size_t)ch];
+            // one that finished late belongs somewhere already played
+            if (tailJobPosition == position - tailSize) {
+                addToRing(c, position, c.tailOutput.get(), tailSize);
+            }
+            FloatVectorOperations::copy(c.tailJob.get(), c.tailInput.get(), tailSize);
+        }
+        tailJobPosition = position;
+        tailPending.store(true, std::memory_order_release);
+        tailThread.notify();
+    }
+
+    // background thread, only into tailOutput
+    void runTail() {
+        for (int ch = 0; ch < numChannels; ch++) {
+            auto& c = *channels[(size_t)ch];
+            c.tail.process(c.tailJob.get(), c.tailOutput.get());
+        }
+    }
+
+    // has to hold everything added ahead of now, at most a tailSize, with room to spare
+    static constexpr int ringSize = 4 * tailSize;
+
+    std::vector<std::unique_ptr<Channel>> channels;
+    AudioBuffer<float> wet;
+    int numChannels = 0, capacity = 0;
+    bool hasBody = false, hasTail = false;
+    int64 position = 0, tailJobPosition = 0;
+    int bodyFill = 0, tailFill = 0;
+    std::atomic<bool> tailPending{ false };
+    std::atomic<uint32> tailsDropped{ 0 };
+    TailThread tailThread;
+};
+
@@ -0,0 +1,516 @@
+#pragma once
+
+// Native versions of the torchaudio.functional effects the Python workers
+// were running (lowpass/highpass/bandpass/band/equalizer biquads, overdrive,
+// flanger). The maths follows torchaudio so a chain moved out of Python sounds
+// the same, except that filter state carries over between blocks here instead
+// of being reset on every call.
+
+class EffectStage {
+public:
+    virtual ~EffectStage() {}
+    virtual void prepare(double sampleRate, int maxBlockSize, int numChannels) = 0;
+    virtual void process(AudioBuffer<float>& buffer, int numChannels, int numSamples) = 0;
+    virtual void reset() = 0;
+    // stages that add harmonics, the oversampler wraps these
+    virtual bool isNonlinear() const { return false; }
+    virtual int getLatencySamples() const { return 0; }
+};
+
+// normalised by a0, same as torchaudio.functional.biquad does
+struct BiquadCoeffs {
+    float b0 = 1.0f, b1 = 0.0f, b2 = 0.0f, a1 = 0.0f, a2 = 0.0f;
+
+    static BiquadCoeffs make(double b0, double b1, double b2, double a0, double a1, double a2) {
+        BiquadCoeffs c;
+        c.b0 = (float)(b0 / a0);
+        c.b1 = (float)(b1 / a0);
+        c.b2 = (float)(b2 / a0);
+        c.a1 = (float)(a1 / a0);
+        c.a2 = (float)(a2 / a0);
+        return c;
+    }
+
+    // F.lowpass_biquad
+    static BiquadCoeffs lowpass(double sampleRate, double cutoff, double Q = 0.707) {
+        auto w0 = MathConstants<double>::twoPi * cutoff / sampleRate;
+        auto alpha = std::sin(w0) / 2.0 / Q;
+        auto b0 = (1.0 - std::cos(w0)) / 2.0;
+        return make(b0, 1.0 - std::cos(w0), b0, 1.0 + alpha, -2.0 * std::cos(w0), 1.0 - alpha);
+    }
+
+    // F.highpass_biquad
+    static BiquadCoeffs highpass(double sampleRate, double cutoff, double Q = 0.707) {
+        auto w0 = MathConstants<double>::twoPi * cutoff / sampleRate;
+        auto alpha = std::sin(w0) / 2.0 / Q;
+        auto b0 = (1.0 + std::cos(w0)) / 2.0;
+        return make(b0, -1.0 - std::cos(w0), b0, 1.0 + alpha, -2.0 * std::cos(w0), 1.0 - alpha);
+    }
+
+    // F.bandpass_biquad
+    static BiquadCoeffs bandpass(double sampleRate, double centre, double Q = 0.707, bool constSkirtGain = false) {
+        auto w0 = MathConstants<double>::twoPi * centre / sampleRate;
+        auto alpha = std::sin(w0) / 2.0 / Q;
+        auto temp = constSkirtGain ? std::sin(w0) / 2.0 : alpha;
+        return make(temp, 0.0, -temp, 1.0 + alpha, -2.0 * std::cos(w0), 1.0 - alpha);
+    }
+
+    // F.band_biquad
+    static BiquadCoeffs band(double sampleRate, double centre, double Q = 0.707, bool noise = false) {
+        auto w0 = MathConstants<double>::twoPi * centre / sampleRate;
+        auto bandwidth = centre / Q;
+        auto a2 = std::exp(-MathConstants<double>::twoPi * bandwidth / sampleRate);
+        auto a1 = -4.0 * a2 / (1.0 + a2) * std::cos(w0);
+        auto b0 = std::sqrt(1.0 - a1 * a1 / (4.0 * a2)) * (1.0 - a2);
+        if (noise) {
+            b0 = std::sqrt(((1.0 + a2) * (1.0 + a2) - a1 * a1) * (1.0 - a2) / (1.0 + a2));
+        }
+        return make(b0, 0.0, 0.0, 1.0, a1, a2);
+    }
+
+    // F.equalizer_biquad
+    static BiquadCoeffs peaking(double sampleRate, double centre, double gainDb, double Q = 0.707) {
+        auto w0 = MathConstants<double>::twoPi * centre / sampleRate;
+        auto A = std::exp(gainDb / 40.0 * std::log(10.0));
+        auto alpha = std::sin(w0) / 2.0 / Q;
+        return make(1.0 + alpha * A, -2.0 * std::cos(w0), 1.0 - alpha * A,
+                    1.0 + alpha / A, -2.0 * std::cos(w0), 1.0 - alpha / A);
+    }
+};
+
+class BiquadStage : public EffectStage {
+public:
+    enum Type { lowpass, highpass, bandpass, band, peaking };
+
+    BiquadStage(Type type_, float freq_, float q_, float gainDb_ = 0.0f, bool flag_ = false)
+        : type(type_), freq(freq_), q(q_), gainDb(gainDb_), flag(flag_) {}
+
+    void prepare(double sampleRate, int maxBlockSize, int numChannels) override {
+        switch (type) {
+            case lowpass:  coeffs = BiquadCoeffs::lowpass(sampleRate, freq, q); break;
+            case highpass: coeffs = BiquadCoeffs::highpass(sampleRate, freq, q); break;
+            case bandpass: coeffs = BiquadCoeffs::bandpass(sampleRate, freq, q, flag); break;
+            case band:     coeffs = BiquadCoeffs::band(sampleRate, freq, q, flag); break;
+            case peaking:  coeffs = BiquadCoeffs::peaking(sampleRate, freq, gainDb, q); break;
+        }
+        // two samples of input history in front of each block
+        capacity = jmax(1, maxBlockSize);
+        scratch.setSize(2, capacity + 2);
+        state.setSize(1, numChannels * 4);
+        reset();
+    }
+
+    void reset() override {
+        state.clear();
+    }
+
+    void setCoeffs(const BiquadCoeffs& c) { coeffs = c; }
+
+    void process(AudioBuffer<float>& buffer, int numChannels, int numSamples) override {
+        // a host block bigger than prepareToPlay promised goes through in pieces
+        for (int done = 0; done < numSamples; done += capacity) {
+            for (int ch = 0; ch < numChannels; ch++) {
+                processChannel(buffer.getWritePointer(ch, done), ch, jmin(capacity, numSamples - done));
+            }
+        }
+    }
+
+private:
+    void processChannel(float* data, int ch, int numSamples) {
+        auto c = coeffs;
+        auto st = state.getWritePointer(0) + ch * 4; // x1 x2 y1 y2
+        auto x = scratch.getWritePointer(0);
+        auto fir = scratch.getWritePointer(1);
+
+        // feed-forward half is plain vector maths over the block,
+        // only the two-pole recursion has to go sample by sample
+        x[0] = st[1];
+        x[1] = st[0];
+        FloatVectorOperations::copy(x + 2, data, numSamples);
+        FloatVectorOperations::copyWithMultiply(fir, x + 2, c.b0, numSamples);
+        FloatVectorOperations::addWithMultiply(fir, x + 1, c.b1, numSamples);
+        FloatVectorOperations::addWithMultiply(fir, x, c.b2, numSamples);
+        st[0] = x[numSamples + 1];
+        st[1] = x[numSamples];
+
+        auto y1 = st[2], y2 = st[3];
+        for (int i = 0; i < numSamples; i++) {
+            auto y = fir[i] - c.a1 * y1 - c.a2 * y2;
+            y2 = y1;
+            y1 = y;
+            data[i] = y;
+        }
+        st[2] = y1;
+        st[3] = y2;
+
+        // lfilter(clamp=True), the recursion itself stays unclamped
+        FloatVectorOperations::clip(data, data, -1.0f, 1.0f, numSamples);
+    }
+
+    Type type;
+    float freq, q, gainDb;
+    bool flag;
+    int capacity = 1;
+    BiquadCoeffs coeffs;
+    AudioBuffer<float> scratch;
+    AudioBuffer<float> state;
+};
+
+// F.overdrive: cubic soft clip with a DC blocker, mixed back with the dry signal
+class OverdriveStage : public EffectStage {
+public:
+    OverdriveStage(float gainDb = 20.0f, float colour_ = 20.0f)
+        : gain(std::pow(10.0f, gainDb / 20.0f)), colour(colour_ / 200.0f) {}
+
+    void prepare(double, int maxBlockSize, int numChannels) override {
+        capacity = jmax(1, maxBlockSize);
+        shaped.setSize(1, capacity);
+        lastIn.assign((size_t)numChannels, 0.0f);
+        lastOut.assign((size_t)numChannels, 0.0f);
+    }
+
+    void reset() override {
+        std::fill(lastIn.begin(), lastIn.end(), 0.0f);
+        std::fill(lastOut.begin(), lastOut.end(), 0.0f);
+    }
+
+    bool isNonlinear() const override { return true; }
+
+    void process(AudioBuffer<float>& buffer, int numChannels, int numSamples) override {
+        // a host block bigger than prepareToPlay promised goes through in pieces
+        for (int done = 0; done < numSamples; done += capacity) {
+            for (int ch = 0; ch < numChannels; ch++) {
+                processChannel(buffer.getWritePointer(ch, done), ch, jmin(capacity, numSamples - done));
+            }
+        }
+    }
+
+private:
+    void processChannel(float* data, int ch, int numSamples) {
+        auto temp = shaped.getWritePointer(0);
+        shape(temp, data, numSamples, gain, colour);
+
+        auto in = lastIn[(size_t)ch], out = lastOut[(size_t)ch];
+        for (int i = 0; i < numSamples; i++) {
+            out = temp[i] - in + 0.995f * out;
+            in = temp[i];
+            temp[i] = out;
+        }
+        lastIn[(size_t)ch] = in;
+        lastOut[(size_t)ch] = out;
+
+        FloatVectorOperations::multiply(data, 0.5f, numSamples);
+        FloatVectorOperations::addWithMultiply(data, temp, 0.75f, numSamples);
+        FloatVectorOperations::clip(data, data, -1.0f, 1.0f, numSamples);
+    }
+
+    // branch-free so it vectorises
+    static void shape(float* __restrict dest, const float* __restrict src, int numSamples, float gain, float colour) {
+        for (int i = 0; i < numSamples; i++) {
+            auto t = src[i] * gain + colour;
+            auto c = t - t * t * t * (1.0f / 3.0f);
+            c = t < -1.0f ? -2.0f / 3.0f : c;
+            dest[i] = t > 1.0f ? 2.0f / 3.0f : c;
+        }
+    }
+
+    float gain, colour;
+    int capacity = 1;
+    AudioBuffer<float> shaped;
+    std::vector<float> lastIn, lastOut;
+};
+
+// F.flanger, one shared delay position and LFO like torchaudio, max 4 channels
+class FlangerStage : public EffectStage {
+public:
+    FlangerStage(float delay_ = 0.0f, float depth_ = 2.0f, float regen_ = 0.0f, float width_ = 71.0f,
+                 float speed_ = 0.5f, float phase_ = 25.0f, bool triangular_ = false, bool quadratic_ = false)
+        : delay(delay_), depth(depth_), regen(regen_), width(width_), speed(speed_), phase(phase_),
+          triangular(triangular_), quadratic(quadratic_) {}
+
+    void prepare(double sampleRate, int, int numChannels) override {
+        feedbackGain = regen / 100.0f;
+        auto delayGain = width / 100.0f;
+        auto channelPhase = phase / 100.0f;
+        auto delayMin = delay / 1000.0;
+        auto delayDepth = depth / 1000.0;
+
+        inGain = 1.0f / (1.0f + delayGain);
+        delayGain = delayGain / (1.0f + delayGain);
+        outGain = delayGain * (1.0f - std::abs(feedbackGain));
+
+        bufLength = (int)((delayMin + delayDepth) * sampleRate + 0.5) + 2;
+        channels = jmin(numChannels, 4);
+        buffers.setSize(channels, bufLength);
+
+        lfoLength = jmax(1, (int)(sampleRate / speed));
+        auto tableMin = std::floor(delayMin * sampleRate + 0.5);
+        auto tableMax = bufLength - 2.0;
+        lfo.allocate((size_t)lfoLength, false);
+        auto phaseOffset = (int)(0.75 * lfoLength + 0.5); // table starts at 3pi/2
+        for (int t = 0; t < lfoLength; t++) {
+            auto point = (t + phaseOffset) % lfoLength;
+            double d;
+            if (!triangular) {
+                d = (std::sin((double)point / lfoLength * MathConstants<double>::twoPi) + 1.0) / 2.0;
+            } else {
+                d = point * 2.0 / lfoLength;
+                switch (4 * point / lfoLength) {
+                    case 0: d = d + 0.5; break;
+                    case 1:
+                    case 2: d = 1.5 - d; break;
+                    default: d = d - 1.5; break;
+                }
+            }
+            lfo[t] = (float)(d * (tableMax - tableMin) + tableMin);
+        }
+        for (int ch = 0; ch < 4; ch++) {
+            channelOffset[ch] = (int)(ch * lfoLength * channelPhase + 0.5f);
+        }
+        reset();
+    }
+
+    void reset() override {
+        buffers.clear();
+        for (auto& l : last) l = 0.0f;
+        bufPos = 0;
+        lfoPos = 0;
+    }
+
+    void process(AudioBuffer<float>& buffer, int numChannels, int numSamples) override {
+        auto numCh = jmin(numChannels, channels);
+        float* data[4];
+        float* bufs[4];
+        for (int ch = 0; ch < numCh; ch++) {
+            data[ch] = buffer.getWritePointer(ch);
+            bufs[ch] = buffers.getWritePointer(ch);
+        }
+        for (int i = 0; i < numSamples; i++) {
+            bufPos = (bufPos + bufLength - 1) % bufLength;
+            for (int ch = 0; ch < numCh; ch++) {
+                auto d = lfo[(lfoPos + channelOffset[ch]) % lfoLength];
+                auto whole = std::floor(d);
+                auto frac = d - whole;
+                auto intDelay = (int)whole;
+
+                auto in = data[ch][i];
+                auto buf = bufs[ch];
+                buf[bufPos] = in + last[ch] * feedbackGain;
+
+                auto d0 = buf[(bufPos + intDelay) % bufLength];
+                auto d1 = buf[(bufPos + intDelay + 1) % bufLength];
+                float delayed;
+                if (!quadratic) {
+                    delayed = d0 + (d1 - d0) * frac;
+                } else {
+                    auto d2 = buf[(bufPos + intDelay + 2) % bufLength] - d0;
+                    d1 = d1 - d0;
+                    auto a = d2 * 0.5f - d1;
+                    auto b = d1 * 2.0f - d2 * 0.5f;
+                    delayed = d0 + (a * frac + b) * frac;
+                }
+                last[ch] = delayed;
+                data[ch][i] = jlimit(-1.0f, 1.0f, in * inGain + delayed * outGain);
+            }
+            if (++lfoPos >= lfoLength) lfoPos = 0;
+        }
+    }
+
+private:
+    float delay, depth, regen, width, speed, phase;
+    bool triangular, quadratic;
+    float feedbackGain = 0.0f, inGain = 1.0f, outGain = 0.0f;
+    int bufLength = 2, lfoLength = 1, channels = 0;
+    int bufPos = 0, lfoPos = 0;
+    int channelOffset[4] = {};
+    float last[4] = {};
+    AudioBuffer<float> buffers;
+    HeapBlock<float> lfo;
+};
+
+// runs a group of chain stages at factor x the host rate
+class OversampledSection : public EffectStage {
+public:
+    OversampledSection(int factor_) : factor(factor_) {}
+
+    int getFactor() const { return factor; }
+
+    void add(std::unique_ptr<EffectStage> stage) { stages.push_back(std::move(stage)); }
+
+    void prepare(double sampleRate, int maxBlockSize, int numChannels) override {
+        capacity = jmax(1, maxBlockSize);
+        oversampler.prepare(numChannels, capacity, factor);
+        for (auto& stage : stages) {
+            stage->prepare(sampleRate * factor, maxBlockSize * factor, numChannels);
+        }
+    }
+
+    void reset() override {
+        oversampler.reset();
+        for (auto& stage : stages) stage->reset();
+    }
+
+    bool isNonlinear() const override { return true; }
+    int getLatencySamples() const override { return oversampler.getLatencySamples(); }
+
+    void process(AudioBuffer<float>& buffer, int numChannels, int numSamples) override {
+        // the oversampler's buffers only hold maxBlockSize, a bigger block goes in pieces
+        for (int done = 0; done < numSamples; done += capacity) {
+            auto n = jmin(capacity, numSamples - done);
+            auto& high = oversampler.upsample(buffer, n, done);
+            for (auto& stage : stages) {
+                stage->process(high, numChannels, n * factor);
+            }
+            oversampler.downsample(buffer, n, done);
+        }
+    }
+
+private:
+    int factor;
+    int capacity = 1;
+    Oversampler oversampler;
+    std::vector<std::unique_ptr<EffectStage>> stages;
+};
+
+// An ordered list of stages built from a spec string, e.g.
+//   "lowpass:1300,overdrive:20:20,flanger"
+// Stages are separated by commas, arguments by colons, and follow the
+// torchaudio argument order with the sample rate left out:
+//   lowpass:cutoff[:Q]              highpass:cutoff[:Q]
+//   bandpass:centre[:Q[:constskirt]]  band:centre[:Q[:noise]]
+//   peaking:centre:gainDb[:Q]       overdrive[:gain[:colour]]
+//   flanger[:delay[:depth[:regen[:width[:speed[:phase]]]]]][:triangle][:quadratic]
+// A stage can be oversampled with an "@2", "@4" or "@8" suffix, e.g.
+// "overdrive:20:20@4". Nonlinear stages without a suffix get
+// defaultOversampling. Neighbouring stages at the same factor share one
+// up/down conversion.
+class EffectChain {
+public:
+    static std::unique_ptr<EffectChain> fromSpec(const String& spec, int defaultOversampling = 1) {
+        auto chain = std::make_unique<EffectChain>();
+        OversampledSection* section = nullptr;
+        for (auto& token : StringArray::fromTokens(spec, ",", "")) {
+            auto stageSpec = token.upToFirstOccurrenceOf("@", false, false).trim();
+            auto stage = makeStage(stageSpec);
+            if (!stage) continue;
+
+            auto factor = token.containsChar('@') ? token.fromFirstOccurrenceOf("@", false, false).getIntValue()
+                                                  : (stage->isNonlinear() ? defaultOversampling : 1);
+            factor = factor >= 8 ? 8 : (factor >= 4 ? 4 : (factor >= 2 ? 2 : 1));
+
+            if (factor == 1) {
+                section = nullptr;
+                chain->add(std::move(stage));
+                continue;
+            }
+            if (section == nullptr || section->getFactor() != factor) {
+                auto newSection = std::make_unique<OversampledSection>(factor);
+                section = newSection.get();
+                chain->add(std::move(newSection));
+            }
+            section->add(std::move(stage));
+        }
+        return chain;
+    }
+
+    void add(std::unique_ptr<EffectStage> stage) {
+        stages.push_back(std::move(stage));
+    }
+
+    void prepare(double sampleRate, int maxBlockSize, int numChannels) {
+        for (auto& stage : stages) {
+            stage->prepare(sampleRate, maxBlockSize, numChannels);
+        }
+        latency = getLatencySamples();
+        delayLine.setSize(numChannels, jmax(1, latency));
+        reset();
+    }
+
+    void reset() {
+        for (auto& stage : stages) {
+            stage->reset();
+        }
+        delayLine.clear();
+        delayPos = 0;
+    }
+
+    void process(AudioBuffer<float>& buffer, int numChannels, int numSamples) {
+        delay(buffer, numChannels, numSamples, false);
+        for (auto& stage : stages) {
+            stage->process(buffer, numChannels, numSamples);
+        }
+    }
+
+    // switched off: the dry signal is held back as far as the stages would
+    // have held it, so the latency reported to the host is right either way
+    void bypass(AudioBuffer<float>& buffer, int numChannels, int numSamples) {
+        delay(buffer, numChannels, numSamples, true);
+    }
+
+    bool isEmpty() const { return stages.empty(); }
+    int size() const { return (int)stages.size(); }
+
+    int getLatencySamples() const {
+        int latency = 0;
+        for (auto& stage : stages) {
+            latency += stage->getLatencySamples();
+        }
+        return latency;
+    }
+
+private:
+    // the last `latency` input samples, kept up while the stages run too so
+    // switching to bypass doesn't replay something old
+    void delay(AudioBuffer<float>& buffer, int numChannels, int numSamples, bool replace) {
+        if (latency == 0) return;
+        numChannels = jmin(numChannels, delayLine.getNumChannels());
+        for (int ch = 0; ch < numChannels; ch++) {
+            auto data = buffer.getWritePointer(ch);
+            auto ring = delayLine.getWritePointer(ch);
+            auto pos = delayPos;
+            for (int i = 0; i < numSamples; i++) {
+                auto in = data[i];
+                if (replace) data[i] = ring[pos];
+                ring[pos] = in;
+                if (++pos == latency) pos = 0;
+            }
+        }
+        delayPos = (delayPos + numSamples) % latency;
+    }
+
+    static std::unique_ptr<EffectStage> makeStage(const String& token) {
+        auto args = StringArray::fromTokens(token, ":", "");
+        if (args.size() == 0) return nullptr;
+
+        auto name = args[0].trim().toLowerCase();
+        // positional numbers, with the flanger's named options pulled out
+        StringArray nums;
+        bool triangle = false, quadratic = false;
+        for (auto& a : args) {
+            if (a.trim().equalsIgnoreCase("triangle")) triangle = true;
+            else if (a.trim().equalsIgnoreCase("quadratic")) quadratic = true;
+            else nums.add(a.trim());
+        }
+        auto arg = [&nums](int i, float fallback) {
+            return i < nums.size() && nums[i].isNotEmpty() ? nums[i].getFloatValue() : fallback;
+        };
+
+        if (name == "lowpass")   return std::make_unique<BiquadStage>(BiquadStage::lowpass,  arg(1, 1000.0f), arg(2, 0.707f));
+        if (name == "highpass")  return std::make_unique<BiquadStage>(BiquadStage::highpass, arg(1, 1000.0f), arg(2, 0.707f));
+        if (name == "bandpass")  return std::make_unique<BiquadStage>(BiquadStage::bandpass, arg(1, 1000.0f), arg(2, 0.707f), 0.0f, arg(3, 0.0f) != 0.0f);
+        if (name == "band")      return std::make_unique<BiquadStage>(BiquadStage::band,     arg(1, 1000.0f), arg(2, 0.707f), 0.0f, arg(3, 0.0f) != 0.0f);
+        if (name == "peaking" || name == "equalizer")
+            return std::make_unique<BiquadStage>(BiquadStage::peaking, arg(1, 1000.0f), arg(3, 0.707f), arg(2, 0.0f));
+        if (name == "overdrive") return std::make_unique<OverdriveStage>(arg(1, 20.0f), arg(2, 20.0f));
+        if (name == "flanger")
+            return std::make_unique<FlangerStage>(arg(1, 0.0f), arg(2, 2.0f), arg(3, 0.0f), arg(4, 71.0f),
+                                                  arg(5, 0.5f), arg(6, 25.0f), triangle, quadratic);
+
+        DBG("Unknown effect stage: " << token);
+        return nullptr;
+    }
+
+    std::vector<std::unique_ptr<EffectStage>> stages;
+    int latency = 0, delayPos = 0;
+    AudioBuffer<float> delayLine;
+};
@@ -0,0 +1,347 @@
+#pragma once
+
+// In-process Python. Instead of a worker on the other end of the socket, the
+// plugin embeds CPython and calls process(audio, midi) from a user script:
+//
+//   def process(audio, midi):      # audio: float32 [channels, samples], midi: uint8[300]
+//       audio *= 0.5               # edit in place, or
+//       return audio, midi         # return new arrays (copied back once)
+//
+// and optionally setup(sample_rate, max_block_size, channels) once at load.
+// The arrays are numpy views straight onto the plugin's slot buffers, made
+// once through the buffer protocol, so nothing is copied going into Python.
+// Only the worker thread ever takes the GIL; the audio thread hands blocks
+// over through a ring of slots with atomic states and never waits on it.
+// Each block is played exactly one block after it went in, which is the
+// latency reported to the host. A block Python didn't finish in time is
+// heard as silence and thrown away when it does come back, so a slow script
+// can't push the output any later.
+//
+// Needs the Python headers and library, so it's only built with
+// TYPHON_EMBED_PYTHON=1 (add the include/lib paths in the exporter).
+
+#ifndef TYPHON_EMBED_PYTHON
+ #define TYPHON_EMBED_PYTHON 0
+#endif
+
+#if TYPHON_EMBED_PYTHON
+
+#include <Python.h>
+
+class EmbeddedPython : public juce::Thread {
+public:
+    enum { numSlots = 8, midiBytes = 300 };
+
+    EmbeddedPython(const File& script_, int numChannels_, int maxBlockSize_, double sampleRate_)
+        : Thread("typhon python"), script(script_), numChannels(numChannels_),
+          maxBlockSize(maxBlockSize_), sampleRate(sampleRate_) {
+        for (auto& slot : slots) {
+            slot.audio.allocate((size_t)(numChannels * maxBlockSize), true);
+        }
+    }
+
+    ~EmbeddedPython() override {
+        stopThread(2000);
+    }
+
+    bool isReady() const { return ready.load(std::memory_order_acquire); }
+    bool hasFailed() const { return failed.load(std::memory_order_acquire); }
+    String getScriptName() const { return script.getFileName(); }
+
+    // audio thread: queue this block for Python, dropped if the ring is full.
+    // It's due at the next block's pull().
+    void push(const AudioBuffer<float>& buffer, const MidiBuffer& midi, int channels, int numSamples) {
+        auto& slot = slots[writeIndex];
+        if (!isReady() || numSamples > maxBlockSize || slot.state.load(std::memory_order_acquire) != slotFree) {
+            return;
+        }
+        slot.numSamples = numSamples;
+        slot.due = blockCount + 1;
+        for (int ch = 0; ch < numChannels; ch++) {
+            auto dest = slot.audio.get() + ch * maxBlockSize;
+            if (ch < channels) FloatVectorOperations::copy(dest, buffer.getReadPointer(ch), numSamples);
+            else FloatVectorOperations::clear(dest, numSamples);
+        }
+        // 3-byte messages, same as the trailer on the wire
+        zeromem(slot.midi, midiBytes);
+        int pos = 0;
+        for (const auto metadata : midi) {
+            if (metadata.numBytes > 3 || pos + 3 > midiBytes) continue;
+            memcpy(slot.midi + pos, metadata.data, (size_t)metadata.numBytes);
+            pos += 3;
+        }
+        slot.state.store(slotQueued, std::memory_order_release);
+        writeIndex = (writeIndex + 1) % numSlots;
+        notify();
+    }
+
+    // audio thread, once per block after push(): the block pushed last time,
+    // false if Python hasn't finished it. Blocks due earlier that finished
+    // late are dropped on the way.
+    bool pull(AudioBuffer<float>& buffer, MidiBuffer& midi, int channels, int numSamples) {
+        auto now = blockCount++;
+        for (;;) {
+            auto& slot = slots[readIndex];
+            auto state = slot.state.load(std::memory_order_acquire);
+            // nothing was pushed for this block, or Python is still on it;
+            // Python takes the slots in order, so nothing behind is done either
+            if (state == slotFree || slot.due > now || state != slotDone) {
+                return false;
+            }
+            if (slot.due == now) {
+                break;
+            }
+            slot.state.store(slotFree, std::memory_order_release);
+            readIndex = (readIndex + 1) % numSlots;
+        }
+        auto& slot = slots[readIndex];
+        auto n = jmin(numSamples, slot.numSamples);
+        for (int ch = 0; ch < jmin(channels, numChannels); ch++) {
+            FloatVectorOperations::copy(buffer.getWritePointer(ch), slot.audio.get() + ch * maxBlockSize, n);
+            if (n < numSamples) FloatVectorOperations::clear(buffer.getWritePointer(ch) + n, numSamples - n);
+        }
+        for (int i = 0; i + 2 < midiBytes; i += 3) {
+            if (slot.midi[i] >= 0x80) {
+                midi.addEvent(MidiMessage(slot.midi[i], slot.midi[i + 1], slot.midi[i + 2], 0), 0);
+            }
+        }
+        slot.state.store(slotFree, std::memory_order_release);
+        readIndex = (readIndex + 1) % numSlots;
+        return true;
+    }
+
+    void run() override {
+        ensureInterpreter();
+
+        auto gil = PyGILState_Ensure();
+        auto ok = load();
+        PyGILState_Release(gil);
+        failed = !ok;
+        ready = ok;
+
+        int workIndex = 0;
+        while (!threadShouldExit()) {
+            auto& slot = slots[workIndex];
+            if (!ok || slot.state.load(std::memory_order_acquire) != slotQueued) {
+                wait(50);
+                continue;
+            }
+            gil = PyGILState_Ensure();
+            call(slot);
+            PyGILState_Release(gil);
+            slot.state.store(slotDone, std::memory_order_release);
+            workIndex = (workIndex + 1) % numSlots;
+        }
+
+        ready = false;
+        gil = PyGILState_Ensure();
+        unload();
+        PyGILState_Release(gil);
+    }
+
+private:
+    enum { slotFree, slotQueued, slotDone };
+
+    struct Slot {
+        std::atomic<int> state{ slotFree };
+        int numSamples = 0;
+        int64 due = 0;            // the pull() it's played at, audio thread only
+        HeapBlock<float> audio;   // planar, channel stride maxBlockSize
+        uint8 midi[midiBytes];
+        PyObject* audioArray = nullptr;
+        PyObject* midiArray = nullptr;
+    };
+
+    // one interpreter per process, shared by every instance's worker thread.
+    // It's never finalised: numpy doesn't survive a restart of the interpreter.
+    static void ensureInterpreter() {
+        static std::once_flag once;
+        std::call_once(once, [] {
+            if (!Py_IsInitialized()) {
+                Py_InitializeEx(0);
+                // drop the GIL this thread got from initialising, workers take it as needed
+                PyEval_SaveThread();
+            }
+        });
+    }
+
+    // GIL held from here down
+    bool load() {
+        auto source = script.loadFileAsString();
+        if (source.isEmpty()) {
+            DBG("python script missing or empty: " << script.getFullPathName());
+            return false;
+        }
+
+        globals = PyDict_New();
+        PyDict_SetItemString(globals, "__builtins__", PyEval_GetBuiltins());
+        auto fileName = PyUnicode_FromString(script.getFullPathName().toRawUTF8());
+        PyDict_SetItemString(globals, "__file__", fileName);
+        Py_XDECREF(fileName);
+
+        auto result = PyRun_String(source.toRawUTF8(), Py_file_input, globals, globals);
+        if (result == nullptr) {
+            PyErr_Print();
+            return false;
+        }
+        Py_DECREF(result);
+
+        processFunction = PyDict_GetItemString(globals, "process");
+        if (processFunction == nullptr || !PyCallable_Check(processFunction)) {
+            DBG("python script has no process(audio, midi)");
+            processFunction = nullptr;
+            return false;
+        }
+        Py_INCREF(processFunction);
+
+        auto numpy = PyImport_ImportModule("numpy");
+        if (numpy == nullptr) {
+            PyErr_Print();
+            return false;
+        }
+        ascontiguous = PyObject_GetAttrString(numpy, "ascontiguousarray");
+        float32 = PyObject_GetAttrString(numpy, "float32");
+        uint8Type = PyObject_GetAttrString(numpy, "uint8");
+
+        auto ok = true;
+        for (auto& slot : slots) {
+            slot.audioArray = wrap(numpy, slot.audio.get(), (Py_ssize_t)(numChannels * maxBlockSize * sizeof(float)), "float32");
+            slot.midiArray = wrap(numpy, slot.midi, midiBytes, "uint8");
+            if (slot.audioArray != nullptr) {
+                auto reshaped = PyObject_CallMethod(slot.audioArray, "reshape", "ii", numChannels, maxBlockSize);
+                Py_DECREF(slot.audioArray);
+                slot.audioArray = reshaped;
+            }
+            ok = ok && slot.audioArray != nullptr && slot.midiArray != nullptr;
+        }
+        Py_DECREF(numpy);
+        if (!ok) {
+            PyErr_Print();
+            return false;
+        }
+
+        if (auto setup = PyDict_GetItemString(globals, "setup")) {
+            auto r = PyObject_CallFunction(setup, "dii", sampleRate, maxBlockSize, numChannels);
+            if (r == nullptr) {
+                PyErr_Print();
+                return false;
+            }
+            Py_DECREF(r);
+        }
+        return true;
+    }
+
+    // numpy.frombuffer over a memoryview of our own memory: a view, not a copy
+    static PyObject* wrap(PyObject* numpy, void* data, Py_ssize_t bytes, const char* dtype) {
+        auto view = PyMemoryView_FromMemory((char*)data, bytes, PyBUF_WRITE);
+        if (view == nullptr) return nullptr;
+        auto array = PyObject_CallMethod(numpy, "frombuffer", "Os", view, dtype);
+        Py_DECREF(view);
+        return array;
+    }
+
+    void call(Slot& slot) {
+        auto n = slot.numSamples;
+        // a short block gets a [:, :n] view of the same memory
+        PyObject* audio = nullptr;
+        if (n == maxBlockSize) {
+            audio = slot.audioArray;
+            Py_INCREF(audio);
+        } else {
+            auto stop = PyLong_FromLong(n);
+            auto columns = PySlice_New(nullptr, stop, nullptr);
+            auto rows = PySlice_New(nullptr, nullptr, nullptr);
+            auto index = PyTuple_Pack(2, rows, columns);
+            audio = PyObject_GetItem(slot.audioArray, index);
+            Py_XDECREF(index);
+            Py_XDECREF(stop);
+            Py_XDECREF(rows);
+            Py_XDECREF(columns);
+        }
+
+        auto result = audio != nullptr ? PyObject_CallFunctionObjArgs(processFunction, audio, slot.midiArray, nullptr) : nullptr;
+        if (result == nullptr) {
+            // a broken block comes back silent rather than stopping the worker
+            PyErr_Print();
+            for (int ch = 0; ch < numChannels; ch++) {
+                FloatVectorOperations::clear(slot.audio.get() + ch * maxBlockSize, n);
+            }
+            zeromem(slot.midi, midiBytes);
+        } else if (result != Py_None) {
+            auto audioOut = result;
+            PyObject* midiOut = nullptr;
+            if (PyTuple_Check(result)) {
+                audioOut = PyTuple_Size(result) > 0 ? PyTuple_GetItem(result, 0) : Py_None;
+                midiOut = PyTuple_Size(result) > 1 ? PyTuple_GetItem(result, 1) : nullptr;
+            }
+            if (audioOut != audio && audioOut != slot.audioArray && audioOut != Py_None) {
+                copyBack(audioOut, float32, slot.audio.get(), n, sizeof(float));
+            }
+            if (midiOut != nullptr && midiOut != slot.midiArray && midiOut != Py_None) {
+                zeromem(slot.midi, midiBytes);
+                copyBack(midiOut, uint8Type, slot.midi, midiBytes, 1);
+            }
+        }
+        Py_XDECREF(result);
+        Py_XDECREF(audio);
+    }
+
+    // whatever the script returned, as contiguous [channels, n] of the given type.
+    // ascontiguousarray is a no-op when it already is, otherwise one conversion.
+    void copyBack(PyObject* value, PyObject* dtype, void* dest, int n, size_t itemSize) {
+        auto array = PyObject_CallFunctionObjArgs(ascontiguous, value, dtype, nullptr);
+        if (array == nullptr) {
+            PyErr_Print();
+            return;
+        }
+        Py_buffer view;
+        if (PyObject_GetBuffer(array, &view, PyBUF_C_CONTIGUOUS) == 0) {
+            auto rowBytes = (size_t)n * itemSize;
+            auto src = (const char*)view.buf;
+            if (itemSize == 1) {
+                memcpy(dest, src, jmin((size_t)view.len, rowBytes));
+            } else {
+                // one row per channel, a mono reply goes to every channel
+                auto rows = (int)((size_t)view.len / rowBytes);
+                for (int ch = 0; ch < numChannels && rows > 0; ch++) {
+                    memcpy((char*)dest + (size_t)ch * maxBlockSize * itemSize, src + (size_t)(ch % rows) * rowBytes, rowBytes);
+                }
+            }
+            PyBuffer_Release(&view);
+        } else {
+            PyErr_Print();
+        }
+        Py_DECREF(array);
+    }
+
+    void unload() {
+        for (auto& slot : slots) {
+            Py_CLEAR(slot.audioArray);
+            Py_CLEAR(slot.midiArray);
+        }
+        Py_CLEAR(processFunction);
+        Py_CLEAR(ascontiguous);
+        Py_CLEAR(float32);
+        Py_CLEAR(uint8Type);
+        Py_CLEAR(globals);
+    }
+
+    File script;
+    int numChannels, maxBlockSize;
+    double sampleRate;
+    std::atomic<bool> ready{ false }, failed{ false };
+
+    Slot slots[numSlots];
+    int writeIndex = 0, readIndex = 0;   // audio thread only
+    int64 blockCount = 0;                // audio thread only, pull() calls so far
+
+    PyObject* globals = nullptr;
+    PyObject* processFunction = nullptr;
+    PyObject* ascontiguous = nullptr;
+    PyObject* float32 = nullptr;
+    PyObject* uint8Type = nullptr;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(EmbeddedPython)
+};
+
+#endif
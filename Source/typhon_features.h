@@ -0,0 +1,268 @@
+#pragma once
+
+// Feature tap. Workers that only listen (pitch trackers, onset detectors
+// that answer with MIDI) don't need the samples, just descriptors:
+//   HELO proto=2;transport=features;features=rms,peak,onset,mel,pitch;fft=1024;hop=512;mels=40
+// The plugin analyses a mono mix every hop and sends float32 vectors, one per
+// hop, in the order the features were asked for:
+//   rms, peak    over the last hop
+//   onset        spectral flux, the mean rise in magnitude since the last hop
+//   mel          `mels` log energies, triangular HTK-mel bands up to Nyquist
+//   pitch        two values, frequency in Hz (0 if unvoiced) and confidence 0..1 (YIN)
+// Header: kind features, channels 1, current = number of vectors,
+// samples = current * vector size, windowOffset = index of the first hop.
+// transport=features is shorthand for consumes=features,midi;produces=midi:
+// the audio isn't touched and replies only carry MIDI, unless the worker
+// says it produces audio as well.
+
+class FeatureTap {
+public:
+    enum Feature { rms = 1, peak = 2, onset = 4, mel = 8, pitch = 16 };
+
+    static int parseFeatures(const String& list) {
+        int mask = 0;
+        for (auto& name : StringArray::fromTokens(list, ",", "")) {
+            auto n = name.trim();
+            if (n == "rms") mask |= rms;
+            else if (n == "peak") mask |= peak;
+            else if (n == "onset") mask |= onset;
+            else if (n == "mel") mask |= mel;
+            else if (n == "pitch") mask |= pitch;
+        }
+        return mask;
+    }
+
+    void prepare(int maxBlockSize, double sampleRate_, int fftSize_, int hop_, int numMels_, int features_) {
+        sampleRate = sampleRate_;
+        fftSize = nextPowerOfTwo(jlimit(64, 16384, fftSize_));
+        hop = jlimit(1, fftSize, hop_);
+        numMels = jlimit(1, 256, numMels_);
+        features = features_ != 0 ? features_ : (rms | peak | onset | mel | pitch);
+        numBins = fftSize / 2 + 1;
+
+        vectorSize = 0;
+        if (features & rms) vectorSize++;
+        if (features & peak) vectorSize++;
+        if (features & onset) vectorSize++;
+        if (features & mel) vectorSize += numMels;
+        if (features & pitch) vectorSize += 2;
+
+        fft = std::make_unique<dsp::FFT>(roundToInt(std::log2(fftSize)));
+        correlationFft = std::make_unique<dsp::FFT>(roundToInt(std::log2(fftSize)) + 1);
+        frame.allocate((size_t)fftSize, true);
+        window.allocate((size_t)fftSize, false);
+        for (int i = 0; i < fftSize; i++) {
+            window[i] = (float)(0.5 - 0.5 * std::cos(MathConstants<double>::twoPi * i / fftSize));
+        }
+        work.allocate((size_t)(4 * fftSize), true);
+        lag.allocate((size_t)(4 * fftSize), true);
+        magnitude.allocate((size_t)numBins, true);
+        lastMagnitude.allocate((size_t)numBins, true);
+        difference.allocate((size_t)(fftSize / 2 + 1), true);
+        prepareMelBands();
+
+        fill = 0;
+        hopIndex = 0;
+        maxVectorsPerBlock = maxBlockSize / hop + 1;
+        message.setSize(getMaxMessageSize(), true);
+    }
+
+    int getVectorSize() const { return vectorSize; }
+
+    size_t getMaxMessageSize() const {
+        return FrameHeader::size + TransportInfo::size + (size_t)maxVectorsPerBlock * vectorSize * sizeof(float) + FrameWriter::maxMidiBytes;
+    }
+
+    // audio thread: nullptr when no hop finished and there's no MIDI to pass on
+    const FrameRef* analyse(const AudioBuffer<float>& buffer, const MidiBuffer& midi, int channels, int numSamples, uint32 seq,
+                               const TransportInfo* transport = nullptr) {
+        auto headerBytes = FrameHeader::size + (transport != nullptr ? TransportInfo::size : 0);
+        auto vectors = (float*)((uint8*)message.getData() + headerBytes);
+        auto firstHop = hopIndex;
+        int count = 0;
+        channels = jmax(1, channels);
+
+        for (int done = 0; done < numSamples;) {
+            auto n = jmin(numSamples - done, hop - fill);
+            // mono mix into the newest hop of the frame
+            auto dest = frame.get() + fftSize - hop + fill;
+            FloatVectorOperations::copyWithMultiply(dest, buffer.getReadPointer(0, done), 1.0f / channels, n);
+            for (int ch = 1; ch < channels; ch++) {
+                FloatVectorOperations::addWithMultiply(dest, buffer.getReadPointer(ch, done), 1.0f / channels, n);
+            }
+            fill += n;
+            done += n;
+            if (fill < hop) break;
+
+            if (count < maxVectorsPerBlock) {
+                describe(vectors + (size_t)count * vectorSize);
+                count++;
+            }
+            hopIndex++;
+            FloatVectorOperations::copy(frame.get(), frame.get() + hop, fftSize - hop);
+            fill = 0;
+        }
+
+        auto midiDest = (uint8*)(vectors + (size_t)count * vectorSize);
+        auto midiBytes = FrameWriter::packMidi(midi, midiDest);
+        if (count == 0 && midiBytes == 0) return nullptr;
+
+        FrameHeader header;
+        header.kind = FrameHeader::features;
+        header.seq = seq;
+        header.channels = 1;
+        header.flags = FrameHeader::float32;
+        header.samples = (uint32)(count * vectorSize);
+        header.current = (uint32)count;
+        header.windowOffset = firstHop;
+        header.midiBytes = (uint32)midiBytes;
+        if (transport != nullptr) {
+            header.flags |= FrameHeader::transportInfo;
+            header.transport = *transport;
+        }
+        header.write((uint8*)message.getData());
+        built = { message.getData(), header.getHeaderBytes() + header.getPayloadBytes() };
+        return &built;
+    }
+
+private:
+    void describe(float* out) {
+        auto newest = frame.get() + fftSize - hop;
+
+        if (features & rms) {
+            double sum = 0.0;
+            for (int i = 0; i < hop; i++) sum += newest[i] * newest[i];
+            *out++ = (float)std::sqrt(sum / hop);
+        }
+        if (features & peak) {
+            auto range = FloatVectorOperations::findMinAndMax(newest, hop);
+            *out++ = jmax(std::abs(range.getStart()), std::abs(range.getEnd()));
+        }
+
+        if (features & (onset | mel)) {
+            auto w = work.get();
+            FloatVectorOperations::multiply(w, frame.get(), window.get(), fftSize);
+            FloatVectorOperations::clear(w + fftSize, fftSize);
+            fft->performRealOnlyForwardTransform(w, true);
+            for (int b = 0; b < numBins; b++) {
+                magnitude[b] = std::sqrt(w[2 * b] * w[2 * b] + w[2 * b + 1] * w[2 * b + 1]);
+            }
+        }
+        if (features & onset) {
+            float flux = 0.0f;
+            for (int b = 0; b < numBins; b++) flux += jmax(0.0f, magnitude[b] - lastMagnitude[b]);
+            *out++ = flux / numBins;
+            FloatVectorOperations::copy(lastMagnitude.get(), magnitude.get(), numBins);
+        }
+        if (features & mel) {
+            for (int m = 0; m < numMels; m++) {
+                auto& band = melBands[(size_t)m];
+                float energy = 0.0f;
+                for (int b = 0; b < band.numBins; b++) {
+                    auto mag = magnitude[band.firstBin + b];
+                    energy += mag * mag * band.weights[b];
+                }
+                *out++ = std::log(energy + 1.0e-10f);
+            }
+        }
+        if (features & pitch) {
+            float confidence = 0.0f;
+            *out++ = estimatePitch(confidence);
+            *out++ = confidence;
+        }
+    }
+
+    // YIN over the whole frame: lags up to half of it, the difference function
+    // built from an FFT cross-correlation instead of the O(n^2) sum
+    float estimatePitch(float& confidence) {
+        auto x = frame.get();
+        auto w = fftSize / 2;           // integration window
+        auto size = 2 * fftSize;        // correlation FFT length, no wrap-around
+        auto a = work.get();
+        auto b = lag.get();
+
+        FloatVectorOperations::clear(a, 2 * size);
+        FloatVectorOperations::copy(a, x, w);
+        FloatVectorOperations::clear(b, 2 * size);
+        FloatVectorOperations::copy(b, x, fftSize);
+        correlationFft->performRealOnlyForwardTransform(a, true);
+        correlationFft->performRealOnlyForwardTransform(b, true);
+        // conj(A) * B gives r(tau) = sum x[j] x[j + tau]
+        for (int k = 0; k <= size / 2; k++) {
+            auto re = a[2 * k] * b[2 * k] + a[2 * k + 1] * b[2 * k + 1];
+            auto im = a[2 * k] * b[2 * k + 1] - a[2 * k + 1] * b[2 * k];
+            b[2 * k] = re;
+            b[2 * k + 1] = im;
+        }
+        correlationFft->performRealOnlyInverseTransform(b);
+
+        // d(tau) = E(0) + E(tau) - 2 r(tau), E a running sum of squares
+        double e0 = 0.0;
+        for (int j = 0; j < w; j++) e0 += x[j] * x[j];
+        double eTau = e0;
+        difference[0] = 0.0f;
+        double running = 0.0;
+        int best = -1;
+        auto minLag = jmax(2, (int)(sampleRate / 2000.0));
+        for (int tau = 1; tau <= w; tau++) {
+            eTau += x[tau + w - 1] * x[tau + w - 1] - x[tau - 1] * x[tau - 1];
+            auto d = (float)jmax(0.0, e0 + eTau - 2.0 * b[tau]);
+            running += d;
+            // cumulative mean normalised difference
+            difference[tau] = running > 0.0 ? (float)(d * tau / running) : 1.0f;
+            if (best < 0 && tau > minLag && difference[tau - 1] < 0.15f && difference[tau] >= difference[tau - 1]) {
+                best = tau - 1;
+            }
+        }
+        if (best < 0 || e0 < 1.0e-8) {
+            confidence = 0.0f;
+            return 0.0f;
+        }
+
+        // parabolic interpolation around the dip
+        auto l = difference[best - 1], c = difference[best], r = difference[best + 1];
+        auto denom = l - 2.0f * c + r;
+        auto offset = std::abs(denom) > 1.0e-9f ? 0.5f * (l - r) / denom : 0.0f;
+        confidence = jlimit(0.0f, 1.0f, 1.0f - c);
+        return (float)(sampleRate / (best + jlimit(-0.5f, 0.5f, offset)));
+    }
+
+    void prepareMelBands() {
+        melBands.clear();
+        auto toMel = [](double hz) { return 2595.0 * std::log10(1.0 + hz / 700.0); };
+        auto toHz = [](double m) { return 700.0 * (std::pow(10.0, m / 2595.0) - 1.0); };
+        auto top = toMel(sampleRate / 2.0);
+        auto binHz = sampleRate / fftSize;
+        for (int m = 0; m < numMels; m++) {
+            auto lo = toHz(top * m / (numMels + 1));
+            auto mid = toHz(top * (m + 1) / (numMels + 1));
+            auto hi = toHz(top * (m + 2) / (numMels + 1));
+            MelBand band;
+            band.firstBin = jlimit(0, numBins - 1, (int)std::ceil(lo / binHz));
+            auto lastBin = jlimit(band.firstBin, numBins - 1, (int)std::floor(hi / binHz));
+            band.numBins = lastBin - band.firstBin + 1;
+            band.weights.allocate((size_t)band.numBins, true);
+            for (int b = 0; b < band.numBins; b++) {
+                auto hz = (band.firstBin + b) * binHz;
+                auto weight = hz <= mid ? (hz - lo) / jmax(1.0e-9, mid - lo) : (hi - hz) / jmax(1.0e-9, hi - mid);
+                band.weights[b] = (float)jlimit(0.0, 1.0, weight);
+            }
+            melBands.push_back(std::move(band));
+        }
+    }
+
+    struct MelBand {
+        int firstBin = 0, numBins = 0;
+        HeapBlock<float> weights;
+    };
+
+    double sampleRate = 44100.0;
+    int fftSize = 0, hop = 0, numMels = 0, features = 0, numBins = 0, vectorSize = 0;
+    int fill = 0, maxVectorsPerBlock = 0;
+    int64 hopIndex = 0;
+    std::unique_ptr<dsp::FFT> fft, correlationFft;
+    HeapBlock<float> frame, window, work, lag, magnitude, lastMagnitude, difference;
+    std::vector<MelBand> melBands;
+    MemoryBlock message;
+    FrameRef built{ nullptr, 0 };
+};
@@ -0,0 +1,409 @@
+#pragma once
+
+// Freeze. With the "freeze" state property on, whatever the worker branch
+// produced is written to disk against the host's timeline, and a block whose
+// every sample has been heard before (same input audio, same MIDI, same tag)
+// is played from there instead: no frame goes out, the worker needn't even be
+// running. The tag is the worker's version (HELO version=, or VERS <tag>; the
+// last one seen is kept in the file for when there's no worker) mixed with
+// the plugin parameters that feed the worker branch, so changing either puts
+// everything back on the live path, which records it again.
+//
+// The file is one per instance (the "freezeId" property) under the user's
+// application data, memory-mapped, and laid out as
+//   header (4096 bytes): "TYFZ", u32 format, f64 sampleRate, u32 inChannels,
+//     u32 outChannels, u32 granule, u32 numGranules, u64 workerVersion
+//   numGranules * Granule (stamp, MIDI), padded to 4096
+//   numGranules * granule samples of outChannels output then inChannels input,
+//     float32 planar
+// A granule is `granule` samples of timeline and only counts once it has been
+// written start to finish under one tag. The audio thread reads the map and
+// queues what it played live; this thread does the writing and pages in what
+// is about to be played, so the audio thread doesn't wait on the disk.
+
+class FreezeCache : private juce::Thread {
+public:
+    enum { granule = 1024, maxEvents = 32, maxSegments = 64, queueLength = 32, headerBytes = 4096, format = 1 };
+
+    FreezeCache(const File& file_, double sampleRate_, int inChannels_, int outChannels_, int maxBlockSize_, double seconds)
+        : Thread("typhon freeze"), file(file_), sampleRate(sampleRate_), inChannels(inChannels_), outChannels(outChannels_),
+          maxBlockSize(maxBlockSize_), numGranules((int)jmax(1.0, std::ceil(seconds * sampleRate_ / granule))) {
+        granuleBytes = (size_t)granule * (size_t)(inChannels + outChannels) * sizeof(float);
+        tableBytes = ((size_t)numGranules * sizeof(Granule) + 4095) & ~(size_t)4095;
+        totalBytes = (size_t)headerBytes + tableBytes + (size_t)numGranules * granuleBytes;
+        progress.assign((size_t)numGranules, Progress());
+
+        input.setSize(inChannels, maxBlockSize);
+        for (auto& job : jobs) {
+            job.input.setSize(inChannels, maxBlockSize);
+            job.output.setSize(outChannels, maxBlockSize);
+        }
+        startThread();
+    }
+
+    ~FreezeCache() override {
+        stopThread(4000);
+    }
+
+    bool isReady() const { return ready.load(std::memory_order_acquire); }
+
+    // message thread: forget everything, the next pass records it all again
+    void clear() {
+        clearRequested = true;
+        notify();
+    }
+
+    // audio thread, while a worker is connected: what it says its version is
+    void setWorkerVersion(uint64 version) { workerVersion = version; }
+
+    // audio thread: keeps this block's input for record(), and if every sample
+    // of it is frozen under this tag for this input, puts the frozen output in
+    // the buffer and returns true
+    bool play(int64 position, AudioBuffer<float>& buffer, int numSamples, const MidiBuffer& midi, uint64 paramsTag) {
+        blockPosition = -1;
+        if (!isReady() || position < 0 || numSamples > maxBlockSize
+            || position + numSamples > (int64)numGranules * granule
+            || position / granule + maxSegments <= (position + numSamples - 1) / granule) return false;
+
+        blockPosition = position;
+        blockSamples = numSamples;
+        blockTag = makeTag(paramsTag);
+        auto channels = jmin(inChannels, buffer.getNumChannels());
+        for (int ch = 0; ch < inChannels; ch++) {
+            if (ch < channels) input.copyFrom(ch, 0, buffer, ch, 0, numSamples);
+            else input.clear(ch, 0, numSamples);
+        }
+        numBlockEvents = 0;
+        for (const auto metadata : midi) {
+            if (numBlockEvents == maxBlockEvents) {
+                // too busy to compare, it goes live
+                blockPosition = -1;
+                return false;
+            }
+            if (metadata.numBytes > 3 || metadata.samplePosition >= numSamples) continue;
+            blockEvents[numBlockEvents++] = makeEvent(metadata.samplePosition, metadata.data, metadata.numBytes);
+        }
+        playhead = (int)(position / granule);
+        notify();
+
+        auto allFrozen = true;
+        numSegments = 0;
+        forEachSegment(position, numSamples, [&](int g, int offset, int start, int length) {
+            auto frozen = isFrozen(g, offset, start, length);
+            segmentFrozen[numSegments++] = frozen;
+            allFrozen = allFrozen && frozen;
+        });
+        if (!allFrozen) return false;
+
+        forEachSegment(position, numSamples, [&](int g, int offset, int start, int length) {
+            auto data = getAudio(g);
+            for (int ch = 0; ch < jmin(outChannels, buffer.getNumChannels()); ch++) {
+                buffer.copyFrom(ch, start, data + (size_t)ch * granule + offset, length);
+            }
+        });
+        return true;
+    }
+
+    // audio thread, after the live path ran on the block play() turned down:
+    // queues the parts that weren't frozen to be written
+    void record(const AudioBuffer<float>& buffer) {
+        if (blockPosition < 0) return;
+        int start1, size1, start2, size2;
+        fifo.prepareToWrite(1, start1, size1, start2, size2);
+        if (size1 == 0) {
+            // the disk is behind, these granules just won't freeze this pass
+            blockPosition = -1;
+            return;
+        }
+        auto& job = jobs[start1];
+        job.position = blockPosition;
+        job.numSamples = blockSamples;
+        job.tag = blockTag;
+        job.numSegments = numSegments;
+        std::copy(segmentFrozen, segmentFrozen + numSegments, job.frozen);
+        for (int ch = 0; ch < inChannels; ch++) {
+            job.input.copyFrom(ch, 0, input, ch, 0, blockSamples);
+        }
+        auto channels = jmin(outChannels, buffer.getNumChannels());
+        for (int ch = 0; ch < outChannels; ch++) {
+            if (ch < channels) job.output.copyFrom(ch, 0, buffer, ch, 0, blockSamples);
+            else job.output.clear(ch, 0, blockSamples);
+        }
+        job.numEvents = numBlockEvents;
+        std::copy(blockEvents, blockEvents + numBlockEvents, job.events);
+        fifo.finishedWrite(1);
+        blockPosition = -1;
+        notify();
+    }
+
+private:
+    struct Event {
+        uint16 offset;
+        uint8 size;
+        uint8 data[3];
+        uint16 reserved;
+    };
+
+    struct Granule {
+        uint64 stamp;      // the tag it was written under, 0 while it isn't whole
+        uint32 numEvents;
+        uint32 reserved;
+        Event events[maxEvents];
+    };
+
+    // this thread's view of a granule being written
+    struct Progress {
+        int next = -1;
+        uint64 tag = 0;
+    };
+
+    enum { maxBlockEvents = 256 };
+
+    struct Job {
+        int64 position = 0;
+        int numSamples = 0;
+        uint64 tag = 0;
+        int numSegments = 0;
+        bool frozen[maxSegments] = {};
+        AudioBuffer<float> input, output;
+        int numEvents = 0;
+        Event events[maxBlockEvents];
+    };
+
+    static Event makeEvent(int offset, const uint8* data, int size) {
+        Event e{};
+        e.offset = (uint16)offset;
+        e.size = (uint8)size;
+        memcpy(e.data, data, (size_t)size);
+        return e;
+    }
+
+    static bool sameEvent(const Event& a, const Event& b) {
+        return a.offset == b.offset && a.size == b.size && memcmp(a.data, b.data, a.size) == 0;
+    }
+
+    uint64 makeTag(uint64 paramsTag) const {
+        auto tag = workerVersion.load() * 0x9E3779B185EBCA87ULL ^ paramsTag;
+        return tag != 0 ? tag : 1;
+    }
+
+    // calls f(granule, offset in it, offset in the block, length) for each piece
+    template <typename F>
+    static void forEachSegment(int64 position, int numSamples, F&& f) {
+        int done = 0;
+        while (done < numSamples) {
+            auto at = position + done;
+            auto g = (int)(at / granule);
+            auto offset = (int)(at - (int64)g * granule);
+            auto length = jmin(numSamples - done, (int)granule - offset);
+            f(g, offset, done, length);
+            done += length;
+        }
+    }
+
+    Granule* getGranule(int g) const {
+        return (Granule*)((uint8*)map->getData() + headerBytes) + g;
+    }
+
+    float* getAudio(int g) const {
+        return (float*)((uint8*)map->getData() + headerBytes + tableBytes + (size_t)g * granuleBytes);
+    }
+
+    // whole under this tag, with the same input and the same MIDI in this stretch
+    bool isFrozen(int g, int offset, int start, int length) const {
+        auto* info = getGranule(g);
+        uint64 stamp;
+        memcpy(&stamp, &info->stamp, sizeof(stamp));
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (stamp != blockTag) return false;
+
+        auto stored = getAudio(g) + (size_t)outChannels * granule;
+        for (int ch = 0; ch < inChannels; ch++) {
+            if (memcmp(stored + (size_t)ch * granule + offset, input.getReadPointer(ch, start), (size_t)length * sizeof(float)) != 0) {
+                return false;
+            }
+        }
+        int e = 0;
+        for (uint32 i = 0; i < info->numEvents && i < maxEvents; i++) {
+            auto& frozen = info->events[i];
+            if (frozen.offset < offset || frozen.offset >= offset + length) continue;
+            while (e < numBlockEvents && (blockEvents[e].offset < start || blockEvents[e].offset >= start + length)) e++;
+            if (e == numBlockEvents) return false;
+            auto live = blockEvents[e++];
+            live.offset = (uint16)(live.offset - start + offset);
+            if (!sameEvent(frozen, live)) return false;
+        }
+        while (e < numBlockEvents && (blockEvents[e].offset < start || blockEvents[e].offset >= start + length)) e++;
+        return e == numBlockEvents;
+    }
+
+    void run() override {
+        if (!open()) return;
+        ready.store(true, std::memory_order_release);
+        while (!threadShouldExit()) {
+            if (clearRequested.exchange(false)) {
+                for (int g = 0; g < numGranules; g++) {
+                    getGranule(g)->stamp = 0;
+                    progress[(size_t)g] = Progress();
+                }
+            }
+            int start1, size1, start2, size2;
+            fifo.prepareToRead(fifo.getNumReady(), start1, size1, start2, size2);
+            for (int i = 0; i < size1; i++) write(jobs[start1 + i]);
+            for (int i = 0; i < size2; i++) write(jobs[start2 + i]);
+            fifo.finishedRead(size1 + size2);
+
+            auto version = workerVersion.load();
+            if (version != savedVersion) {
+                memcpy((uint8*)map->getData() + 32, &version, sizeof(version));
+                savedVersion = version;
+            }
+            prefetch();
+            wait(10);
+        }
+    }
+
+    // maps the file, making it again if it isn't this layout
+    bool open() {
+        if (file.existsAsFile() && (size_t)file.getSize() == totalBytes) {
+            map = std::make_unique<MemoryMappedFile>(file, MemoryMappedFile::readWrite);
+            if (map->getData() != nullptr && headerMatches()) {
+                memcpy(&savedVersion, (const uint8*)map->getData() + 32, sizeof(savedVersion));
+                workerVersion = savedVersion;
+                return true;
+            }
+            map.reset();
+        }
+        file.deleteFile();
+        file.getParentDirectory().createDirectory();
+        {
+            FileOutputStream out(file);
+            if (out.failedToOpen() || !out.setPosition((int64)totalBytes - 1) || !out.writeByte(0)) {
+                DBG("Couldn't make the freeze file " << file.getFullPathName());
+                return false;
+            }
+        }
+        map = std::make_unique<MemoryMappedFile>(file, MemoryMappedFile::readWrite);
+        if (map->getData() == nullptr) return false;
+        auto header = (uint8*)map->getData();
+        zeromem(header, headerBytes);
+        memcpy(header, "TYFZ", 4);
+        put(header + 4, (uint32)format);
+        put(header + 8, sampleRate);
+        put(header + 16, (uint32)inChannels);
+        put(header + 20, (uint32)outChannels);
+        put(header + 24, (uint32)granule);
+        put(header + 28, (uint32)numGranules);
+        put(header + 32, savedVersion);
+        return true;
+    }
+
+    bool headerMatches() const {
+        auto header = (const uint8*)map->getData();
+        return memcmp(header, "TYFZ", 4) == 0 && get<uint32>(header + 4) == (uint32)format
+            && get<double>(header + 8) == sampleRate && get<uint32>(header + 16) == (uint32)inChannels
+            && get<uint32>(header + 20) == (uint32)outChannels && get<uint32>(header + 24) == (uint32)granule
+            && get<uint32>(header + 28) == (uint32)numGranules;
+    }
+
+    void write(const Job& job) {
+        int segment = 0;
+        forEachSegment(job.position, job.numSamples, [&](int g, int offset, int start, int length) {
+            if (job.frozen[segment++]) return;
+            auto* info = getGranule(g);
+            auto& state = progress[(size_t)g];
+            if (offset == 0) {
+                state.next = 0;
+                state.tag = job.tag;
+                info->stamp = 0;
+                info->numEvents = 0;
+            } else if (state.next != offset || state.tag != job.tag) {
+                // came in part way, it has to wait for a pass from the start
+                state.next = -1;
+                if (info->stamp != 0) info->stamp = 0;
+                return;
+            }
+            auto data = getAudio(g);
+            for (int ch = 0; ch < outChannels; ch++) {
+                memcpy(data + (size_t)ch * granule + offset, job.output.getReadPointer(ch, start), (size_t)length * sizeof(float));
+            }
+            data += (size_t)outChannels * granule;
+            for (int ch = 0; ch < inChannels; ch++) {
+                memcpy(data + (size_t)ch * granule + offset, job.input.getReadPointer(ch, start), (size_t)length * sizeof(float));
+            }
+            for (int e = 0; e < job.numEvents; e++) {
+                auto event = job.events[e];
+                if (event.offset < start || event.offset >= start + length) continue;
+                if (info->numEvents == maxEvents) {
+                    state.next = -1;
+                    return;
+                }
+                event.offset = (uint16)(event.offset - start + offset);
+                info->events[info->numEvents++] = event;
+            }
+            state.next += length;
+            if (state.next == granule) {
+                // everything else is there before the stamp says so
+                std::atomic_thread_fence(std::memory_order_release);
+                memcpy(&info->stamp, &job.tag, sizeof(job.tag));
+                state.next = -1;
+            }
+        });
+    }
+
+    // touches the next couple of seconds so play() finds them in memory
+    void prefetch() {
+        auto first = playhead.load();
+        if (first < 0 || first == prefetched) return;
+        prefetched = first;
+        auto count = (int)std::ceil(2.0 * sampleRate / granule);
+        uint8 sum = 0;
+        for (int g = first; g < jmin(numGranules, first + count); g++) {
+            sum ^= ((const uint8*)getGranule(g))[0];
+            auto data = (const uint8*)getAudio(g);
+            for (size_t at = 0; at < granuleBytes; at += 4096) sum ^= data[at];
+        }
+        touched = sum;
+    }
+
+    template <typename T>
+    static void put(uint8* dest, T value) {
+        value = ByteOrder::swapIfBigEndian(value);
+        memcpy(dest, &value, sizeof(T));
+    }
+
+    template <typename T>
+    static T get(const uint8* src) {
+        T value;
+        memcpy(&value, src, sizeof(T));
+        return ByteOrder::swapIfBigEndian(value);
+    }
+
+    File file;
+    double sampleRate;
+    int inChannels, outChannels, maxBlockSize, numGranules;
+    size_t granuleBytes = 0, tableBytes = 0, totalBytes = 0;
+    std::unique_ptr<MemoryMappedFile> map;
+    std::atomic<bool> ready{ false }, clearRequested{ false };
+    std::atomic<uint64> workerVersion{ 0 };
+    uint64 savedVersion = 0;
+    std::atomic<int> playhead{ -1 };
+    int prefetched = -1;
+    volatile uint8 touched = 0;
+    std::vector<Progress> progress;
+
+    // the block between play() and record(), audio thread only
+    int64 blockPosition = -1;
+    int blockSamples = 0;
+    uint64 blockTag = 0;
+    AudioBuffer<float> input;
+    Event blockEvents[maxBlockEvents];
+    int numBlockEvents = 0;
+    bool segmentFrozen[maxSegments] = {};
+    int numSegments = 0;
+
+    Job jobs[queueLength];
+    AbstractFifo fifo{ queueLength };
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(FreezeCache)
+};
@@ -0,0 +1,299 @@
+#pragma once
+
+// Native inference for the small attention denoiser trained in
+// quantize_train-*.ipynb (Net), so it doesn't need torch behind the socket.
+// Net.forward() is
+//   l0 (scalar) -> single-head attention across channels, each channel's
+//   frame being one token -> attn_out (scalar) -> tanh -> l3 (scalar)
+//   -> conv1d with replicate padding
+// The LayerNorm, lstm_out and l_tmp layers are declared there but never used
+// in forward(), so there's nothing to run for them. All the scalars fold into
+// two matrices when the weights are loaded:
+//   values  W_ov = attn_out * l0 * W_o * W_v
+//   scores  M    = l0^2 / sqrt(E) * W_q^T * W_k    (q.k = x_i . M x_j)
+// so a frame costs one matrix-vector product per channel, two when there's
+// more than one channel to attend across. The conv kernel takes l3.
+//
+// Weights come from the export cell after torch.save in the notebook:
+//   "TYNN", u32 version (1), u32 E (frame size), u32 K (kernel taps),
+//   then float32 little-endian l0[1], in_proj[3E*E], out_proj[E*E],
+//   attn_out[1], l3[1], kernel[K]
+
+// E x E, stored by column so y += x[j] * column j is a straight vector op and
+// every column is read once for all tokens. Optionally int8 with one scale per
+// column, a quarter of the memory traffic for a small loss of precision.
+class DenseMatrix {
+public:
+    void set(const float* rowMajor, int size_, bool quantise) {
+        size = size_;
+        quantised = quantise;
+        auto count = (size_t)size * (size_t)size;
+        if (quantised) {
+            q.allocate(count, false);
+            scales.allocate((size_t)size, false);
+            values.free();
+        } else {
+            values.allocate(count, false);
+            q.free();
+        }
+        for (int j = 0; j < size; j++) {
+            float peak = 0.0f;
+            for (int i = 0; i < size; i++) peak = jmax(peak, std::abs(rowMajor[(size_t)i * size + j]));
+            auto scale = peak > 0.0f ? peak / 127.0f : 1.0f;
+            for (int i = 0; i < size; i++) {
+                auto w = rowMajor[(size_t)i * size + j];
+                auto index = (size_t)j * size + i;
+                if (quantised) q[index] = (int8)roundToInt(w / scale);
+                else values[index] = w;
+            }
+            if (quantised) scales[j] = scale;
+        }
+    }
+
+    // y[t] = W x[t] for every token
+    void multiply(const float* const* x, float* const* y, int numTokens) const {
+        for (int t = 0; t < numTokens; t++) FloatVectorOperations::clear(y[t], size);
+        for (int j = 0; j < size; j++) {
+            if (quantised) {
+                auto column = q.get() + (size_t)j * size;
+                for (int t = 0; t < numTokens; t++) addWithMultiply(y[t], column, x[t][j] * scales[j], size);
+            } else {
+                auto column = values.get() + (size_t)j * size;
+                for (int t = 0; t < numTokens; t++) FloatVectorOperations::addWithMultiply(y[t], column, x[t][j], size);
+            }
+        }
+    }
+
+private:
+    // widen and accumulate in one loop the compiler can vectorise
+    static void addWithMultiply(float* __restrict y, const int8* __restrict w, float m, int n) {
+        for (int i = 0; i < n; i++) y[i] += (float)w[i] * m;
+    }
+
+    int size = 0;
+    bool quantised = false;
+    HeapBlock<float> values, scales;
+    HeapBlock<int8> q;
+};
+
+class AttentionDenoiser {
+public:
+    enum { maxTokens = 8 };
+
+    // nullptr if the file isn't a valid export
+    static std::unique_ptr<AttentionDenoiser> fromFile(const File& file, bool quantise) {
+        MemoryBlock data;
+        if (!file.loadFileAsData(data) || data.getSize() < 16 || memcmp(data.getData(), "TYNN", 4) != 0) {
+            DBG("not a model export: " << file.getFullPathName());
+            return nullptr;
+        }
+        auto header = (const uint8*)data.getData();
+        auto version = (int)ByteOrder::littleEndianInt(header + 4);
+        auto e = (int)ByteOrder::littleEndianInt(header + 8);
+        auto k = (int)ByteOrder::littleEndianInt(header + 12);
+        auto numFloats = (size_t)1 + 4 * (size_t)e * e + 2 + (size_t)k;
+        if (version != 1 || e <= 0 || e > 8192 || k <= 0 || k > 64 || data.getSize() != 16 + numFloats * sizeof(float)) {
+            DBG("unsupported model export: " << file.getFullPathName());
+            return nullptr;
+        }
+
+        HeapBlock<float> w(numFloats);
+        for (size_t i = 0; i < numFloats; i++) {
+            auto bits = ByteOrder::littleEndianInt(header + 16 + i * sizeof(float));
+            memcpy(w.get() + i, &bits, sizeof(float));
+        }
+        auto l0 = w[0];
+        auto inProj = w.get() + 1;
+        auto wq = inProj, wk = inProj + (size_t)e * e, wv = inProj + 2 * (size_t)e * e;
+        auto wo = inProj + 3 * (size_t)e * e;
+        auto attnOut = wo[(size_t)e * e];
+        auto l3 = wo[(size_t)e * e + 1];
+        auto kernel = wo + (size_t)e * e + 2;
+
+        auto model = std::make_unique<AttentionDenoiser>();
+        model->frameSize = e;
+        model->numTaps = k;
+        model->kernel.allocate((size_t)k, false);
+        for (int j = 0; j < k; j++) model->kernel[j] = kernel[j] * l3;
+
+        // W_ov[a] = sum_r W_o[a][r] * W_v[r], one row at a time
+        HeapBlock<float> product((size_t)e * e, true);
+        for (int a = 0; a < e; a++) {
+            auto row = product.get() + (size_t)a * e;
+            for (int r = 0; r < e; r++) {
+                FloatVectorOperations::addWithMultiply(row, wv + (size_t)r * e, wo[(size_t)a * e + r] * attnOut * l0, e);
+            }
+        }
+        model->valueMatrix.set(product.get(), e, quantise);
+
+        // M[a] = sum_r W_q[r][a] * W_k[r]
+        FloatVectorOperations::clear(product.get(), e * e);
+        auto scoreScale = l0 * l0 / std::sqrt((float)e);
+        for (int r = 0; r < e; r++) {
+            for (int a = 0; a < e; a++) {
+                FloatVectorOperations::addWithMultiply(product.get() + (size_t)a * e, wk + (size_t)r * e, wq[(size_t)r * e + a] * scoreScale, e);
+            }
+        }
+        model->scoreMatrix.set(product.get(), e, quantise);
+        return model;
+    }
+
+    int getFrameSize() const { return frameSize; }
+
+    // all activations up front, process() doesn't allocate
+    void prepare(int numTokens_) {
+        numTokens = jlimit(1, (int)maxTokens, numTokens_);
+        values.setSize(numTokens, frameSize);
+        keys.setSize(numTokens, frameSize);
+        attended.setSize(numTokens, frameSize);
+        padded.allocate((size_t)(frameSize + numTaps), false);
+    }
+
+    // frames[t] holds frameSize samples of channel t, replaced with the output
+    void process(float* const* frames, int tokens) {
+        tokens = jmin(tokens, numTokens);
+        auto e = frameSize;
+        valueMatrix.multiply(frames, values.getArrayOfWritePointers(), tokens);
+
+        if (tokens == 1) {
+            // one key, the softmax is 1
+            FloatVectorOperations::copy(attended.getWritePointer(0), values.getReadPointer(0), e);
+        } else {
+            scoreMatrix.multiply(frames, keys.getArrayOfWritePointers(), tokens);
+            for (int i = 0; i < tokens; i++) {
+                float scores[maxTokens];
+                float peak = -std::numeric_limits<float>::max();
+                for (int j = 0; j < tokens; j++) {
+                    scores[j] = dot(frames[i], keys.getReadPointer(j), e);
+                    peak = jmax(peak, scores[j]);
+                }
+                float sum = 0.0f;
+                for (int j = 0; j < tokens; j++) {
+                    scores[j] = std::exp(scores[j] - peak);
+                    sum += scores[j];
+                }
+                auto out = attended.getWritePointer(i);
+                FloatVectorOperations::copyWithMultiply(out, values.getReadPointer(0), scores[0] / sum, e);
+                for (int j = 1; j < tokens; j++) {
+                    FloatVectorOperations::addWithMultiply(out, values.getReadPointer(j), scores[j] / sum, e);
+                }
+            }
+        }
+
+        // tanh into the middle of a replicate-padded frame, then the kernel tap by tap
+        auto half = numTaps / 2;
+        auto pad = padded.get();
+        for (int t = 0; t < tokens; t++) {
+            auto att = attended.getReadPointer(t);
+            for (int i = 0; i < e; i++) pad[half + i] = std::tanh(att[i]);
+            for (int i = 0; i < half; i++) {
+                pad[i] = pad[half];
+                pad[half + e + i] = pad[half + e - 1];
+            }
+            auto out = frames[t];
+            FloatVectorOperations::copyWithMultiply(out, pad, kernel[0], e);
+            for (int j = 1; j < numTaps; j++) {
+                FloatVectorOperations::addWithMultiply(out, pad + j, kernel[j], e);
+            }
+        }
+    }
+
+private:
+    static float dot(const float* __restrict a, const float* __restrict b, int n) {
+        float sum = 0.0f;
+        for (int i = 0; i < n; i++) sum += a[i] * b[i];
+        return sum;
+    }
+
+    int frameSize = 0, numTaps = 0, numTokens = 0;
+    DenseMatrix valueMatrix, scoreMatrix;
+    HeapBlock<float> kernel, padded;
+    AudioBuffer<float> values, keys, attended;
+};
+
+// Runs a model on its own thread. The model wants whole frames and the host
+// block size is whatever it is, so the audio thread only writes into an input
+// FIFO and reads from an output FIFO primed with frame + block of silence,
+// which is how far behind the output runs.
+class NativeInference : public juce::Thread {
+public:
+    NativeInference(std::unique_ptr<AttentionDenoiser> model_, int numChannels_, int maxBlockSize)
+        : Thread("typhon inference"), model(std::move(model_)), numChannels(jmin(numChannels_, (int)AttentionDenoiser::maxTokens)),
+          frameSize(model->getFrameSize()), latency(frameSize + maxBlockSize),
+          inFifo(4 * (frameSize + maxBlockSize)), outFifo(4 * (frameSize + maxBlockSize)) {
+        model->prepare(numChannels);
+        inBuffer.setSize(numChannels, inFifo.getTotalSize());
+        outBuffer.setSize(numChannels, outFifo.getTotalSize());
+        inBuffer.clear();
+        outBuffer.clear();
+        frames.setSize(numChannels, frameSize);
+        outFifo.finishedWrite(latency);
+    }
+
+    ~NativeInference() override {
+        stopThread(1000);
+    }
+
+    int getLatencySamples() const { return latency; }
+
+    // audio thread
+    void process(AudioBuffer<float>& buffer, int channels, int numSamples) {
+        channels = jmin(channels, numChannels);
+        write(inFifo, inBuffer, buffer, channels, numSamples);
+        notify();
+
+        // whatever the worker couldn't deliver last time is skipped so we stay in step
+        if (owed > 0) {
+            auto skip = jmin(owed, outFifo.getNumReady());
+            outFifo.finishedRead(skip);
+            owed -= skip;
+        }
+        auto got = read(outFifo, outBuffer, buffer, channels, numSamples);
+        if (got < numSamples) {
+            for (int ch = 0; ch < channels; ch++) buffer.clear(ch, got, numSamples - got);
+            owed += numSamples - got;
+        }
+    }
+
+    void run() override {
+        while (!threadShouldExit()) {
+            if (inFifo.getNumReady() < frameSize || outFifo.getFreeSpace() < frameSize) {
+                wait(20);
+                continue;
+            }
+            read(inFifo, inBuffer, frames, numChannels, frameSize);
+            model->process(frames.getArrayOfWritePointers(), numChannels);
+            write(outFifo, outBuffer, frames, numChannels, frameSize);
+        }
+    }
+
+private:
+    static void write(AbstractFifo& fifo, AudioBuffer<float>& ring, const AudioBuffer<float>& src, int channels, int n) {
+        int start1, size1, start2, size2;
+        fifo.prepareToWrite(n, start1, size1, start2, size2);
+        for (int ch = 0; ch < channels; ch++) {
+            if (size1 > 0) ring.copyFrom(ch, start1, src.getReadPointer(ch), size1);
+            if (size2 > 0) ring.copyFrom(ch, start2, src.getReadPointer(ch, size1), size2);
+        }
+        fifo.finishedWrite(size1 + size2);
+    }
+
+    static int read(AbstractFifo& fifo, const AudioBuffer<float>& ring, AudioBuffer<float>& dest, int channels, int n) {
+        int start1, size1, start2, size2;
+        fifo.prepareToRead(n, start1, size1, start2, size2);
+        for (int ch = 0; ch < channels; ch++) {
+            if (size1 > 0) dest.copyFrom(ch, 0, ring.getReadPointer(ch, start1), size1);
+            if (size2 > 0) dest.copyFrom(ch, size1, ring.getReadPointer(ch, start2), size2);
+        }
+        fifo.finishedRead(size1 + size2);
+        return size1 + size2;
+    }
+
+    std::unique_ptr<AttentionDenoiser> model;
+    int numChannels, frameSize, latency;
+    int owed = 0;   // audio thread only
+    AbstractFifo inFifo, outFifo;
+    AudioBuffer<float> inBuffer, outBuffer, frames;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(NativeInference)
+};
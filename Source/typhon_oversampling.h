@@ -0,0 +1,182 @@
+#pragma once
+
+// Polyphase half-band oversampling for the nonlinear stages of the native
+// chain (overdrive and friends alias badly at 44.1/48k). 2x/4x/8x is a cascade
+// of 2x half-band stages. Every other tap of a half-band filter is zero, so
+// each 2x step only needs one short FIR branch per direction; the other branch
+// is just a delayed copy. The FIR branches run tap by tap across the whole
+// block with FloatVectorOperations rather than sample by sample.
+
+class HalfBandFilter {
+public:
+    // taps = 4 * quarter + 3, so the centre tap is odd and the odd branch
+    // collapses to a pure delay of `quarter` input samples. extraDelay pads
+    // the input so a cascade adds up to a whole number of host samples.
+    void prepare(int quarter_, int maxInputBlock, int extraDelay_ = 0) {
+        quarter = quarter_;
+        extraDelay = extraDelay_;
+        auto numTaps = 4 * quarter + 3;
+        auto centre = (numTaps - 1) / 2;
+        branchTaps = 2 * quarter + 2;
+        history = branchTaps - 1 + extraDelay;
+
+        // Kaiser-windowed sinc at a quarter of the (oversampled) rate
+        const double beta = 8.0;
+        evenTaps.allocate((size_t)branchTaps, true);
+        for (int j = 0; j < branchTaps; j++) {
+            auto k = 2 * j;
+            auto m = (double)(k - centre);
+            auto sinc = std::sin(MathConstants<double>::halfPi * m) / (MathConstants<double>::pi * m);
+            auto r = m / centre;
+            auto window = besselI0(beta * std::sqrt(jmax(0.0, 1.0 - r * r))) / besselI0(beta);
+            evenTaps[j] = (float)(sinc * window);
+        }
+
+        // scale the branch so DC passes at exactly 0.5, the centre tap's share
+        double sum = 0.0;
+        for (int j = 0; j < branchTaps; j++) sum += evenTaps[j];
+        for (int j = 0; j < branchTaps; j++) evenTaps[j] = (float)(evenTaps[j] * 0.5 / sum);
+
+        upBuf.allocate((size_t)(history + maxInputBlock), true);
+        evenBuf.allocate((size_t)(branchTaps - 1 + maxInputBlock), true);
+        oddBuf.allocate((size_t)(quarter + 1 + maxInputBlock), true);
+        branchOut.allocate((size_t)maxInputBlock, true);
+        capacity = maxInputBlock;
+    }
+
+    void reset() {
+        FloatVectorOperations::clear(upBuf.get(), history + capacity);
+        FloatVectorOperations::clear(evenBuf.get(), branchTaps - 1 + capacity);
+        FloatVectorOperations::clear(oddBuf.get(), quarter + 1 + capacity);
+    }
+
+    // n samples in, 2n out
+    void upsample(const float* in, float* out, int n) {
+        auto buf = upBuf.get();
+        FloatVectorOperations::copy(buf + history, in, n);
+
+        // even outputs: 2 * even taps, odd outputs: 2 * 0.5 * x[n - quarter]
+        auto newest = buf + history - extraDelay;
+        auto even = branchOut.get();
+        fir(even, newest, n, 2.0f);
+        auto delayed = newest - quarter;
+        for (int i = 0; i < n; i++) {
+            out[2 * i] = even[i];
+            out[2 * i + 1] = delayed[i];
+        }
+        FloatVectorOperations::copy(buf, buf + n, history);
+    }
+
+    // 2n samples in, n out
+    void downsample(const float* in, float* out, int n) {
+        auto e = evenBuf.get();
+        auto o = oddBuf.get();
+        auto evenHistory = branchTaps - 1;
+        auto oddHistory = quarter + 1;
+        for (int i = 0; i < n; i++) {
+            e[evenHistory + i] = in[2 * i];
+            o[oddHistory + i] = in[2 * i + 1];
+        }
+        fir(out, e + evenHistory, n, 1.0f);
+        FloatVectorOperations::addWithMultiply(out, o, 0.5f, n);
+        FloatVectorOperations::copy(e, e + n, evenHistory);
+        FloatVectorOperations::copy(o, o + n, oddHistory);
+    }
+
+    // delay through one up + down pair, in samples at the lower rate
+    int getRoundTripLatency() const { return 2 * quarter + 1 + extraDelay; }
+
+private:
+    // out[i] = gain * sum_j taps[j] * x[i - j], x has branchTaps - 1 of history before it
+    void fir(float* out, const float* x, int n, float gain) {
+        FloatVectorOperations::copyWithMultiply(out, x, evenTaps[0] * gain, n);
+        for (int j = 1; j < branchTaps; j++) {
+            FloatVectorOperations::addWithMultiply(out, x - j, evenTaps[j] * gain, n);
+        }
+    }
+
+    static double besselI0(double x) {
+        double sum = 1.0, term = 1.0;
+        for (int k = 1; k < 32; k++) {
+            term *= (x / (2.0 * k)) * (x / (2.0 * k));
+            sum += term;
+        }
+        return sum;
+    }
+
+    int quarter = 0, extraDelay = 0, branchTaps = 0, history = 0, capacity = 0;
+    HeapBlock<float> evenTaps, upBuf, evenBuf, oddBuf, branchOut;
+};
+
+class Oversampler {
+public:
+    // factor is 2, 4 or 8
+    void prepare(int numChannels_, int maxBlockSize, int factor_) {
+        numChannels = numChannels_;
+        factor = factor_;
+        numStages = factor >= 8 ? 3 : (factor >= 4 ? 2 : 1);
+        filters.clear();
+        buffers.clear();
+        auto blockSize = maxBlockSize;
+        for (int s = 0; s < numStages; s++) {
+            // the first stage has the tightest transition band, later ones get shorter
+            auto quarter = s == 0 ? 15 : (s == 1 ? 7 : 4);
+            // pad so this stage's delay is a whole number of host samples
+            auto rate = 1 << s;
+            auto pad = (rate - (2 * quarter + 1) % rate) % rate;
+            for (int ch = 0; ch < numChannels; ch++) {
+                filters.push_back(std::make_unique<HalfBandFilter>());
+                filters.back()->prepare(quarter, blockSize, pad);
+            }
+            blockSize *= 2;
+            buffers.push_back(std::make_unique<AudioBuffer<float>>(numChannels, blockSize));
+        }
+    }
+
+    void reset() {
+        for (auto& f : filters) f->reset();
+    }
+
+    int getFactor() const { return factor; }
+
+    // returns the buffer at the top rate holding numSamples * factor samples,
+    // taken from in at startSample; numSamples is at most maxBlockSize
+    AudioBuffer<float>& upsample(const AudioBuffer<float>& in, int numSamples, int startSample = 0) {
+        auto n = numSamples;
+        for (int s = 0; s < numStages; s++) {
+            auto& dest = *buffers[(size_t)s];
+            for (int ch = 0; ch < numChannels; ch++) {
+                auto src = s == 0 ? in.getReadPointer(ch, startSample) : buffers[(size_t)s - 1]->getReadPointer(ch);
+                filters[(size_t)(s * numChannels + ch)]->upsample(src, dest.getWritePointer(ch), n);
+            }
+            n *= 2;
+        }
+        return *buffers.back();
+    }
+
+    void downsample(AudioBuffer<float>& out, int numSamples, int startSample = 0) {
+        auto n = numSamples * factor / 2;
+        for (int s = numStages; --s >= 0;) {
+            auto& src = *buffers[(size_t)s];
+            for (int ch = 0; ch < numChannels; ch++) {
+                auto dest = s == 0 ? out.getWritePointer(ch, startSample) : buffers[(size_t)s - 1]->getWritePointer(ch);
+                filters[(size_t)(s * numChannels + ch)]->downsample(src.getReadPointer(ch), dest, n);
+            }
+            n /= 2;
+        }
+    }
+
+    // each 2x stage's round trip counts at its own input rate
+    int getLatencySamples() const {
+        int latency = 0;
+        for (int s = 0; s < numStages && numChannels > 0; s++) {
+            latency += filters[(size_t)(s * numChannels)]->getRoundTripLatency() >> s;
+        }
+        return latency;
+    }
+
+private:
+    int numChannels = 0, factor = 1, numStages = 0;
+    std::vector<std::unique_ptr<HalfBandFilter>> filters;
+    std::vector<std::unique_ptr<AudioBuffer<float>>> buffers;
+};
@@ -0,0 +1,123 @@
+#pragma once
+
+// Block-rate parameter engine.
+// Every parameter is read once at the top of process() and turned into a
+// linear per-sample ramp from last block's value to this block's value, so
+// automation doesn't zipper at block boundaries. If a parameter hasn't moved
+// it's flagged steady and its ramp is never written.
+
+class ParamEngine {
+public:
+    enum { maxParams = 16 };
+
+    // returns the index to use with isSteady/getValue/getRamp
+    int add(std::atomic<float>* source) {
+        jassert(source != nullptr && numParams < maxParams);
+        params[numParams].source = source;
+        params[numParams].current = source->load(std::memory_order_relaxed);
+        return numParams++;
+    }
+
+    void prepare(int maxBlockSize) {
+        capacity = maxBlockSize;
+        ramps.setSize(maxParams, capacity);
+        // ramp[i] = current + (i + 1) * step, so the last sample lands on target
+        index.allocate((size_t)capacity, false);
+        for (int i = 0; i < capacity; i++) {
+            index[i] = (float)(i + 1);
+        }
+        for (int p = 0; p < numParams; p++) {
+            params[p].current = params[p].source->load(std::memory_order_relaxed);
+            params[p].steady = true;
+        }
+    }
+
+    // snapshot everything up front so the whole block sees one consistent set
+    void beginBlock(int numSamples) {
+        for (int p = 0; p < numParams; p++) {
+            params[p].target = params[p].source->load(std::memory_order_relaxed);
+        }
+        for (int p = 0; p < numParams; p++) {
+            auto& param = params[p];
+            param.steady = param.target == param.current;
+            if (param.steady) continue;
+
+            if (numSamples <= 0 || numSamples > capacity) {
+                // host gave us more than prepareToPlay promised, just jump
+                jassert(numSamples <= capacity);
+                param.current = param.target;
+                param.steady = true;
+                continue;
+            }
+            auto step = (param.target - param.current) / (float)numSamples;
+            auto ramp = ramps.getWritePointer(p);
+            FloatVectorOperations::copyWithMultiply(ramp, index.get(), step, numSamples);
+            FloatVectorOperations::add(ramp, param.current, numSamples);
+            ramp[numSamples - 1] = param.target;
+            param.current = param.target;
+        }
+    }
+
+    bool isSteady(int p) const { return params[p].steady; }
+    bool allSteady() const {
+        for (int p = 0; p < numParams; p++) {
+            if (!params[p].steady) return false;
+        }
+        return true;
+    }
+    // end-of-block value; for a steady parameter that's the whole block
+    float getValue(int p) const { return params[p].current; }
+
+    // per-sample values for this block. A steady parameter gets its ramp
+    // filled with the constant, only call this when something else is moving.
+    const float* getRamp(int p, int numSamples) {
+        auto ramp = ramps.getWritePointer(p);
+        if (params[p].steady) {
+            FloatVectorOperations::fill(ramp, params[p].current, jmin(numSamples, capacity));
+        }
+        return ramp;
+    }
+
+    int getCapacity() const { return capacity; }
+
+private:
+    struct Param {
+        std::atomic<float>* source = nullptr;
+        float current = 0.0f;
+        float target = 0.0f;
+        bool steady = true;
+    };
+    Param params[maxParams];
+    int numParams = 0;
+    int capacity = 0;
+    AudioBuffer<float> ramps;
+    HeapBlock<float> index;
+};
+
+// gain -> delay feedback -> delay mix in a single pass over each channel.
+// mix is how much of the delay line is sent on top of the signal, the dry
+// path always stays at full level (0 is no echo at all).
+// delay is the slice of the delay line lined up with out, the caller splits
+// the block wherever the delay line wraps so this stays a straight loop the
+// compiler can vectorise.
+struct GainDelayMix {
+    static void process(float* __restrict out, float* __restrict delay, int numSamples,
+                        float gain, float feedback, float mix) {
+        for (int i = 0; i < numSamples; i++) {
+            auto x = out[i] * gain;
+            auto d = delay[i];
+            out[i] = x + d * mix;
+            delay[i] = (d + x) * feedback;
+        }
+    }
+
+    static void process(float* __restrict out, float* __restrict delay, int numSamples,
+                        const float* __restrict gain, const float* __restrict feedback, const float* __restrict mix) {
+        for (int i = 0; i < numSamples; i++) {
+            auto x = out[i] * gain[i];
+            auto d = delay[i];
+            out[i] = x + d * mix[i];
+            delay[i] = (d + x) * feedback[i];
+        }
+    }
+};
@@ -0,0 +1,455 @@
+#pragma once
+
+// Wire format v2. A worker opts in with "proto=2" in its HELO; anything else
+// keeps the original raw frames. Every v2 message in either direction starts
+// with this header, all fields little-endian:
+//
+//   0  "TYFR"
+//   4  u16 headerBytes   (size of this header, skip anything past what you know)
+//   6  u16 kind          (what the payload is, see Kind)
+//   8  u32 seq
+//  12  u16 channels
+//  14  u16 flags
+//  16  u32 samples       (per channel in the payload)
+//  20  u32 history       context window layout, see below
+//  24  u32 current
+//  28  u32 lookahead
+//  32  i64 windowOffset  (stream position of the first payload sample)
+//  40  u32 midiBytes     (3-byte short messages after the samples)
+//
+// then channels * samples int16 planar (float32 with the float32 flag) and
+// midiBytes of MIDI. With the transportInfo flag the header is followed by a
+// TransportInfo block and headerBytes covers both; the payload always starts
+// at headerBytes. Kinds other than audio say what their fields mean where
+// they're built (spectrum: typhon_spectral.h, features: typhon_features.h,
+// control: typhon_control.h, batch: typhon_batch.h).
+//
+// Context window: a worker that asks for "history=N;lookahead=M" keeps one
+// ring per channel and writes each payload into it at windowOffset. The
+// plugin sends the whole window once as a keyframe, and after that only the
+// newest block. The frame to run is then
+//   [history | current | lookahead]  ending at windowOffset + samples
+// and the reply is `current` samples lined up with the current block. The
+// lookahead is reported to the host as latency. A worker that loses track
+// (restart, dropped frame) sets the resync flag on a reply to get another
+// keyframe.
+//
+// Subscriptions: a worker says which streams it wants and which it answers
+// with, so nobody ships 300 bytes of MIDI to an effect or a block of audio to
+// a MIDI generator:
+//   HELO proto=2;consumes=midi,transport;produces=midi
+// consumes is any of audio, midi, features (in place of audio, see
+// typhon_features.h), transport (host tempo and position every frame) and
+// sidechain/aux (those input buses, after the main channels, see BusLayout);
+// produces is audio, midi and/or control (in place of audio, see
+// typhon_control.h). Left out, both mean audio,midi. A frame
+// without audio has channels = samples = 0 but still says how long the block
+// is in `current`. Audio that isn't produced leaves the block dry.
+//
+// Silence: with "silence=<dBFS>" (or "silence=digital" for exact zeros) a
+// block whose every sample is at or under that level goes out as a header
+// with the silent flag and samples = 0. Everything else in the header is as
+// usual, so a context-window worker just writes `current` zeros at
+// windowOffset. Keyframes are always sent in full. A worker can answer any
+// frame the same way, flag set and no samples, and the plugin clears the
+// block instead of converting one.
+//
+// Sessions: a worker that names itself with "session=<name>" can reconnect
+// without losing its place, see typhon_session.h.
+//
+// Caching: a worker that says "deterministic=1" has its replies remembered
+// and repeated frames answered without it, see typhon_cache.h.
+//
+// Shared memory: a worker on the same machine can trade frames through a file
+// it maps instead of the socket, see typhon_shm.h.
+//
+// Warm-up: before any real audio a worker is sent a few throwaway frames with
+// the warmup flag, so it's done compiling by the time it matters, see
+// typhon_warmup.h.
+//
+// Quality levels: a worker can offer cheaper settings with "level1=..",
+// "level2=.." and is moved between them when the plugin runs short of time,
+// see typhon_quality.h.
+
+// A frame built in place: the first `size` bytes of its builder's block,
+// which stays at its largest so the audio thread never reallocates it. Good
+// until the builder makes the next one. A MemoryBlock converts to one.
+struct FrameRef {
+    FrameRef(const void* data_, size_t size_) : data(data_), size(size_) {}
+    FrameRef(const MemoryBlock& block) : data(block.getData()), size(block.getSize()) {}
+
+    const void* getData() const { return data; }
+    size_t getSize() const { return size; }
+
+private:
+    const void* data;
+    size_t size;
+};
+
+// Host position, sent with every frame to a worker that consumes transport.
+//   0  f64 bpm
+//   8  f64 ppqPosition
+//  16  f64 ppqPositionOfLastBarStart
+//  24  i64 timeInSamples
+//  32  u16 numerator, 34 u16 denominator
+//  36  u32 state         (playing 1, recording 2, looping 4)
+struct TransportInfo {
+    enum { size = 40 };
+    enum State { playing = 1, recording = 2, looping = 4 };
+
+    double bpm = 120.0, ppqPosition = 0.0, ppqPositionOfLastBarStart = 0.0;
+    int64 timeInSamples = 0;
+    uint16 numerator = 4, denominator = 4;
+    uint32 state = 0;
+
+    static TransportInfo from(const AudioPlayHead::CurrentPositionInfo& info) {
+        TransportInfo t;
+        t.bpm = info.bpm;
+        t.ppqPosition = info.ppqPosition;
+        t.ppqPositionOfLastBarStart = info.ppqPositionOfLastBarStart;
+        t.timeInSamples = info.timeInSamples;
+        t.numerator = (uint16)jmax(0, info.timeSigNumerator);
+        t.denominator = (uint16)jmax(0, info.timeSigDenominator);
+        t.state = (info.isPlaying ? playing : 0) | (info.isRecording ? recording : 0) | (info.isLooping ? looping : 0);
+        return t;
+    }
+};
+
+// Which input buses an audio frame carries, sent with the buses flag right
+// after the header (and TransportInfo, if that's there too):
+//   0  u16 main   2 u16 sidechain   4 u16 aux   6 u16 reserved
+// channels = main + sidechain + aux, planar in that order. Only on frames to a
+// worker that consumes sidechain or aux.
+struct BusLayout {
+    enum { size = 8 };
+
+    uint16 main = 0, sidechain = 0, aux = 0;
+};
+
+struct Subscription {
+    enum Stream { audio = 1, midi = 2, features = 4, transport = 8, control = 16, sidechain = 32, aux = 64 };
+
+    static int parse(const String& list) {
+        int mask = 0;
+        for (auto& name : StringArray::fromTokens(list, ",", "")) {
+            auto n = name.trim();
+            if (n == "audio") mask |= audio;
+            else if (n == "midi") mask |= midi;
+            else if (n == "features") mask |= features;
+            else if (n == "transport") mask |= transport;
+            else if (n == "control") mask |= control;
+            else if (n == "sidechain") mask |= sidechain;
+            else if (n == "aux") mask |= aux;
+        }
+        return mask;
+    }
+};
+
+struct FrameHeader {
+    enum Kind { audio = 0, spectrum = 1, features = 2, control = 3, batch = 4 };
+    enum Flags { keyframe = 1, resync = 2, float32 = 4, magnitudes = 8, transportInfo = 16, silent = 32, buses = 64, warmup = 128 };
+    enum { size = 44 };
+
+    uint16 headerBytes = size;
+    uint16 kind = audio;
+    uint32 seq = 0;
+    uint16 channels = 0;
+    uint16 flags = 0;
+    uint32 samples = 0;
+    uint32 history = 0, current = 0, lookahead = 0;
+    int64 windowOffset = 0;
+    uint32 midiBytes = 0;
+    TransportInfo transport; // only on the wire with the transportInfo flag
+    BusLayout layout;        // only on the wire with the buses flag
+
+    // where the payload starts in what write() produces
+    int getHeaderBytes() const {
+        return getBusesOffset() + ((flags & buses) ? (int)BusLayout::size : 0);
+    }
+
+    int getBusesOffset() const {
+        return size + ((flags & transportInfo) ? (int)TransportInfo::size : 0);
+    }
+
+    void write(uint8* dest) const {
+        memcpy(dest, "TYFR", 4);
+        put(dest + 4, (uint16)getHeaderBytes());
+        put(dest + 6, kind);
+        put(dest + 8, seq);
+        put(dest + 12, channels);
+        put(dest + 14, flags);
+        put(dest + 16, samples);
+        put(dest + 20, history);
+        put(dest + 24, current);
+        put(dest + 28, lookahead);
+        put(dest + 32, windowOffset);
+        put(dest + 40, midiBytes);
+        if (flags & transportInfo) {
+            auto t = dest + size;
+            put(t, transport.bpm);
+            put(t + 8, transport.ppqPosition);
+            put(t + 16, transport.ppqPositionOfLastBarStart);
+            put(t + 24, transport.timeInSamples);
+            put(t + 32, transport.numerator);
+            put(t + 34, transport.denominator);
+            put(t + 36, transport.state);
+        }
+        if (flags & buses) {
+            auto b = dest + getBusesOffset();
+            put(b, layout.main);
+            put(b + 2, layout.sidechain);
+            put(b + 4, layout.aux);
+            put(b + 6, (uint16)0);
+        }
+    }
+
+    // false if this isn't a v2 frame or its sizes don't add up
+    static bool read(FrameRef msg, FrameHeader& header) {
+        auto src = (const uint8*)msg.getData();
+        if (msg.getSize() < size || memcmp(src, "TYFR", 4) != 0) return false;
+        get(src + 4, header.headerBytes);
+        get(src + 6, header.kind);
+        get(src + 8, header.seq);
+        get(src + 12, header.channels);
+        get(src + 14, header.flags);
+        get(src + 16, header.samples);
+        get(src + 20, header.history);
+        get(src + 24, header.current);
+        get(src + 28, header.lookahead);
+        get(src + 32, header.windowOffset);
+        get(src + 40, header.midiBytes);
+        if ((header.flags & transportInfo) && header.headerBytes >= size + TransportInfo::size
+            && msg.getSize() >= size + TransportInfo::size) {
+            auto t = src + size;
+            get(t, header.transport.bpm);
+            get(t + 8, header.transport.ppqPosition);
+            get(t + 16, header.transport.ppqPositionOfLastBarStart);
+            get(t + 24, header.transport.timeInSamples);
+            get(t + 32, header.transport.numerator);
+            get(t + 34, header.transport.denominator);
+            get(t + 36, header.transport.state);
+        }
+        if ((header.flags & buses) && header.headerBytes >= header.getHeaderBytes()
+            && msg.getSize() >= (size_t)header.getHeaderBytes()) {
+            auto b = src + header.getBusesOffset();
+            get(b, header.layout.main);
+            get(b + 2, header.layout.sidechain);
+            get(b + 4, header.layout.aux);
+        }
+        return header.headerBytes >= size
+            && (uint64)header.headerBytes + header.getPayloadBytes() <= (uint64)msg.getSize();
+    }
+
+    uint64 getPayloadBytes() const {
+        auto bytesPerSample = (flags & float32) ? sizeof(float) : sizeof(int16);
+        return (uint64)channels * samples * bytesPerSample + midiBytes;
+    }
+
+private:
+    template <typename T> static void put(uint8* dest, T value) {
+        value = ByteOrder::swapIfBigEndian(value);
+        memcpy(dest, &value, sizeof(T));
+    }
+    template <typename T> static void get(const uint8* src, T& value) {
+        memcpy(&value, src, sizeof(T));
+        value = ByteOrder::swapIfBigEndian(value);
+    }
+    // doubles go over as their bit pattern
+    static void put(uint8* dest, double value) {
+        uint64 bits;
+        memcpy(&bits, &value, sizeof(bits));
+        put(dest, bits);
+    }
+    static void get(const uint8* src, double& value) {
+        uint64 bits;
+        get(src, bits);
+        memcpy(&value, &bits, sizeof(bits));
+    }
+};
+
+// float <-> int16 the same way the v1 frames do it, but clipped
+struct SampleConversion {
+    static void toInt16(int16* __restrict dest, const float* __restrict src, int n) {
+        for (int i = 0; i < n; i++) {
+            dest[i] = (int16)jlimit(-32768.0f, 32767.0f, src[i] * 32768.0f);
+        }
+    }
+    static void toFloat(float* __restrict dest, const int16* __restrict src, int n) {
+        for (int i = 0; i < n; i++) {
+            dest[i] = (float)src[i] * (1.0f / 32768.0f);
+        }
+    }
+};
+
+// Builds v2 frames on the audio thread. Everything is allocated in prepare(),
+// including the per-channel history ring the keyframes are cut from. Zero
+// channels is a worker that doesn't consume audio: the frames only say how
+// long the block was.
+class FrameWriter {
+public:
+    enum { maxMidiBytes = 300 };
+
+    void prepare(int numChannels_, int maxBlockSize_, int history_, int lookahead_) {
+        numChannels = numChannels_;
+        maxBlockSize = maxBlockSize_;
+        history = jmax(0, history_);
+        lookahead = jmax(0, lookahead_);
+        ringSize = history + lookahead + maxBlockSize;
+        ring.setSize(numChannels, ringSize);
+        ring.clear();
+        zeros.allocate((size_t)jmax(maxBlockSize, hostBlockSize), true);
+        message.setSize(getMaxMessageSize(), true);
+        writePos = 0;
+        position = 0;
+        needsKeyframe = true;
+    }
+
+    int getLatencySamples() const { return lookahead; }
+    void requestKeyframe() { needsKeyframe = true; }
+
+    // the biggest frame write() can build, a keyframe with transport and MIDI
+    size_t getMaxMessageSize() const {
+        return FrameHeader::size + TransportInfo::size + BusLayout::size + (size_t)numChannels * ringSize * sizeof(int16) + maxMidiBytes;
+    }
+
+    // Which channels of the process buffer go out: the first `main`, then the
+    // sidechain and aux buses from where the host put them. Channels that
+    // aren't there are sent as zeros. Before prepare(), which takes the total.
+    // hostBlockSize is the most gather() is asked for, before any rate change.
+    void setBuses(int main, int sidechain, int sidechainOffset, int aux, int auxOffset, int hostBlockSize_ = 0) {
+        hostBlockSize = hostBlockSize_;
+        layout.main = (uint16)main;
+        layout.sidechain = (uint16)sidechain;
+        layout.aux = (uint16)aux;
+        channelMap.clear();
+        for (int ch = 0; ch < main; ch++) channelMap.push_back(ch);
+        for (int ch = 0; ch < sidechain; ch++) channelMap.push_back(sidechainOffset + ch);
+        for (int ch = 0; ch < aux; ch++) channelMap.push_back(auxOffset + ch);
+        pointers.assign(channelMap.size(), nullptr);
+    }
+
+    // audio thread: the channels this writer sends, in order, as a view on
+    // numSamples of the host's buffer from startSample. Nothing is copied.
+    // numSamples is at most what setBuses() and prepare() were given
+    const AudioBuffer<float>& gather(const AudioBuffer<float>& buffer, int startSample, int numSamples) {
+        jassert(numSamples <= jmax(maxBlockSize, hostBlockSize));
+        if (layout.sidechain == 0 && layout.aux == 0 && startSample == 0) return buffer;
+        for (size_t i = 0; i < channelMap.size(); i++) {
+            auto ch = channelMap[i];
+            pointers[i] = ch < buffer.getNumChannels() ? const_cast<float*>(buffer.getReadPointer(ch, startSample)) : zeros.get();
+        }
+        view.setDataToReferTo(pointers.data(), (int)pointers.size(), numSamples);
+        return view;
+    }
+
+    // blocks peaking at or under this go out as silent frames, negative is never
+    void setSilenceThreshold(float gain) { silenceThreshold = gain; }
+
+    // max-abs over every channel, stops at the first one that's too loud
+    static bool isSilent(const AudioBuffer<float>& buffer, int channels, int numSamples, float threshold) {
+        for (int ch = 0; ch < channels; ch++) {
+            auto range = FloatVectorOperations::findMinAndMax(buffer.getReadPointer(ch), numSamples);
+            if (jmax(-range.getStart(), range.getEnd()) > threshold) return false;
+        }
+        return true;
+    }
+
+    // returns the message to send for this block, transport is left off when null
+    FrameRef write(const AudioBuffer<float>& buffer, const MidiBuffer& midi, int channels, int numSamples, uint32 seq,
+                             const TransportInfo* transport = nullptr) {
+        // callers split bigger blocks, nothing is reallocated here
+        jassert(numSamples <= maxBlockSize);
+        numSamples = jmin(numSamples, maxBlockSize);
+        channels = jmin(channels, numChannels);
+        auto silentBlock = numChannels > 0 && silenceThreshold >= 0.0f && !needsKeyframe
+                        && isSilent(buffer, channels, numSamples, silenceThreshold);
+        for (int ch = 0; ch < channels; ch++) {
+            // the ring still has to move on so the next keyframe is right
+            if (silentBlock) clearRing(ch, numSamples);
+            else writeRing(ch, buffer.getReadPointer(ch), numSamples);
+        }
+        for (int ch = channels; ch < numChannels; ch++) {
+            clearRing(ch, numSamples);
+        }
+        writePos = (writePos + numSamples) % ringSize;
+        position += numSamples;
+
+        FrameHeader header;
+        header.seq = seq;
+        header.channels = (uint16)numChannels;
+        header.history = (uint32)history;
+        header.current = (uint32)numSamples;
+        header.lookahead = (uint32)lookahead;
+        auto keyframe = needsKeyframe;
+        needsKeyframe = false;
+        auto count = keyframe ? history + lookahead + numSamples : numSamples;
+        header.flags = keyframe ? FrameHeader::keyframe : 0;
+        header.samples = numChannels > 0 && !silentBlock ? (uint32)count : 0;
+        header.windowOffset = position - count;
+        if (silentBlock) header.flags |= FrameHeader::silent;
+        if (transport != nullptr) {
+            header.flags |= FrameHeader::transportInfo;
+            header.transport = *transport;
+        }
+        if (layout.sidechain > 0 || layout.aux > 0) {
+            header.flags |= FrameHeader::buses;
+            header.layout = layout;
+        }
+
+        auto dest = (uint8*)message.getData() + header.getHeaderBytes();
+        auto samples = (int16*)dest;
+        for (int ch = 0; ch < numChannels && header.samples > 0; ch++) {
+            readRing(ch, samples + (size_t)ch * count, count);
+        }
+        auto midiDest = dest + (size_t)numChannels * header.samples * sizeof(int16);
+        header.midiBytes = (uint32)packMidi(midi, midiDest);
+        header.write((uint8*)message.getData());
+        return { message.getData(), header.getHeaderBytes() + header.getPayloadBytes() };
+    }
+
+    // MIDI as 3-byte short messages, the same as the reply trailer
+    static int packMidi(const MidiBuffer& midi, uint8* dest) {
+        int bytes = 0;
+        for (const auto metadata : midi) {
+            if (metadata.numBytes > 3 || bytes + 3 > maxMidiBytes) continue;
+            zeromem(dest + bytes, 3);
+            memcpy(dest + bytes, metadata.data, (size_t)metadata.numBytes);
+            bytes += 3;
+        }
+        return bytes;
+    }
+
+private:
+    void writeRing(int ch, const float* src, int n) {
+        auto first = jmin(n, ringSize - writePos);
+        FloatVectorOperations::copy(ring.getWritePointer(ch, writePos), src, first);
+        FloatVectorOperations::copy(ring.getWritePointer(ch), src + first, n - first);
+    }
+
+    void clearRing(int ch, int n) {
+        auto first = jmin(n, ringSize - writePos);
+        FloatVectorOperations::clear(ring.getWritePointer(ch, writePos), first);
+        FloatVectorOperations::clear(ring.getWritePointer(ch), n - first);
+    }
+
+    // the newest n samples, writePos has already moved past them
+    void readRing(int ch, int16* dest, int n) {
+        auto start = (writePos - n + ringSize) % ringSize;
+        auto first = jmin(n, ringSize - start);
+        SampleConversion::toInt16(dest, ring.getReadPointer(ch, start), first);
+        SampleConversion::toInt16(dest + first, ring.getReadPointer(ch), n - first);
+    }
+
+    int numChannels = 0, maxBlockSize = 0, hostBlockSize = 0, history = 0, lookahead = 0, ringSize = 0;
+    int writePos = 0;
+    int64 position = 0;
+    bool needsKeyframe = true;
+    float silenceThreshold = -1.0f;
+    AudioBuffer<float> ring;
+    MemoryBlock message;
+    BusLayout layout;
+    std::vector<int> channelMap;
+    std::vector<float*> pointers;
+    HeapBlock<float> zeros;
+    AudioBuffer<float> view;
+};
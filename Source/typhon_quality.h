@@ -0,0 +1,228 @@
+#pragma once
+
+// Quality control. On a busy machine blocks don't go late once, they go late
+// one after another. This keeps an eye on how long each callback takes
+// against the block it renders, how long the worker takes to answer and how
+// many blocks found a reply they were counting on late (a worker that isn't
+// meant to answer never is), and when that stays bad steps down
+// through the levels in the "qualityLevels" state property, e.g.
+//   worker|polyphony:4|model,convolution|native
+// Level n is everything up to and including the nth part:
+//   worker       the worker's next level of its own (worker:N for that one)
+//   polyphony:N  at most N synth voices
+//   chain, model, convolution
+//                skip that native stage
+//   native       stop sending to the worker, native processing only
+// It steps down after two seconds of overload: 2% of blocks unanswered,
+// callbacks using 75% of the block, or replies averaging more than a block.
+// It steps back up after six seconds of headroom: nothing unanswered, under
+// 40%, replies inside half a block. A level it has to leave again soon after
+// coming back waits twice as long before the next try, up to a minute.
+//
+// A worker says what it can do with less in its HELO, one key per level, each
+// a comma list of settings to use in place of the ones it gave:
+//   HELO proto=2;quantum=512;level1=quantum:1024;level2=rate:16000,quantum:1024
+// It's sent "QUAL <n>" before the change, and the first frame after it is a
+// keyframe. Lookahead, rate or quanta that change the latency are reported to
+// the host again.
+
+// A Synthesiser whose polyphony can be turned down while it plays: past the
+// limit a new note takes over a sounding voice instead of a free one.
+class LimitedSynthesiser : public Synthesiser {
+public:
+    // 0 is every voice
+    void setVoiceLimit(int limit) { voiceLimit = limit; }
+
+protected:
+    SynthesiserVoice* findFreeVoice(SynthesiserSound* sound, int midiChannel, int midiNoteNumber, bool stealIfNoneAvailable) const override {
+        auto limit = voiceLimit.load();
+        if (limit <= 0) return Synthesiser::findFreeVoice(sound, midiChannel, midiNoteNumber, stealIfNoneAvailable);
+        int active = 0;
+        for (auto* voice : voices) {
+            if (voice->isVoiceActive()) active++;
+        }
+        if (active < limit) return Synthesiser::findFreeVoice(sound, midiChannel, midiNoteNumber, stealIfNoneAvailable);
+        if (!stealIfNoneAvailable) return nullptr;
+        // not findVoiceToSteal, that expects every voice to be sounding
+        SynthesiserVoice* oldest = nullptr;
+        for (auto* voice : voices) {
+            if (voice->isVoiceActive() && voice->canPlaySound(sound)
+                && (oldest == nullptr || voice->wasStartedBefore(*oldest))) {
+                oldest = voice;
+            }
+        }
+        return oldest;
+    }
+
+private:
+    std::atomic<int> voiceLimit{ 0 };
+};
+
+class QualityController : private Timer {
+public:
+    enum Stage { chainStage = 1, modelStage = 2, convolutionStage = 4 };
+    enum { tickMs = 250, windowTicks = 8, upTicks = 24, maxUpTicks = 240 };
+
+    // what a level turns down, level 0 is nothing
+    struct Level {
+        int workerLevel = 0;
+        int polyphony = 0;   // 0 is every voice
+        int bypass = 0;      // Stage bits
+        bool nativeOnly = false;
+    };
+
+    // message thread: a level was chosen, make it so
+    std::function<void(const Level&)> onChange;
+    // message thread: the worker's mean round trip since last asked, ms, negative if none
+    std::function<double()> takeRoundTripMs;
+
+    QualityController() {
+        levels.resize(1);
+    }
+
+    ~QualityController() override {
+        stopTimer();
+    }
+
+    // message thread: the spec above; an empty one keeps everything at full quality
+    void setLevels(const String& spec) {
+        std::vector<Level> parsed(1);
+        Level level;
+        for (auto& part : StringArray::fromTokens(spec, "|", "")) {
+            if (part.trim().isEmpty()) continue;
+            for (auto& token : StringArray::fromTokens(part, ",", "")) {
+                auto name = token.upToFirstOccurrenceOf(":", false, false).trim();
+                auto value = token.fromFirstOccurrenceOf(":", false, false).trim();
+                if (name == "worker") level.workerLevel = value.isEmpty() ? level.workerLevel + 1 : value.getIntValue();
+                else if (name == "polyphony") level.polyphony = jmax(1, value.getIntValue());
+                else if (name == "chain") level.bypass |= chainStage;
+                else if (name == "model") level.bypass |= modelStage;
+                else if (name == "convolution") level.bypass |= convolutionStage;
+                else if (name == "native") level.nativeOnly = true;
+            }
+            parsed.push_back(level);
+        }
+        levels = std::move(parsed);
+        setLevel(jmin(current.load(), getNumLevels()));
+    }
+
+    // message thread
+    void prepare(double sampleRate_) {
+        sampleRate = sampleRate_;
+        filled = 0;
+        startTimer(tickMs);
+    }
+
+    // audio thread, once per block: how long it took, and whether the
+    // worker was sent it and had nothing to give back
+    void blockDone(int64 ticks, int numSamples, bool sentToWorker, bool unanswered) {
+        busyMicros += (int64)(Time::highResolutionTicksToSeconds(ticks) * 1.0e6);
+        blockMicros += (int64)(numSamples * 1.0e6 / jmax(1.0, sampleRate));
+        blocks++;
+        if (sentToWorker) workerBlocks++;
+        if (unanswered) misses++;
+    }
+
+    // audio thread
+    int getBypass() const { return bypass.load(); }
+    bool isNativeOnly() const { return nativeOnly.load(); }
+
+    int getLevel() const { return current.load(); }
+    int getNumLevels() const { return (int)levels.size() - 1; }
+    // callback time over block time, last tick
+    float getLoad() const { return load.load(); }
+
+private:
+    struct Tick {
+        int64 busyMicros = 0, blockMicros = 0;
+        uint32 blocks = 0, workerBlocks = 0, misses = 0;
+        double roundTripMs = -1.0;
+    };
+
+    void setLevel(int level) {
+        current = level;
+        const auto& chosen = levels[(size_t)level];
+        bypass = chosen.bypass;
+        nativeOnly = chosen.nativeOnly;
+        // everything measured so far was at the old level
+        filled = 0;
+        headroomTicks = 0;
+        if (onChange) onChange(chosen);
+    }
+
+    void timerCallback() override {
+        Tick tick;
+        tick.busyMicros = busyMicros.exchange(0);
+        tick.blockMicros = blockMicros.exchange(0);
+        tick.blocks = blocks.exchange(0);
+        tick.workerBlocks = workerBlocks.exchange(0);
+        tick.misses = misses.exchange(0);
+        tick.roundTripMs = takeRoundTripMs ? takeRoundTripMs() : -1.0;
+        if (tick.blocks == 0) return; // the host isn't calling, nothing to go on
+        load = (float)((double)tick.busyMicros / (double)jmax((int64)1, tick.blockMicros));
+
+        window[next] = tick;
+        next = (next + 1) % windowTicks;
+        filled = jmin(filled + 1, (int)windowTicks);
+        sinceChange++;
+        if (getNumLevels() == 0 || filled < windowTicks) return;
+
+        Tick sum;
+        double roundTrips = 0.0;
+        int withRoundTrips = 0;
+        for (auto& t : window) {
+            sum.busyMicros += t.busyMicros;
+            sum.blockMicros += t.blockMicros;
+            sum.blocks += t.blocks;
+            sum.workerBlocks += t.workerBlocks;
+            sum.misses += t.misses;
+            if (t.roundTripMs >= 0.0) {
+                roundTrips += t.roundTripMs;
+                withRoundTrips++;
+            }
+        }
+        auto meanLoad = (double)sum.busyMicros / (double)jmax((int64)1, sum.blockMicros);
+        auto missRate = sum.workerBlocks > 0 ? (double)sum.misses / sum.workerBlocks : 0.0;
+        auto blockMs = (double)sum.blockMicros / 1000.0 / jmax(1u, sum.blocks);
+        auto roundTrip = withRoundTrips > 0 ? roundTrips / withRoundTrips : -1.0;
+
+        auto overloaded = missRate > 0.02 || meanLoad > 0.75 || roundTrip > blockMs;
+        auto headroom = sum.misses == 0 && meanLoad < 0.4 && roundTrip < 0.5 * blockMs;
+
+        auto level = current.load();
+        if (overloaded && level < getNumLevels()) {
+            // straight back down after coming up: wait longer next time
+            if (cameUp && sinceChange < 2 * upHold) upHold = jmin(upHold * 2, (int)maxUpTicks);
+            cameUp = false;
+            sinceChange = 0;
+            setLevel(level + 1);
+            return;
+        }
+        headroomTicks = headroom ? headroomTicks + 1 : 0;
+        // a way back up that held has earned the short wait again
+        if (cameUp && sinceChange > 2 * upHold) upHold = upTicks;
+        if (headroomTicks >= upHold && level > 0) {
+            cameUp = true;
+            sinceChange = 0;
+            setLevel(level - 1);
+        }
+    }
+
+    std::vector<Level> levels;
+    double sampleRate = 44100.0;
+    std::atomic<int> current{ 0 }, bypass{ 0 };
+    std::atomic<bool> nativeOnly{ false };
+    std::atomic<float> load{ 0.0f };
+
+    // audio thread in, timer out
+    std::atomic<int64> busyMicros{ 0 }, blockMicros{ 0 };
+    std::atomic<uint32> blocks{ 0 }, workerBlocks{ 0 }, misses{ 0 };
+
+    // timer only
+    Tick window[windowTicks];
+    int next = 0, filled = 0, headroomTicks = 0, sinceChange = 0;
+    int upHold = upTicks;
+    bool cameUp = false;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(QualityController)
+};
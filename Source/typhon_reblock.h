@@ -0,0 +1,156 @@
+#pragma once
+
+// Fixed quanta. Hosts change their buffer size and may call process with
+// anything up to it; a worker that wants the same shape every time asks for
+//   HELO proto=2;quantum=480
+// and every audio frame is then exactly 480 samples (at the worker's rate if
+// it asked for one), however the host blocks fall. Blocks that don't finish
+// a quantum send nothing; their MIDI waits for the next frame. Each reply
+// has to carry the seq of the frame it answers: it's written back at that
+// quantum's place on a fixed delay of quantum + one host block, so a reply
+// that's a little late in one block is still on time. One that's later than
+// that is dropped and the gap is silence.
+
+class Reblocker {
+public:
+    enum { maxQuantaInFlight = 64 };
+
+    static int getLatencyFor(int quantum, int maxBlockSize) {
+        return quantum + maxBlockSize;
+    }
+
+    // numChannels is what comes back; more can go out (sidechain, aux)
+    void prepare(int numChannels_, int quantum_, int maxBlockSize_, int numInputChannels = -1) {
+        numChannels = numChannels_;
+        quantum = jmax(1, quantum_);
+        maxBlockSize = maxBlockSize_;
+        latency = getLatencyFor(quantum, maxBlockSize);
+
+        input.setSize(numInputChannels < 0 ? numChannels : numInputChannels, quantum);
+        input.clear();
+        fill = 0;
+        pendingMidi.clear();
+        pendingMidi.ensureSize(FrameWriter::maxMidiBytes * 4);
+
+        replies.allocate((size_t)(maxQuantaInFlight * numChannels * quantum), true);
+        replySeqs.allocate((size_t)maxQuantaInFlight, true);
+        replyFifo.setTotalSize(maxQuantaInFlight);
+
+        outputSize = nextPowerOfTwo(latency + 2 * quantum + maxBlockSize);
+        output.setSize(numChannels, outputSize);
+        output.clear();
+        readIndex = 0;
+        quantaSent = 0;
+        pulled.allocate((size_t)(numChannels * maxBlockSize), true);
+    }
+
+    int getQuantum() const { return quantum; }
+    int getLatencySamples() const { return latency; }
+
+    // audio thread: adds the block and calls send(quantum, midi, seq) for every
+    // quantum it completes. seq is whatever the caller numbers its frames with.
+    template <typename Send>
+    void push(const AudioBuffer<float>& block, const MidiBuffer& midi, int channels, int numSamples, uint32& seq, Send&& send) {
+        channels = jmin(channels, input.getNumChannels());
+        // the MIDI goes with the samples it came with, at their place in the
+        // quantum, so blocks that share a quantum keep their order
+        if (numSamples <= 0) pendingMidi.addEvents(midi, 0, -1, fill);
+        int done = 0;
+        while (done < numSamples) {
+            auto n = jmin(numSamples - done, quantum - fill);
+            pendingMidi.addEvents(midi, done, done + n < numSamples ? n : -1, fill - done);
+            for (int ch = 0; ch < channels; ch++) {
+                input.copyFrom(ch, fill, block, ch, done, n);
+            }
+            fill += n;
+            done += n;
+            if (fill < quantum) break;
+
+            if (quantaSent == 0) firstSeq = seq;
+            quantaSent++;
+            send(input, pendingMidi, seq++);
+            pendingMidi.clear();
+            fill = 0;
+        }
+    }
+
+    // message thread: one reply, planar int16 or float32. Dropped if the audio
+    // thread is that far behind.
+    void receive(uint32 seq, const uint8* src, bool isFloat, int channels, int samples) {
+        int start1, size1, start2, size2;
+        replyFifo.prepareToWrite(1, start1, size1, start2, size2);
+        if (size1 == 0) return;
+        auto dest = replies.get() + (size_t)start1 * numChannels * quantum;
+        auto n = jmin(samples, quantum);
+        for (int ch = 0; ch < numChannels; ch++) {
+            auto d = dest + (size_t)ch * quantum;
+            auto copied = ch < channels ? n : 0;
+            if (copied > 0) {
+                if (isFloat) memcpy(d, (const float*)src + (size_t)ch * samples, (size_t)copied * sizeof(float));
+                else SampleConversion::toFloat(d, (const int16*)src + (size_t)ch * samples, copied);
+            }
+            if (copied < quantum) FloatVectorOperations::clear(d + copied, quantum - copied);
+        }
+        replySeqs[start1] = seq;
+        replyFifo.finishedWrite(1);
+    }
+
+    // audio thread: the next numSamples of output, planar with a stride of
+    // numSamples
+    const float* pull(int numSamples) {
+        int start1, size1, start2, size2;
+        replyFifo.prepareToRead(replyFifo.getNumReady(), start1, size1, start2, size2);
+        for (int i = 0; i < size1; i++) place(start1 + i);
+        for (int i = 0; i < size2; i++) place(start2 + i);
+        replyFifo.finishedRead(size1 + size2);
+
+        numSamples = jmin(numSamples, maxBlockSize);
+        auto mask = outputSize - 1;
+        for (int ch = 0; ch < numChannels; ch++) {
+            auto ring = output.getWritePointer(ch);
+            auto dest = pulled.get() + (size_t)ch * numSamples;
+            for (int i = 0; i < numSamples; i++) {
+                auto index = (int)((readIndex + (uint64)i) & (uint64)mask);
+                dest[i] = ring[index];
+                ring[index] = 0.0f;
+            }
+        }
+        readIndex += (uint64)numSamples;
+        return pulled.get();
+    }
+
+private:
+    // a reply goes at its quantum's place plus the latency, if that's still to come
+    void place(int slot) {
+        auto k = (int32)(replySeqs[slot] - firstSeq);
+        if (k < 0 || (uint64)k >= quantaSent) return;
+        auto start = (uint64)k * (uint64)quantum + (uint64)latency;
+        if (start + (uint64)quantum <= readIndex || start + (uint64)quantum > readIndex + (uint64)outputSize) return;
+        auto src = replies.get() + (size_t)slot * numChannels * quantum;
+        auto mask = (uint64)(outputSize - 1);
+        for (int ch = 0; ch < numChannels; ch++) {
+            auto ring = output.getWritePointer(ch);
+            for (int i = 0; i < quantum; i++) {
+                auto at = start + (uint64)i;
+                // the part that's already been played is gone
+                if (at >= readIndex) ring[(int)(at & mask)] = src[(size_t)ch * quantum + i];
+            }
+        }
+    }
+
+    int numChannels = 0, quantum = 1, maxBlockSize = 0, latency = 0;
+    AudioBuffer<float> input;
+    int fill = 0;
+    MidiBuffer pendingMidi;
+    uint32 firstSeq = 0;
+    uint64 quantaSent = 0;
+
+    HeapBlock<float> replies;
+    HeapBlock<uint32> replySeqs;
+    AbstractFifo replyFifo{ maxQuantaInFlight };
+
+    AudioBuffer<float> output;
+    int outputSize = 0;
+    uint64 readIndex = 0;
+    HeapBlock<float> pulled;
+};
@@ -0,0 +1,216 @@
+#pragma once
+
+// Worker sample rate. A model trained at one rate shouldn't have to resample
+// every block in Python:
+//   HELO proto=2;rate=16000
+// Audio frames then go out at 16 kHz and the replies are expected at 16 kHz
+// too; the plugin converts on both sides. history/lookahead/current are in
+// the worker's samples, and `current` goes up and down by one as the
+// fractional positions come out. The reply is put back on the host's clock
+// through a small FIFO, so the latency reported to the host is both filters
+// plus a couple of samples of slack. Only the audio transport converts;
+// spectrum and features frames stay at the host rate.
+
+// One direction, any ratio: Kaiser-windowed sinc read from a table with
+// `phases` entries per input sample and interpolated in between.
+class Resampler {
+public:
+    enum { zeroCrossings = 16, phases = 256 };
+
+    // how many input samples either side of an output the filter reaches
+    static double getHalfWidth(double inRate, double outRate) {
+        return zeroCrossings / (2.0 * getCutoff(inRate, outRate));
+    }
+
+    void prepare(int numChannels_, double inRate, double outRate, int maxInputBlock) {
+        numChannels = numChannels_;
+        step = inRate / outRate;
+        auto cutoff = getCutoff(inRate, outRate);
+        halfWidth = getHalfWidth(inRate, outRate);
+
+        tableSize = (int)std::ceil(halfWidth * phases) + 2;
+        table.allocate((size_t)tableSize, true);
+        const double beta = 8.0;
+        auto norm = 1.0 / bessel0(beta);
+        for (int i = 0; i < tableSize; i++) {
+            auto t = (double)i / phases;
+            auto x = 2.0 * cutoff * t;
+            auto sinc = x == 0.0 ? 1.0 : std::sin(MathConstants<double>::pi * x) / (MathConstants<double>::pi * x);
+            auto r = t / halfWidth;
+            auto window = r < 1.0 ? bessel0(beta * std::sqrt(1.0 - r * r)) * norm : 0.0;
+            table[i] = (float)(2.0 * cutoff * sinc * window);
+        }
+
+        // zeros in front so the first output has a full filter's worth behind it
+        lead = (int)std::ceil(halfWidth) + 1;
+        historySize = 2 * lead + maxInputBlock + 4;
+        history.setSize(numChannels, historySize);
+        history.clear();
+        count = lead;
+        position = lead;
+    }
+
+    int getMaxOutput(int numInput) const {
+        return (int)std::ceil(numInput / step) + 2;
+    }
+
+    // audio thread: everything `input` makes possible, returns how many samples
+    int process(const float* const* input, int numInput, float* const* output) {
+        for (int ch = 0; ch < numChannels; ch++) {
+            FloatVectorOperations::copy(history.getWritePointer(ch, count), input[ch], numInput);
+        }
+        count += numInput;
+
+        int produced = 0;
+        while (position + halfWidth <= count - 1) {
+            auto first = jmax(0, (int)std::ceil(position - halfWidth));
+            auto last = jmin(count - 1, (int)std::floor(position + halfWidth));
+            for (int ch = 0; ch < numChannels; ch++) {
+                auto x = history.getReadPointer(ch);
+                float sum = 0.0f;
+                for (int i = first; i <= last; i++) {
+                    sum += x[i] * lookup(std::abs(position - i));
+                }
+                output[ch][produced] = sum;
+            }
+            produced++;
+            position += step;
+        }
+
+        // keep just what the next output still needs
+        auto drop = (int)std::floor(position - halfWidth) - 1;
+        if (drop > 0) {
+            for (int ch = 0; ch < numChannels; ch++) {
+                auto x = history.getWritePointer(ch);
+                memmove(x, x + drop, (size_t)(count - drop) * sizeof(float));
+            }
+            count -= drop;
+            position -= drop;
+        }
+        return produced;
+    }
+
+private:
+    // cycles per input sample, a little under the lower Nyquist
+    static double getCutoff(double inRate, double outRate) {
+        return 0.5 * 0.95 * jmin(1.0, outRate / inRate);
+    }
+
+    static double bessel0(double x) {
+        double sum = 1.0, term = 1.0;
+        for (int k = 1; k < 32; k++) {
+            term *= (x / (2.0 * k)) * (x / (2.0 * k));
+            sum += term;
+        }
+        return sum;
+    }
+
+    float lookup(double t) const {
+        auto index = t * phases;
+        auto i = (int)index;
+        if (i >= tableSize - 1) return 0.0f;
+        auto frac = (float)(index - i);
+        return table[i] + frac * (table[i + 1] - table[i]);
+    }
+
+    int numChannels = 0;
+    double step = 1.0, halfWidth = 0.0, position = 0.0;
+    int tableSize = 0, lead = 0, historySize = 0, count = 0;
+    HeapBlock<float> table;
+    AudioBuffer<float> history;
+};
+
+// Both sides of the transport: host blocks down to the worker's rate, replies
+// back up and out of a FIFO one host block at a time.
+class RateConverter {
+public:
+    static int getLatencyFor(double hostRate, double workerRate) {
+        auto ratio = hostRate / workerRate;
+        return (int)std::ceil(Resampler::getHalfWidth(hostRate, workerRate)
+                              + Resampler::getHalfWidth(workerRate, hostRate) * ratio
+                              + 2.0 * ratio) + 1;
+    }
+
+    // the most one host block can turn into
+    static int getWorkerBlockFor(int maxBlockSize, double hostRate, double workerRate) {
+        return (int)std::ceil(maxBlockSize * workerRate / hostRate) + 2;
+    }
+
+    // numChannels is what comes back; more can go out (sidechain, aux)
+    void prepare(int numChannels_, int maxBlockSize, double hostRate, double workerRate, int numInputChannels_ = -1) {
+        numChannels = numChannels_;
+        numInputChannels = numInputChannels_ < 0 ? numChannels : numInputChannels_;
+        down.prepare(numInputChannels, hostRate, workerRate, maxBlockSize);
+        maxWorkerBlock = getWorkerBlockFor(maxBlockSize, hostRate, workerRate);
+        up.prepare(numChannels, workerRate, hostRate, maxWorkerBlock);
+
+        toWorkerBuffer.setSize(numInputChannels, maxWorkerBlock);
+        zeros.allocate((size_t)maxBlockSize, true);
+        inputs.assign((size_t)numInputChannels, nullptr);
+        fromWorkerBuffer.setSize(numChannels, maxWorkerBlock);
+        upBuffer.setSize(numChannels, up.getMaxOutput(maxWorkerBlock));
+
+        latency = getLatencyFor(hostRate, workerRate);
+        outputSize = latency + upBuffer.getNumSamples() + 2 * maxBlockSize;
+        output.setSize(numChannels, outputSize);
+        output.clear();
+        readPos = 0;
+        // the slack is there from the start, so the first replies line up
+        available = latency;
+        sent = 0;
+    }
+
+    int getLatencySamples() const { return latency; }
+    int getMaxWorkerBlock() const { return maxWorkerBlock; }
+
+    // audio thread: this host block at the worker's rate, getNumSent() samples of it
+    const AudioBuffer<float>& toWorker(const AudioBuffer<float>& buffer, int channels, int numSamples) {
+        for (int ch = 0; ch < numInputChannels; ch++) {
+            inputs[(size_t)ch] = ch < channels ? buffer.getReadPointer(ch) : zeros.get();
+        }
+        sent = down.process(inputs.data(), numSamples, toWorkerBuffer.getArrayOfWritePointers());
+        return toWorkerBuffer;
+    }
+
+    int getNumSent() const { return sent; }
+
+    // audio thread: the reply (planar, replySamples per channel, nullptr for
+    // silence) at the host's rate, numSamples of it. Only as many samples as
+    // went out this block are taken, so the clock can't drift.
+    void fromWorker(const float* reply, int replySamples, AudioBuffer<float>& buffer, int channels, int numSamples) {
+        auto taken = reply != nullptr ? jmin(replySamples, sent) : 0;
+        for (int ch = 0; ch < numChannels; ch++) {
+            auto dest = fromWorkerBuffer.getWritePointer(ch);
+            if (taken > 0) FloatVectorOperations::copy(dest, reply + (size_t)ch * replySamples, taken);
+            if (taken < sent) FloatVectorOperations::clear(dest + taken, sent - taken);
+        }
+        auto produced = up.process(fromWorkerBuffer.getArrayOfReadPointers(), sent, upBuffer.getArrayOfWritePointers());
+        produced = jmin(produced, outputSize - available);
+        for (int ch = 0; ch < numChannels; ch++) {
+            auto writePos = (readPos + available) % outputSize;
+            auto first = jmin(produced, outputSize - writePos);
+            output.copyFrom(ch, writePos, upBuffer, ch, 0, first);
+            output.copyFrom(ch, 0, upBuffer, ch, first, produced - first);
+        }
+        available += produced;
+
+        auto n = jmin(numSamples, available);
+        channels = jmin(channels, numChannels);
+        for (int ch = 0; ch < channels; ch++) {
+            auto first = jmin(n, outputSize - readPos);
+            buffer.copyFrom(ch, 0, output, ch, readPos, first);
+            buffer.copyFrom(ch, first, output, ch, 0, n - first);
+            if (n < numSamples) buffer.clear(ch, n, numSamples - n);
+        }
+        readPos = (readPos + n) % outputSize;
+        available -= n;
+    }
+
+private:
+    int numChannels = 0, numInputChannels = 0, maxWorkerBlock = 0, latency = 0, sent = 0;
+    Resampler down, up;
+    AudioBuffer<float> toWorkerBuffer, fromWorkerBuffer, upBuffer, output;
+    HeapBlock<float> zeros;
+    std::vector<const float*> inputs;
+    int outputSize = 0, readPos = 0, available = 0;
+};
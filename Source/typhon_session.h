@@ -0,0 +1,62 @@
+#pragma once
+
+// Resumable sessions. A v2 worker that names itself in its HELO
+//   HELO proto=2;session=reverb-1;resume=2000;resend=32
+// can drop the socket and come back within `resume` ms (default 2000) to find
+// the plugin as it left it: same rings, same sequence numbers, no keyframe. The
+// plugin answers the second HELO with
+//   RSUM session=reverb-1;acked=<seq>
+// then sends every frame after `acked` that it still has (the last `resend`
+// frames, default 32, including those built while the worker was away) and
+// carries on. A reply's seq acknowledges every frame up to it. If the worker
+// was gone longer than that it gets a keyframe instead and sees the gap in
+// seq. A different session name, or none, starts from scratch.
+//
+// Until the worker is back or the window closes, the block is covered by the
+// last reply played again, fading out by half each block.
+
+// Audio thread only: the last few frames sent, in order, to go again after a resume.
+class ResendBuffer {
+public:
+    ResendBuffer(size_t maxFrameBytes, int length)
+        : capacity(maxFrameBytes), numSlots(jlimit(1, 1024, length)) {
+        frames.allocate((size_t)numSlots * capacity, false);
+        sizes.allocate((size_t)numSlots, true);
+        seqs.allocate((size_t)numSlots, true);
+    }
+
+    void keep(FrameRef message) {
+        FrameHeader header;
+        if (message.getSize() > capacity || !FrameHeader::read(message, header)) return;
+        auto slot = (int)(written++ % (uint64)numSlots);
+        memcpy(frames.get() + (size_t)slot * capacity, message.getData(), message.getSize());
+        sizes[slot] = message.getSize();
+        seqs[slot] = header.seq;
+    }
+
+    // sends everything after `acked`, oldest first. false if some of it has
+    // already been overwritten
+    template <typename Send>
+    bool resendAfter(uint32 acked, Send&& send) {
+        auto count = (int)jmin(written, (uint64)numSlots);
+        auto complete = count == 0 || (int32)(seqs[(int)((written - (uint64)count) % (uint64)numSlots)] - acked) <= 1;
+        for (int i = count; i > 0; i--) {
+            auto slot = (int)((written - (uint64)i) % (uint64)numSlots);
+            if ((int32)(seqs[slot] - acked) <= 0) continue;
+            outgoing.replaceWith(frames.get() + (size_t)slot * capacity, sizes[slot]);
+            send(outgoing);
+        }
+        return complete;
+    }
+
+private:
+    size_t capacity;
+    int numSlots;
+    uint64 written = 0;
+    HeapBlock<uint8> frames;
+    HeapBlock<size_t> sizes;
+    HeapBlock<uint32> seqs;
+    MemoryBlock outgoing;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(ResendBuffer)
+};
@@ -0,0 +1,169 @@
+#pragma once
+
+// Shared-memory frames. A worker on the same machine can take its frames out
+// of a file it maps rather than off the socket:
+//   HELO proto=2;shm=/dev/shm/typhon-1234
+// The socket stays up for the handshake and the text messages (RSUM, VERS..),
+// only the frames go through the file. The worker creates it, all
+// little-endian:
+//
+//   0  "TYSH"
+//   4  u32 format (1)
+//   8  u32 ringBytes     (multiple of 8)
+//  12  reserved to 64
+//  64  ring to the worker, then ring from the worker, each
+//        0  u64 head  (bytes ever written, the producer's)
+//       64  u64 tail  (bytes ever read, the consumer's)
+//      128  ringBytes of records
+//
+// A record is u32 size then the message as it would have gone on the socket,
+// padded to 8. A record never wraps: when it won't fit before the end the
+// producer writes a size of 0xffffffff there and starts again at 0. Nothing
+// blocks; a frame that doesn't fit is dropped and the next one is a keyframe.
+// Both sides poll, spinning for `shmspin` microseconds (default 200) after
+// the last message before sleeping a millisecond at a time.
+
+class SharedMemoryLink : private juce::Thread, private juce::AsyncUpdater {
+public:
+    using Deliver = std::function<void(const MemoryBlock&)>;
+    enum { headerBytes = 64, controlBytes = 128, format = 1, wrapMarker = -1 };
+
+    // null if the file isn't there, isn't ours or can't hold a frame this big
+    static std::unique_ptr<SharedMemoryLink> open(const File& file, size_t maxFrameBytes, int spinMicros, Deliver deliver) {
+        auto map = std::make_unique<MemoryMappedFile>(file, MemoryMappedFile::readWrite, false);
+        if (map->getData() == nullptr || map->getSize() < (size_t)headerBytes) return nullptr;
+        auto base = (uint8*)map->getData();
+        uint32 fileFormat, ringBytes;
+        memcpy(&fileFormat, base + 4, 4);
+        memcpy(&ringBytes, base + 8, 4);
+        fileFormat = ByteOrder::swapIfBigEndian(fileFormat);
+        ringBytes = ByteOrder::swapIfBigEndian(ringBytes);
+        if (memcmp(base, "TYSH", 4) != 0 || fileFormat != format || (ringBytes & 7) != 0
+            || map->getSize() < (size_t)headerBytes + 2 * ((size_t)controlBytes + ringBytes)
+            || (size_t)ringBytes < 2 * (maxFrameBytes + 8)) {
+            DBG("Not a usable shared memory file " << file.getFullPathName());
+            return nullptr;
+        }
+        return std::unique_ptr<SharedMemoryLink>(new SharedMemoryLink(std::move(map), ringBytes, maxFrameBytes, spinMicros, std::move(deliver)));
+    }
+
+    ~SharedMemoryLink() override {
+        close();
+    }
+
+    // message thread: no more deliveries after this, though push() still works
+    void close() {
+        stopThread(1000);
+        cancelPendingUpdate();
+    }
+
+    // audio thread: false if there wasn't room
+    bool push(FrameRef message) {
+        auto& ring = toWorker;
+        auto size = (uint32)message.getSize();
+        auto bytes = recordBytes(size);
+        auto head = ring.head->load(std::memory_order_relaxed);
+        auto at = (uint32)(head % ring.capacity);
+        auto skip = at + bytes > ring.capacity ? ring.capacity - at : 0;
+        if (head + skip + bytes - ring.tail->load(std::memory_order_acquire) > ring.capacity) {
+            dropped++;
+            return false;
+        }
+        if (skip > 0) {
+            putSize(ring.data + at, (uint32)wrapMarker);
+            at = 0;
+        }
+        putSize(ring.data + at, size);
+        memcpy(ring.data + at + 4, message.getData(), size);
+        ring.head->store(head + skip + bytes, std::memory_order_release);
+        return true;
+    }
+
+    uint32 getNumDropped() const { return dropped.load(); }
+
+private:
+    struct Ring {
+        std::atomic<uint64>* head;
+        std::atomic<uint64>* tail;
+        uint8* data;
+        uint32 capacity;
+    };
+
+    SharedMemoryLink(std::unique_ptr<MemoryMappedFile> map_, uint32 ringBytes, size_t maxFrameBytes, int spinMicros_, Deliver deliver_)
+        : Thread("typhon shm"), map(std::move(map_)), spinMicros(jmax(0, spinMicros_)), deliver(std::move(deliver_)) {
+        static_assert(std::atomic<uint64>::is_always_lock_free, "the rings are shared with another process");
+        auto base = (uint8*)map->getData() + headerBytes;
+        toWorker = ringAt(base, ringBytes);
+        fromWorker = ringAt(base + controlBytes + ringBytes, ringBytes);
+        incoming.ensureSize(maxFrameBytes);
+        startThread();
+    }
+
+    static Ring ringAt(uint8* at, uint32 capacity) {
+        return { reinterpret_cast<std::atomic<uint64>*>(at), reinterpret_cast<std::atomic<uint64>*>(at + 64), at + controlBytes, capacity };
+    }
+
+    static uint32 recordBytes(uint32 size) { return (4 + size + 7) & ~(uint32)7; }
+
+    static void putSize(uint8* dest, uint32 size) {
+        size = ByteOrder::swapIfBigEndian(size);
+        memcpy(dest, &size, 4);
+    }
+
+    // watches for replies, the message thread picks them up like socket messages
+    void run() override {
+        auto lastSeen = Time::getHighResolutionTicks();
+        while (!threadShouldExit()) {
+            if (!posted.load(std::memory_order_acquire)
+                && fromWorker.head->load(std::memory_order_acquire) != fromWorker.tail->load(std::memory_order_relaxed)) {
+                posted = true;
+                triggerAsyncUpdate();
+                lastSeen = Time::getHighResolutionTicks();
+                continue;
+            }
+            if (Time::highResolutionTicksToSeconds(Time::getHighResolutionTicks() - lastSeen) * 1.0e6 < spinMicros) {
+                Thread::yield();
+            } else {
+                wait(1);
+            }
+        }
+    }
+
+    void handleAsyncUpdate() override {
+        auto& ring = fromWorker;
+        auto head = ring.head->load(std::memory_order_acquire);
+        auto tail = ring.tail->load(std::memory_order_relaxed);
+        while (tail != head) {
+            auto at = (uint32)(tail % ring.capacity);
+            uint32 size;
+            memcpy(&size, ring.data + at, 4);
+            size = ByteOrder::swapIfBigEndian(size);
+            if (size == (uint32)wrapMarker) {
+                tail += ring.capacity - at;
+                continue;
+            }
+            if (at + recordBytes(size) > ring.capacity) {
+                // the worker wrote something it shouldn't have, drop the lot
+                jassertfalse;
+                tail = head;
+                break;
+            }
+            incoming.replaceWith(ring.data + at + 4, size);
+            tail += recordBytes(size);
+            ring.tail->store(tail, std::memory_order_release);
+            deliver(incoming);
+        }
+        ring.tail->store(tail, std::memory_order_release);
+        posted = false;
+    }
+
+    std::unique_ptr<MemoryMappedFile> map;
+    Ring toWorker, fromWorker;
+    int spinMicros;
+    Deliver deliver;
+    MemoryBlock incoming;
+    std::atomic<bool> posted{ false };
+    std::atomic<uint32> dropped{ 0 };
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SharedMemoryLink)
+};
@@ -0,0 +1,77 @@
+#pragma once
+
+// Analysis sidecar. Workers that only log or draw what they're sent shouldn't
+// be able to touch the audio, or hold up the audio thread when the socket
+// backs up:
+//   HELO proto=2;sidecar=1;queue=32;decimate=4
+// Frames are built as usual but the audio thread only copies them into a
+// queue; this thread does the sending. When the queue is full the frame is
+// dropped, and with decimate=N only every Nth frame is queued at all. Replies
+// are ignored and the block goes out dry. `seq` counts every frame, so the
+// worker can see the gaps. The v2 audio frame after a dropped one is a
+// keyframe; decimated ones are gaps the worker asked for, windowOffset says
+// where the next frame goes.
+
+class SidecarSender : public juce::Thread {
+public:
+    using Send = std::function<bool(const MemoryBlock&)>;
+
+    SidecarSender(Send send_, size_t maxFrameBytes, int queueLength, int decimate_)
+        : Thread("typhon sidecar"), send(std::move(send_)), capacity(maxFrameBytes),
+          decimate(jmax(1, decimate_)), fifo(jlimit(2, 1024, queueLength)) {
+        slots.allocate((size_t)fifo.getTotalSize() * capacity, false);
+        sizes.allocate((size_t)fifo.getTotalSize(), true);
+    }
+
+    ~SidecarSender() override {
+        stopThread(1000);
+    }
+
+    enum Result { queued, skipped, dropped };
+
+    // audio thread: skipped is decimate leaving it out on purpose, dropped
+    // is a full queue or a frame too big for a slot
+    Result push(FrameRef message) {
+        if (counter++ % decimate != 0) return skipped;
+        int start1, size1, start2, size2;
+        fifo.prepareToWrite(1, start1, size1, start2, size2);
+        if (size1 == 0 || message.getSize() > capacity) {
+            numDropped++;
+            return dropped;
+        }
+        memcpy(slots.get() + (size_t)start1 * capacity, message.getData(), message.getSize());
+        sizes[start1] = message.getSize();
+        fifo.finishedWrite(1);
+        notify();
+        return queued;
+    }
+
+    uint32 getNumDropped() const { return numDropped.load(); }
+
+    void run() override {
+        while (!threadShouldExit()) {
+            int start1, size1, start2, size2;
+            fifo.prepareToRead(1, start1, size1, start2, size2);
+            if (size1 == 0) {
+                wait(50);
+                continue;
+            }
+            outgoing.replaceWith(slots.get() + (size_t)start1 * capacity, sizes[start1]);
+            fifo.finishedRead(1);
+            send(outgoing);
+        }
+    }
+
+private:
+    Send send;
+    size_t capacity;
+    int decimate;
+    uint32 counter = 0; // audio thread only
+    std::atomic<uint32> numDropped{ 0 };
+    AbstractFifo fifo;
+    HeapBlock<uint8> slots;
+    HeapBlock<size_t> sizes;
+    MemoryBlock outgoing;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SidecarSender)
+};
@@ -0,0 +1,264 @@
+#pragma once
+
+// STFT transport. With "transport=stft" in a v2 handshake the plugin does the
+// analysis and resynthesis itself and the worker only ever sees bins:
+//   HELO proto=2;transport=stft;fft=1024;hop=256;window=hann;bins=complex
+// Each message carries the frames completed during that host block as
+// float32 [channels][frames][bins] with bins = fft / 2 + 1, interleaved
+// (re, im) or magnitudes only with "bins=magnitude". windowOffset is the index
+// of the first frame, `current` the number of frames. The reply is the same
+// shape; returned magnitudes are put back with the phase of the analysis
+// frame they came from. The analysis and synthesis windows are the square
+// root of the chosen window so the overlap-add is exact at the usual hops.
+//
+// The output runs fft + one block behind the input: a frame is complete fft
+// samples after it starts and its reply gets one block to come back.
+
+class StftTransport {
+public:
+    enum { maxFramesInFlight = 64 };
+
+    void prepare(int numChannels_, int maxBlockSize_, int fftSize_, int hop_, const String& windowName, bool magnitudes_) {
+        numChannels = numChannels_;
+        maxBlockSize = maxBlockSize_;
+        fftSize = getFftSize(fftSize_);
+        hop = jlimit(1, fftSize, hop_);
+        magnitudes = magnitudes_;
+        numBins = fftSize / 2 + 1;
+        valuesPerFrame = magnitudes ? numBins : 2 * numBins;
+        latency = getLatencyFor(fftSize, maxBlockSize);
+        fft = std::make_unique<dsp::FFT>(roundToInt(std::log2(fftSize)));
+
+        fillWindow(windowName);
+
+        analysis.setSize(numChannels, fftSize);
+        analysis.clear();
+        fill = 0;
+        frameIndex = 0;
+        work.allocate((size_t)(2 * fftSize), true);
+
+        // enough for every frame one host block can finish
+        maxFramesPerBlock = maxBlockSize / hop + 1;
+        message.setSize(getMaxMessageSize(), true);
+        analysisSpectra.setSize(numChannels, maxFramesInFlight * 2 * numBins);
+        analysisSpectra.clear();
+
+        replies.allocate((size_t)(maxFramesInFlight * numChannels * valuesPerFrame), true);
+        replyIndices.allocate((size_t)maxFramesInFlight, true);
+        replyFifo.setTotalSize(maxFramesInFlight);
+
+        outputSize = 4 * (fftSize + maxBlockSize);
+        output.setSize(numChannels, outputSize);
+        output.clear();
+        outputPos = 0;
+    }
+
+    int getLatencySamples() const { return latency; }
+
+    size_t getMaxMessageSize() const {
+        return FrameHeader::size + TransportInfo::size + (size_t)numChannels * maxFramesPerBlock * valuesPerFrame * sizeof(float) + FrameWriter::maxMidiBytes;
+    }
+
+    // what a handshake asking for this fft size will add
+    static int getLatencyFor(int requestedFftSize, int maxBlockSize) {
+        return getFftSize(requestedFftSize) + maxBlockSize;
+    }
+
+    // audio thread: window and transform every frame this block completes.
+    // nullptr when there's nothing to send yet.
+    const FrameRef* analyse(const AudioBuffer<float>& buffer, const MidiBuffer& midi, int channels, int numSamples, uint32 seq,
+                               const TransportInfo* transport = nullptr) {
+        auto headerBytes = FrameHeader::size + (transport != nullptr ? TransportInfo::size : 0);
+        auto values = (float*)((uint8*)message.getData() + headerBytes);
+        auto firstFrame = frameIndex;
+        int frames = 0;
+        channels = jmin(channels, numChannels);
+
+        for (int done = 0; done < numSamples;) {
+            auto n = jmin(numSamples - done, hop - fill);
+            for (int ch = 0; ch < numChannels; ch++) {
+                auto dest = analysis.getWritePointer(ch, fftSize - hop + fill);
+                if (ch < channels) FloatVectorOperations::copy(dest, buffer.getReadPointer(ch, done), n);
+                else FloatVectorOperations::clear(dest, n);
+            }
+            fill += n;
+            done += n;
+            if (fill < hop) break;
+
+            // a frame is the last fftSize samples, then slide along by hop
+            if (frames < maxFramesPerBlock) {
+                for (int ch = 0; ch < numChannels; ch++) {
+                    analyseFrame(ch, frameIndex, values + ((size_t)ch * maxFramesPerBlock + frames) * valuesPerFrame);
+                }
+                frames++;
+            }
+            frameIndex++;
+            for (int ch = 0; ch < numChannels; ch++) {
+                auto data = analysis.getWritePointer(ch);
+                FloatVectorOperations::copy(data, data + hop, fftSize - hop);
+            }
+            fill = 0;
+        }
+
+        auto midiDest = (uint8*)values + (size_t)numChannels * frames * valuesPerFrame * sizeof(float);
+        if (frames < maxFramesPerBlock) {
+            // the channels were laid out for a full message, close the gaps
+            for (int ch = 1; ch < numChannels; ch++) {
+                memmove(values + (size_t)ch * frames * valuesPerFrame,
+                        values + (size_t)ch * maxFramesPerBlock * valuesPerFrame,
+                        (size_t)frames * valuesPerFrame * sizeof(float));
+            }
+        }
+        auto midiBytes = FrameWriter::packMidi(midi, midiDest);
+        if (frames == 0 && midiBytes == 0) return nullptr;
+
+        FrameHeader header;
+        header.kind = FrameHeader::spectrum;
+        header.seq = seq;
+        header.channels = (uint16)numChannels;
+        header.flags = (uint16)(FrameHeader::float32 | (magnitudes ? FrameHeader::magnitudes : 0));
+        header.samples = (uint32)(frames * valuesPerFrame);
+        header.current = (uint32)frames;
+        header.windowOffset = firstFrame;
+        header.midiBytes = (uint32)midiBytes;
+        if (transport != nullptr) {
+            header.flags |= FrameHeader::transportInfo;
+            header.transport = *transport;
+        }
+        header.write((uint8*)message.getData());
+        built = { message.getData(), header.getHeaderBytes() + header.getPayloadBytes() };
+        return &built;
+    }
+
+    // message thread: queue the frames of a reply, whatever doesn't fit is dropped
+    void receive(const FrameHeader& header, const uint8* payload) {
+        if (header.channels == 0 || header.current == 0) return;
+        if (header.samples != header.current * (uint32)valuesPerFrame) return;
+        auto frames = (int)header.current;
+        auto values = (const float*)payload;
+        for (int f = 0; f < frames; f++) {
+            int start1, size1, start2, size2;
+            replyFifo.prepareToWrite(1, start1, size1, start2, size2);
+            if (size1 == 0) return;
+            replyIndices[start1] = header.windowOffset + f;
+            auto dest = replies.get() + (size_t)start1 * numChannels * valuesPerFrame;
+            for (int ch = 0; ch < numChannels; ch++) {
+                auto src = ch < header.channels ? values + ((size_t)ch * frames + f) * valuesPerFrame : nullptr;
+                if (src != nullptr) memcpy(dest + (size_t)ch * valuesPerFrame, src, (size_t)valuesPerFrame * sizeof(float));
+                else FloatVectorOperations::clear(dest + (size_t)ch * valuesPerFrame, valuesPerFrame);
+            }
+            replyFifo.finishedWrite(1);
+        }
+    }
+
+    // audio thread: overlap-add what's come back and write out this block
+    void render(AudioBuffer<float>& buffer, int channels, int numSamples) {
+        channels = jmin(channels, numChannels);
+        int start1, size1, start2, size2;
+        replyFifo.prepareToRead(replyFifo.getNumReady(), start1, size1, start2, size2);
+        for (int i = 0; i < size1; i++) synthesise(start1 + i);
+        for (int i = 0; i < size2; i++) synthesise(start2 + i);
+        replyFifo.finishedRead(size1 + size2);
+
+        for (int done = 0; done < numSamples;) {
+            auto pos = (int)(outputPos % outputSize);
+            auto n = jmin(numSamples - done, outputSize - pos);
+            for (int ch = 0; ch < numChannels; ch++) {
+                if (ch < channels) FloatVectorOperations::copy(buffer.getWritePointer(ch, done), output.getReadPointer(ch, pos), n);
+                output.clear(ch, pos, n);
+            }
+            done += n;
+            outputPos += n;
+        }
+    }
+
+private:
+    static int getFftSize(int requested) {
+        return nextPowerOfTwo(jlimit(64, 16384, requested));
+    }
+
+    void analyseFrame(int ch, int64 index, float* dest) {
+        auto w = work.get();
+        FloatVectorOperations::multiply(w, analysis.getReadPointer(ch), window.get(), fftSize);
+        FloatVectorOperations::clear(w + fftSize, fftSize);
+        fft->performRealOnlyForwardTransform(w, true);
+        if (magnitudes) {
+            // keep the phase for when the magnitudes come back
+            FloatVectorOperations::copy(analysisSpectra.getWritePointer(ch, (int)(index % maxFramesInFlight) * 2 * numBins), w, 2 * numBins);
+            for (int b = 0; b < numBins; b++) dest[b] = std::sqrt(w[2 * b] * w[2 * b] + w[2 * b + 1] * w[2 * b + 1]);
+        } else {
+            FloatVectorOperations::copy(dest, w, 2 * numBins);
+        }
+    }
+
+    void synthesise(int slot) {
+        auto index = replyIndices[slot];
+        // frame k covers input [(k + 1) * hop - fftSize, (k + 1) * hop)
+        auto start = (index + 1) * hop - fftSize + latency;
+        auto skip = (int)jlimit((int64)0, (int64)fftSize, outputPos - start);
+        if (skip >= fftSize || start + fftSize > outputPos + outputSize || index < frameIndex - maxFramesInFlight) return;
+
+        auto src = replies.get() + (size_t)slot * numChannels * valuesPerFrame;
+        auto w = work.get();
+        for (int ch = 0; ch < numChannels; ch++) {
+            auto bins = src + (size_t)ch * valuesPerFrame;
+            if (magnitudes) {
+                auto analysed = analysisSpectra.getReadPointer(ch, (int)(index % maxFramesInFlight) * 2 * numBins);
+                for (int b = 0; b < numBins; b++) {
+                    auto re = analysed[2 * b], im = analysed[2 * b + 1];
+                    auto mag = std::sqrt(re * re + im * im);
+                    auto scale = mag > 1.0e-9f ? bins[b] / mag : 0.0f;
+                    w[2 * b] = re * scale;
+                    w[2 * b + 1] = im * scale;
+                }
+            } else {
+                FloatVectorOperations::copy(w, bins, 2 * numBins);
+            }
+            FloatVectorOperations::clear(w + 2 * numBins, 2 * fftSize - 2 * numBins);
+            fft->performRealOnlyInverseTransform(w);
+            FloatVectorOperations::multiply(w, synthesisWindow.get(), fftSize);
+
+            for (int i = skip; i < fftSize;) {
+                auto pos = (int)((start + i) % outputSize);
+                auto n = jmin(fftSize - i, outputSize - pos);
+                FloatVectorOperations::add(output.getWritePointer(ch, pos), w + i, n);
+                i += n;
+            }
+        }
+    }
+
+    // periodic window, square-rooted for analysis and again for synthesis,
+    // with the overlap-add gain folded into the synthesis side
+    void fillWindow(const String& name) {
+        window.allocate((size_t)fftSize, false);
+        synthesisWindow.allocate((size_t)fftSize, false);
+        for (int i = 0; i < fftSize; i++) {
+            auto x = MathConstants<double>::twoPi * i / fftSize;
+            double w;
+            if (name == "hamming") w = 0.54 - 0.46 * std::cos(x);
+            else if (name == "blackman") w = 0.42 - 0.5 * std::cos(x) + 0.08 * std::cos(2.0 * x);
+            else if (name == "rect") w = 1.0;
+            else w = 0.5 - 0.5 * std::cos(x);
+            window[i] = (float)std::sqrt(jmax(0.0, w));
+        }
+        // constant for a window/hop pair that overlap-adds properly, averaged otherwise
+        double overlap = 0.0;
+        for (int i = 0; i < fftSize; i++) overlap += (double)window[i] * window[i];
+        overlap /= hop;
+        for (int i = 0; i < fftSize; i++) {
+            synthesisWindow[i] = (float)(window[i] / jmax(1.0e-6, overlap));
+        }
+    }
+
+    int numChannels = 0, maxBlockSize = 0, fftSize = 0, hop = 0, numBins = 0, valuesPerFrame = 0;
+    int latency = 0, maxFramesPerBlock = 0, fill = 0, outputSize = 0;
+    bool magnitudes = false;
+    int64 frameIndex = 0, outputPos = 0;
+    std::unique_ptr<dsp::FFT> fft;
+    HeapBlock<float> window, synthesisWindow, work, replies;
+    HeapBlock<int64> replyIndices;
+    AudioBuffer<float> analysis, analysisSpectra, output;
+    AbstractFifo replyFifo{ maxFramesInFlight };
+    MemoryBlock message;
+    FrameRef built{ nullptr, 0 };
+};
@@ -1,5 +1,97 @@
 #pragma once
 
+// Hands an object built off the audio thread (an effect chain, a loaded IR..)
+// over to the audio thread without ever blocking it. Whatever gets replaced is
+// parked and freed by the next set(), so nothing is deleted on the audio thread.
+template <typename T>
+class Handoff {
+public:
+    // message thread / loader thread only
+    void set(std::unique_ptr<T> next) {
+        std::unique_ptr<T> garbage;
+        {
+            const juce::SpinLock::ScopedLockType lock(mutex);
+            garbage = std::move(retired);
+            std::swap(pending, next);
+            hasPending = true;
+        }
+    }
+
+    // audio thread, picks up whatever was set last if it can get the lock
+    T* get() {
+        if (hasPending.load(std::memory_order_acquire)) {
+            const juce::SpinLock::ScopedTryLockType lock(mutex);
+            if (lock.isLocked() && retired == nullptr) {
+                retired = std::move(active);
+                active = std::move(pending);
+                hasPending = false;
+            }
+        }
+        return active.get();
+    }
+
+private:
+    juce::SpinLock mutex;
+    std::atomic<bool> hasPending{ false };
+    std::unique_ptr<T> active, pending, retired;
+};
+
+// What a worker says about itself. Optional: after our EHLO a worker may send a
+// short text message "HELO key=value;key=value..." before any audio, e.g.
+//   HELO chain=lowpass:1300,overdrive:20:20
+// Workers that never send one get exactly the old behaviour.
+struct WorkerConfig {
+    juce::StringPairArray values;
+
+    static bool isHandshake(const juce::MemoryBlock& msg) {
+        auto size = msg.getSize();
+        auto data = (const char*)msg.getData();
+        if (size < 4 || size > 4096 || memcmp(data, "HELO", 4) != 0) return false;
+        // an audio frame could start with those bytes, text won't have control chars
+        for (size_t i = 4; i < size; i++) {
+            auto c = (uint8)data[i];
+            if (c < 32 && c != '\n' && c != '\r' && c != '\t') return false;
+        }
+        return true;
+    }
+
+    static WorkerConfig parse(const juce::MemoryBlock& msg) {
+        WorkerConfig config;
+        auto text = juce::String::fromUTF8((const char*)msg.getData() + 4, (int)msg.getSize() - 4);
+        for (auto& pair : juce::StringArray::fromTokens(text, ";\n", "")) {
+            auto key = pair.upToFirstOccurrenceOf("=", false, false).trim();
+            if (key.isNotEmpty()) {
+                config.values.set(key, pair.fromFirstOccurrenceOf("=", false, false).trim());
+            }
+        }
+        return config;
+    }
+
+    bool has(const char* key) const { return values.containsKey(key); }
+    juce::String get(const char* key, const juce::String& fallback = {}) const { return values.getValue(key, fallback); }
+    int getInt(const char* key, int fallback) const { return has(key) ? get(key).getIntValue() : fallback; }
+
+    // how many of level1=.., level2=.. the worker offers, see typhon_quality.h
+    int getNumLevels() const {
+        int n = 0;
+        while (has(("level" + juce::String(n + 1)).toRawUTF8())) n++;
+        return n;
+    }
+
+    // these settings with level n's "key:value,key:value" on top; past the
+    // last level it stays on the last
+    WorkerConfig atLevel(int level) const {
+        WorkerConfig out(*this);
+        level = jmin(level, getNumLevels());
+        if (level <= 0) return out;
+        for (auto& pair : juce::StringArray::fromTokens(get(("level" + juce::String(level)).toRawUTF8()), ",", "")) {
+            auto key = pair.upToFirstOccurrenceOf(":", false, false).trim();
+            if (key.isNotEmpty()) out.values.set(key, pair.fromFirstOccurrenceOf(":", false, false).trim());
+        }
+        return out;
+    }
+};
+
 struct pycom {
     int note;
     float vol;
@@ -14,17 +106,20 @@ public:
     }
     ~Pyaudio() {}
     int seqnum; // dont play if its same as last time
+    bool silent = false; // the worker said so, audio is empty and the block should be cleared
     std::unique_ptr<juce::MemoryBlock> audio;
     std::unique_ptr<juce::MemoryBlock> midi;
     void reset() {
         audio->reset();
         midi->reset();
         seqnum = 0;
+        silent = false;
     }
-    void set(juce::MemoryBlock newaudio, juce::MemoryBlock newmidi, int seqnum_) {
+    void set(juce::MemoryBlock newaudio, juce::MemoryBlock newmidi, int seqnum_, bool silent_ = false) {
         audio->swapWith(newaudio);
         midi->swapWith(newmidi);
         seqnum = seqnum_;
+        silent = silent_;
     }
     juce::MemoryBlock* getAudio() {
         return audio.get();
@@ -42,7 +137,6 @@ public:
         stop_signal_(stop_signal)
     {
         audiomsg = std::make_unique<Pyaudio[]>(BUF_SIZE);
-        memory_block_ = std::make_unique<juce::MemoryBlock>();
         tmp2 = std::make_unique<juce::MemoryBlock>(12000);
         tmpMidi2 = std::make_unique<juce::MemoryBlock>(300 * sizeof(uint8));
     }
@@ -51,14 +145,46 @@ public:
     {
         DBG("Connection made");
 
+        madeGeneration = socketGeneration.load();
+        // a resumed session carries on in the same log
+        if (captureReceiver == nullptr) startCapture();
         juce::String msg("EHLO" + timecodeInfo + "BYE");
         juce::MemoryBlock mb(msg.toRawUTF8(), msg.length());
+        if (captureReceiver != nullptr) captureReceiver->messageThread(WireLog::toWorker, mb);
         sendMessage(mb);
     }
 
+    // Queued by the connection's thread when the socket went. The worker can
+    // be back before it runs: the server may already have handed this object
+    // its new socket, which mustn't be the one that's closed. Callbacks come
+    // in order, so the socket lost is the one connectionMade last saw
     void connectionLost() override
     {
-        disconnect(10, Notify::yes);
+        holdSession();
+        if (socketGeneration.load() == madeGeneration) disconnect(10, Notify::yes);
+    }
+
+    // the server's thread, when a worker connects and this one's socket has
+    // gone: true if the new one gets this object. The message thread may not
+    // have heard about the old socket yet, so the window can open here too
+    bool claimForResume()
+    {
+        holdSession();
+        if (!canResume()) return false;
+        socketGeneration++;
+        return true;
+    }
+
+    // still within the resume window after the socket went, see typhon_session.h
+    bool canResume() const
+    {
+        return resuming.load() && (int32)(resumeDeadline.load() - juce::Time::getMillisecondCounter()) > 0;
+    }
+
+    // connected, or covering for a worker that might be back any moment
+    bool isActive() const
+    {
+        return isConnected() || canResume();
     }
 
     void saveTimecodeInfo(std::string info)
@@ -66,8 +192,105 @@ public:
         timecodeInfo = info;
     }
 
+    void setHandshakeCallback(std::function<void(const WorkerConfig&)> callback)
+    {
+        onHandshake = callback;
+    }
+
+    const WorkerConfig& getWorkerConfig() const { return config; }
+
+    // the worker's version= or latest VERS, hashed; 0 if it never said
+    uint64 getVersionTag() const { return cacheTag.load(); }
+
+    // the next v2 audio frame carries the whole window again
+    void requestKeyframe() { keyframeRequested = true; }
+
+    // how far along the worker's warm-up is, see typhon_warmup.h
+    const Warmup& getWarmup() const { return warmup; }
+
+    // message thread: run the worker at its own level n, 0 being what its
+    // HELO said, see typhon_quality.h. Returns the settings now in force.
+    const WorkerConfig& setQualityLevel(int level)
+    {
+        qualityLevel = level;
+        if (config.getInt("proto", 1) < 2) return config;
+        auto next = helloConfig.atLevel(level);
+        if (next.values == config.values) return config;
+        config = next;
+        // it hears before the first frame in the new shape, which is a keyframe
+        sendText("QUAL " + juce::String(jmin(level, helloConfig.getNumLevels())));
+        updateVersionTag();
+        configureFrames();
+        return config;
+    }
+
+    // message thread: mean time from a frame going out to its reply coming
+    // in since last asked, ms; negative if nothing came back
+    double takeRoundTripMs()
+    {
+        auto mean = roundTrips > 0 ? roundTripMicros / 1000.0 / roundTrips : -1.0;
+        roundTripMicros = 0;
+        roundTrips = 0;
+        return mean;
+    }
+
+    // log everything on the wire to a new file in `directory`, see
+    // typhon_capture.h. An empty File stops it.
+    void setCapture(const juce::File& directory, bool headersOnly)
+    {
+        if (directory == captureDirectory && headersOnly == captureHeadersOnly && captureReceiver != nullptr) return;
+        captureDirectory = directory;
+        captureHeadersOnly = headersOnly;
+        if (isConnected() || captureDirectory == juce::File()) startCapture();
+    }
+
+    // what prepareToPlay promised, v2 frames are sized from it
+    // sidechain and aux follow the main channels in the process buffer
+    void setBlockLayout(int numChannels, int sidechainChannels, int auxChannels, int maxBlockSize, double sampleRate)
+    {
+        frameChannels = numChannels;
+        frameSidechainChannels = sidechainChannels;
+        frameAuxChannels = auxChannels;
+        frameBlockSize = maxBlockSize;
+        frameSampleRate = sampleRate;
+        configureFrames();
+    }
+
     void messageReceived(const juce::MemoryBlock& msg) override
     {
+        if (captureReceiver != nullptr) captureReceiver->messageThread(WireLog::fromWorker, msg);
+        if (WorkerConfig::isHandshake(msg)) {
+            // we're on the message thread here
+            auto next = WorkerConfig::parse(msg);
+            if (resuming && sessionId.isNotEmpty() && next.get("session") == sessionId) {
+                resume();
+                return;
+            }
+            startSession(next);
+            return;
+        }
+        juce::String tag;
+        if (config.getInt("proto", 1) >= 2 && BlockCache::isVersion(msg, tag)) {
+            // replies cached from here on are under the new tag, see typhon_cache.h
+            versionName = tag;
+            updateVersionTag();
+            return;
+        }
+        if (config.getInt("proto", 1) >= 2 && Warmup::isReady(msg)) {
+            warmup.ready();
+            return;
+        }
+        bool warmedUp = false;
+        if (config.getInt("proto", 1) >= 2 && warmup.isReply(msg, warmedUp)) {
+            // the worker's ring has noise in it now, start it again from real audio
+            if (warmedUp) keyframeRequested = true;
+            return;
+        }
+        if (resuming) {
+            // whoever reconnected never said HELO, so it's an old worker and not ours
+            startSession({});
+        }
+
         if (seqnum == 0) {
             seqnum = 0;
             lastGot = 0;
@@ -76,6 +299,12 @@ public:
             lastGot = seqnum - 1;
         }
 
+        FrameHeader header;
+        if (FrameHeader::read(msg, header)) {
+            receiveFrame(msg, header);
+            return;
+        }
+
         int16* msg_data = (int16*)msg.getData();
         uint8* msg_data_midi = (uint8*)msg.getData();
         float* tmp = (float*)tmp2->getData();
@@ -91,28 +320,109 @@ public:
         audiomsg[seqnum++ % BUF_SIZE].set(*tmp2.get(), *tmpMidi2.get(), seqnum);
     }
     Pyaudio* gotMsg() {
+        if (hitDue) {
+            // last block was answered from the cache, it plays now as a reply would
+            hitDue = false;
+            lastReply = &cacheHits[dueSlot];
+            return lastReply;
+        }
         if (seqnum > lastGot) {
             lastGot = seqnum - 1;
         }
         auto msg = &audiomsg[lastGot++ % BUF_SIZE];
+        if (resuming && msg->seqnum == 0) {
+            lastReply = conceal();
+            return lastReply;
+        }
+        concealGain = 1.0f;
         auto x = msg->getAudio();
         auto x_midi = msg->getMidi();
         tmp_audio.audio->replaceWith(x->getData(), x->getSize());
         tmp_audio.midi->replaceWith(x_midi->getData(), x_midi->getSize());
         tmp_audio.seqnum = msg->seqnum - 1;
+        tmp_audio.silent = msg->silent;
         msg->audio->fillWith(0);
         msg->midi->fillWith(0);
         msg->seqnum = 0;
+        msg->silent = false;
+        lastReply = &tmp_audio;
         return &tmp_audio;
     }
     void clearMsg() {
         audiomsg[seqnum].reset();
     }
     template <typename FloatType>
-    void transmit(AudioBuffer<FloatType>& buffer, MidiBuffer & midiBuffer) {
+    void transmit(AudioBuffer<FloatType>& buffer, MidiBuffer & midiBuffer, const TransportInfo* transport) {
         int chunkSize = buffer.getNumSamples() * sizeof(float);
         if (!chunkSize) return;
-        int totalSamples = buffer.getNumSamples() * buffer.getNumChannels();
+
+        // a hit from the last block is due in this one's gotMsg
+        hitDue = std::exchange(hitPending, false);
+        dueSlot = hitSlot;
+        hitSlot ^= 1;
+
+        // what went out replyGrace blocks ago should have been answered by
+        // now, by the worker or the cache
+        sentBy[(blockCount - 1) % deadlineBlocks] = frameSeq;
+        hitBy[(blockCount - 1) % deadlineBlocks] = hitDue;
+        auto grace = replyGrace.load();
+        if (grace > 0 && blockCount >= (uint32)grace) {
+            auto block = (blockCount - (uint32)grace) % deadlineBlocks;
+            pastDeadline = !hitBy[block] && (int32)(sentBy[block] - 1 - lastAcked.load()) > 0;
+        } else {
+            pastDeadline = false;
+        }
+        blockCount++;
+
+        if (resendRequested.exchange(false) && isConnected()) {
+            if (auto* kept = resend.get()) {
+                // too long away for the ring to cover it, start the window again
+                auto* log = capture.get();
+                auto resent = [this, log](const juce::MemoryBlock& m) {
+                    if (log != nullptr) log->audioThread(WireLog::toWorker, m);
+                    sendFrame(m);
+                };
+                if (!kept->resendAfter(lastAcked.load(), resent)) {
+                    keyframeRequested = true;
+                }
+            }
+        }
+
+        // v2 frames only carry what the worker subscribed to
+        auto subscribed = consumes.load();
+        const auto& midiIn = (subscribed & Subscription::midi) ? midiBuffer : noMidi;
+        auto position = (subscribed & Subscription::transport) ? transport : nullptr;
+
+        if (auto* spectral = stft.get()) {
+            if (auto* message = spectral->analyse(buffer, midiIn, jmin(buffer.getNumChannels(), frameChannels), buffer.getNumSamples(), frameSeq++, position)) {
+                send(*message);
+            }
+            return;
+        }
+
+        if (auto* tap = features.get()) {
+            if (auto* message = tap->analyse(buffer, midiIn, jmin(buffer.getNumChannels(), frameChannels), buffer.getNumSamples(), frameSeq++, position)) {
+                send(*message);
+            }
+            return;
+        }
+
+        if (auto* writer = frameWriter.get()) {
+            if (keyframeRequested.exchange(false)) writer->requestKeyframe();
+            // a host going over what prepareToPlay promised is sent in pieces
+            // that fit, everything after the writer is sized for that
+            auto total = buffer.getNumSamples();
+            auto piece = jmax(1, frameBlockSize);
+            for (int done = 0; done < total; done += piece) {
+                transmitAudio(*writer, buffer, done, jmin(piece, total - done), done == 0 ? midiIn : noMidi,
+                              position, total <= piece);
+            }
+            return;
+        }
+
+        auto channels = jmin(buffer.getNumChannels(), frameChannels);
+        auto numSamples = buffer.getNumSamples();
+        int totalSamples = numSamples * channels;
 
         auto midi = midiBuffer.data.begin();
         auto midiSize = midiBuffer.data.size();
@@ -121,31 +431,528 @@ public:
         midib->copyFrom(midi, 0, midiSize);
         midib->ensureSize(300, true); // 300 (/3 bytes/event) events per 10ms is a lot...
         
-        memory_block_ = std::make_unique<juce::MemoryBlock>(chunkSize * buffer.getNumChannels());
-        auto mb = memory_block_.get();
-
-        mb->copyFrom((FloatType*)buffer.getReadPointer(0, 0), 0, chunkSize);
-        mb->copyFrom((FloatType*)buffer.getReadPointer(1, 0), chunkSize, chunkSize);
-        jassert(mb->getSize() == (chunkSize * buffer.getNumChannels()));
-
-        MemoryBlock toSend((int)((mb->getSize() / 2) + midib->getSize()));
+        MemoryBlock toSend((size_t)totalSamples * sizeof(int16) + midib->getSize());
         int16* p = (int16*)toSend.getData();
-        float* channelData = (float*)mb->getData();
         uint8* midiData = (uint8*)midib->getData();
-        for (int s = 0; s < totalSamples; ++s) {
-            p[s] = (int16)(channelData[s] * 32768.0f);
-            // TODO add max(1) and min(-1) if clipped
+        // every output channel, straight from the buffer into the message
+        for (int ch = 0; ch < channels; ++ch) {
+            SampleConversion::toInt16(p + (size_t)ch * numSamples, buffer.getReadPointer(ch), numSamples);
         }
         uint8* p2 = (uint8*)toSend.getData();
         for (int s = totalSamples * sizeof(int16); s < (totalSamples * sizeof(int16)) + (300 * sizeof(uint8)); s++) {
             p2[s] = (uint8)(midiData[s - (totalSamples * sizeof(int16))]);
         }
-        sendMessage(toSend);
+        send(toSend);
+    }
+
+    // audio thread: numSamples of the block from startSample, no more than
+    // prepareToPlay promised. Only a whole block is looked up in the cache
+    void transmitAudio(FrameWriter& writer, const AudioBuffer<float>& buffer, int startSample, int numSamples,
+                       const MidiBuffer& midiIn, const TransportInfo* position, bool wholeBlock)
+    {
+        // main, sidechain and aux as the worker asked for them, at its rate
+        // if it has one (typhon_resample.h)
+        const auto& input = writer.gather(buffer, startSample, numSamples);
+        auto* converter = rate.get();
+        const AudioBuffer<float>& block = converter != nullptr
+            ? converter->toWorker(input, input.getNumChannels(), numSamples) : input;
+        if (converter != nullptr) numSamples = converter->getNumSent();
+        if (auto* quanta = reblock.get()) {
+            // the same size every frame, see typhon_reblock.h
+            quanta->push(block, midiIn, block.getNumChannels(), numSamples, frameSeq,
+                         [&](const AudioBuffer<float>& quantum, const MidiBuffer& midi, uint32 seq) {
+                             send(writer.write(quantum, midi, quantum.getNumChannels(), quantum.getNumSamples(), seq, position));
+                         });
+            return;
+        }
+        auto seq = frameSeq++;
+        auto message = writer.write(block, midiIn, block.getNumChannels(), numSamples, seq, position);
+        if (auto* blocks = wholeBlock ? cache.get() : nullptr) {
+            // heard this one before, the worker doesn't need to
+            auto key = BlockCache::keyFor(message, cacheTag.load());
+            auto& hit = cacheHits[hitSlot];
+            if (blocks->lookup(key, *hit.audio, *hit.midi, hit.silent)) {
+                hitPending = true;
+                return;
+            }
+            blocks->expect(seq, key);
+        }
+        send(message);
+    }
+
+    // audio thread, after gotMsg: a reply the block was counting on is
+    // late, see typhon_quality.h. Raw frames get one reply a block, v2 ones
+    // are late once their seq hasn't been answered within the transport's
+    // latency; a sidecar or a worker that only answers with MIDI is never late
+    bool missedDeadline() const {
+        auto grace = replyGrace.load();
+        if (grace < 0) return lastReply->seqnum < 0;
+        return grace > 0 && pastDeadline;
+    }
+
+    // true if this mode deals with the output itself: STFT replies are
+    // overlap-added here, control replies are rendered onto the block's own
+    // audio and a worker that doesn't produce audio leaves the block dry.
+    // false means copy the audio in from gotMsg as usual.
+    bool renderReplyAudio(AudioBuffer<float>& buffer, int numChannels, int numSamples) {
+        if (auto* spectral = stft.get()) {
+            spectral->render(buffer, numChannels, numSamples);
+            return true;
+        }
+        if (auto* renderer = control.get()) {
+            renderer->process(buffer, numChannels, numSamples);
+            return true;
+        }
+        if ((produces.load() & Subscription::audio) == 0) return true;
+        auto* converter = rate.get();
+        if (auto* quanta = reblock.get()) {
+            // as much as went out this block, from wherever the quanta put it
+            auto n = converter != nullptr ? converter->getNumSent() : numSamples;
+            auto reply = quanta->pull(n);
+            if (converter != nullptr) {
+                converter->fromWorker(reply, n, buffer, numChannels, numSamples);
+            } else {
+                for (int ch = 0; ch < jmin(numChannels, frameChannels); ch++) {
+                    buffer.copyFrom(ch, 0, reply + ch * n, n);
+                }
+            }
+            return true;
+        }
+        if (converter != nullptr) {
+            // the reply comes back at the worker's rate, one channel after another
+            auto* reply = lastReply;
+            auto perChannel = (int)(reply->audio->getSize() / sizeof(float)) / jmax(1, frameChannels);
+            converter->fromWorker(reply->silent ? nullptr : (const float*)reply->audio->getData(), perChannel,
+                                  buffer, numChannels, numSamples);
+            return true;
+        }
+        return false;
+    }
+
+    // false when the replies never carry MIDI, so there's nothing to unpack
+    bool repliesWithMidi() const {
+        return (produces.load() & Subscription::midi) != 0;
+    }
+
+    // how far behind the output runs with the frames this config asks for
+    static int getLatencySamples(const WorkerConfig& config, int maxBlockSize, double sampleRate) {
+        if (config.getInt("proto", 1) < 2 || config.getInt("sidecar", 0) != 0) return 0;
+        if (config.get("transport") == "stft") return StftTransport::getLatencyFor(config.getInt("fft", 1024), maxBlockSize);
+        if ((getConsumes(config) & Subscription::audio) == 0) return 0;
+        auto workerRate = getWorkerRate(config, sampleRate);
+        auto workerBlock = workerRate == sampleRate ? maxBlockSize : RateConverter::getWorkerBlockFor(maxBlockSize, sampleRate, workerRate);
+        auto quantum = config.getInt("quantum", 0);
+        auto latency = jmax(0, config.getInt("lookahead", 0)) + (quantum > 0 ? Reblocker::getLatencyFor(quantum, workerBlock) : 0);
+        if (workerRate == sampleRate) return latency;
+        // the lookahead and quanta are counted in the worker's samples
+        return (int)std::ceil(latency * sampleRate / workerRate) + RateConverter::getLatencyFor(sampleRate, workerRate);
     }
 
 private:
+    // a features worker defaults to listening and answering with MIDI
+    static int getConsumes(const WorkerConfig& config) {
+        auto fallback = config.get("transport") == "features" ? "features,midi" : "audio,midi";
+        return Subscription::parse(config.get("consumes", fallback));
+    }
+    static int getProduces(const WorkerConfig& config) {
+        auto fallback = config.get("transport") == "features" ? "midi" : "audio,midi";
+        return Subscription::parse(config.get("produces", fallback));
+    }
+
+    // "rate=16000", the host's rate if left out or the same
+    static double getWorkerRate(const WorkerConfig& config, double sampleRate) {
+        auto rate = config.get("rate").getDoubleValue();
+        return rate >= 1000.0 && std::abs(rate - sampleRate) > 0.5 ? rate : sampleRate;
+    }
+
+    // "silence=-90" in dBFS, "silence=digital" for exact zeros, left out is off
+    static float getSilenceThreshold(const WorkerConfig& config) {
+        if (!config.has("silence")) return -1.0f;
+        auto value = config.get("silence");
+        if (value == "digital" || value == "0") return 0.0f;
+        return juce::Decibels::decibelsToGain(value.getFloatValue(), -200.0f);
+    }
+
+    // straight out on the socket, or into the sidecar queue for the sender thread
+    void send(FrameRef message)
+    {
+        if (auto* log = capture.get()) {
+            log->audioThread(WireLog::toWorker, message);
+        }
+        FrameHeader header;
+        if (FrameHeader::read(message, header)) {
+            auto& sent = sentAt[header.seq % roundTripSlots];
+            sent.ticks = juce::Time::getHighResolutionTicks();
+            sent.seq = header.seq;
+        }
+        if (auto* side = sidecar.get()) {
+            // whatever comes after a gap has to be a whole window again; a
+            // decimated worker asked for its gaps, they don't count
+            if (side->push(message) == SidecarSender::dropped) keyframeRequested = true;
+            return;
+        }
+        if (auto* kept = resend.get()) {
+            kept->keep(message);
+        }
+        // while resuming the frame only goes in the resend ring
+        if (isConnected() && !sendFrame(message)) keyframeRequested = true;
+    }
+
+    // on the socket, or through the worker's shared memory if it has some
+    bool sendFrame(FrameRef message)
+    {
+        if (auto* link = shm.get()) return link->push(message);
+        // sendMessage copies it into a block of its own anyway
+        return sendMessage(juce::MemoryBlock(message.getData(), message.getSize()));
+    }
+
+    // a new worker, or the old one under a different name: nothing carries over
+    void startSession(const WorkerConfig& next)
+    {
+        helloConfig = next;
+        config = next.getInt("proto", 1) >= 2 ? next.atLevel(qualityLevel) : next;
+        sessionId = config.getInt("proto", 1) >= 2 ? config.get("session") : juce::String();
+        resumeWindowMs = sessionId.isNotEmpty() ? jmax(0, config.getInt("resume", 2000)) : -1;
+        resuming = false;
+        resendRequested = false;
+        lastAcked = ~(uint32)0;
+        if (config.getInt("proto", 1) >= 2 && jmin(qualityLevel, next.getNumLevels()) > 0) {
+            sendText("QUAL " + juce::String(jmin(qualityLevel, next.getNumLevels())));
+        }
+        versionName = config.get("version");
+        updateVersionTag();
+        configureFrames();
+        if (onHandshake) onHandshake(config);
+    }
+
+    // a named session is held open for a while in case the worker comes
+    // back. Whichever of connectionLost and claimForResume gets here first
+    // opens the window
+    void holdSession()
+    {
+        auto window = resumeWindowMs.load();
+        if (window < 0 || resuming.load()) return;
+        resumeDeadline = juce::Time::getMillisecondCounter() + (uint32)window;
+        resuming = true;
+    }
+
+    // the same worker back within the window: keep everything, send what it missed
+    void resume()
+    {
+        resuming = false;
+        sendText("RSUM session=" + sessionId + ";acked=" + juce::String((int64)(int32)lastAcked.load()));
+        resendRequested = true;
+    }
+
+    // message thread
+    void sendText(const juce::String& text)
+    {
+        juce::MemoryBlock message(text.toRawUTF8(), text.getNumBytesAsUTF8());
+        if (captureReceiver != nullptr) captureReceiver->messageThread(WireLog::toWorker, message);
+        sendMessage(message);
+    }
+
+    // replies from a worker at a lower level aren't the ones it gives at full
+    // quality, so they're cached and frozen under their own tag
+    void updateVersionTag()
+    {
+        auto level = jmin(qualityLevel, helloConfig.getNumLevels());
+        cacheTag = BlockCache::hashTag(level > 0 ? versionName + "@level" + juce::String(level) : versionName);
+    }
+
+    // the last reply again, each block half as loud as the one before
+    Pyaudio* conceal()
+    {
+        auto bytes = tmp_audio.audio->getSize();
+        concealed.audio->replaceWith(tmp_audio.audio->getData(), bytes);
+        concealed.midi->setSize(300);
+        concealed.midi->fillWith(0);
+        concealed.silent = tmp_audio.silent;
+        concealed.seqnum = tmp_audio.seqnum;
+        auto data = (float*)concealed.audio->getData();
+        auto channels = jmax(1, frameChannels);
+        auto perChannel = (int)(bytes / sizeof(float)) / channels;
+        for (int ch = 0; ch < channels; ch++) {
+            for (int i = 0; i < perChannel; i++) {
+                data[ch * perChannel + i] *= concealGain * (1.0f - 0.5f * (float)(i + 1) / (float)perChannel);
+            }
+        }
+        concealGain *= 0.5f;
+        return &concealed;
+    }
+
+    // a fresh log named for when it started, or none
+    void startCapture()
+    {
+        // the old log can sit in the Handoff until the next set(), its file
+        // has to be finished now
+        if (captureReceiver != nullptr) captureReceiver->close();
+        if (captureDirectory == juce::File()) {
+            captureReceiver = nullptr;
+            capture.set(nullptr);
+            return;
+        }
+        auto name = "typhon-" + juce::Time::getCurrentTime().formatted("%Y%m%d-%H%M%S");
+        auto log = std::make_unique<WireLog>(captureDirectory.getNonexistentChildFile(name, ".tycap", false), captureHeadersOnly);
+        // same as stftReceiver, only replaced from this thread
+        captureReceiver = log.get();
+        capture.set(std::move(log));
+    }
+
+    // a named v2 session keeps its last frames for a resume, see typhon_session.h
+    void configureResend()
+    {
+        if (sessionId.isEmpty() || config.getInt("sidecar", 0) != 0) {
+            resend.set(nullptr);
+            return;
+        }
+        resend.set(std::make_unique<ResendBuffer>(maxFrameBytes, config.getInt("resend", 32)));
+    }
+
+    // a worker that says it's deterministic gets its replies remembered, see typhon_cache.h
+    void configureCache()
+    {
+        auto plainAudio = config.getInt("proto", 1) >= 2 && config.get("transport") != "stft"
+                       && (consumes.load() & (Subscription::features | Subscription::transport)) == 0
+                       && config.getInt("history", 0) == 0 && config.getInt("lookahead", 0) == 0
+                       && config.getInt("quantum", 0) == 0 && config.getInt("sidecar", 0) == 0;
+        if (!plainAudio || config.getInt("deterministic", 0) == 0) {
+            cache.set(nullptr);
+            cacheReceiver = nullptr;
+            return;
+        }
+        auto blocks = std::make_unique<BlockCache>((size_t)jmax(1, config.getInt("cache", 64)) << 20);
+        // same as stftReceiver, only replaced from this thread
+        cacheReceiver = blocks.get();
+        cache.set(std::move(blocks));
+    }
+
+    // frames through a file the worker mapped, see typhon_shm.h
+    void configureSharedMemory()
+    {
+        if (shmReceiver != nullptr) shmReceiver->close();
+        shmReceiver = nullptr;
+        auto path = config.get("shm");
+        if (config.getInt("proto", 1) < 2 || config.getInt("sidecar", 0) != 0 || !juce::File::isAbsolutePath(path)) {
+            shm.set(nullptr);
+            return;
+        }
+        auto link = SharedMemoryLink::open(juce::File(path), maxFrameBytes, config.getInt("shmspin", 200),
+                                           [this](const juce::MemoryBlock& m) {
+                                               // only frames come this way, and none for a session on hold
+                                               FrameHeader header;
+                                               if (!resuming && FrameHeader::read(m, header)) messageReceived(m);
+                                           });
+        // same as stftReceiver, only replaced from this thread
+        shmReceiver = link.get();
+        shm.set(std::move(link));
+    }
+
+    // throwaway frames at the shape just negotiated, see typhon_warmup.h
+    void configureWarmup()
+    {
+        auto count = warmBlockSize > 0 && isConnected() ? config.getInt("warmup", 8) : 0;
+        if (count <= 0) {
+            warmup.stop();
+            return;
+        }
+        FrameWriter writer;
+        writer.setBuses(warmMain, warmSidechain, warmMain, warmAux, warmMain + warmSidechain);
+        writer.prepare(warmMain + warmSidechain + warmAux, warmBlockSize, config.getInt("history", 0), config.getInt("lookahead", 0));
+        warmup.start(writer, warmMain + warmSidechain + warmAux, warmBlockSize, count, config.getInt("warmupms", 10000),
+                     [this](const juce::MemoryBlock& m) {
+                         if (captureReceiver != nullptr) captureReceiver->messageThread(WireLog::toWorker, m);
+                         sendMessage(m);
+                     });
+    }
+
+    void configureFrames()
+    {
+        configureDeadline();
+        configureTransport();
+        configureResend();
+        configureCache();
+        configureSharedMemory();
+
+        if (config.getInt("sidecar", 0) == 0) {
+            sidecar.set(nullptr);
+            configureWarmup();
+            return;
+        }
+        // nothing comes back to warm up
+        warmup.stop();
+        // never feeds back, whatever the worker said
+        produces = 0;
+        control.set(nullptr);
+        controlReceiver = nullptr;
+        auto side = std::make_unique<SidecarSender>([this](const juce::MemoryBlock& m) { return sendMessage(m); },
+                                                    maxFrameBytes, config.getInt("queue", 32), config.getInt("decimate", 1));
+        side->startThread();
+        sidecar.set(std::move(side));
+    }
+
+    // how many blocks a v2 reply has before it counts as late: the one it
+    // goes out in, and as many as the transport holds it back
+    void configureDeadline()
+    {
+        if (config.getInt("proto", 1) < 2) {
+            replyGrace = -1;
+            return;
+        }
+        auto backs = getProduces(config) & (Subscription::audio | Subscription::control);
+        if (config.getInt("sidecar", 0) != 0 || backs == 0) {
+            replyGrace = 0;
+            return;
+        }
+        auto latency = getLatencySamples(config, frameBlockSize, frameSampleRate);
+        replyGrace = jmin(1 + (latency + frameBlockSize - 1) / jmax(1, frameBlockSize), (int)deadlineBlocks - 1);
+    }
+
+    void configureTransport()
+    {
+        // only the audio frames below convert or go in quanta, or get warmed up
+        rate.set(nullptr);
+        reblock.set(nullptr);
+        reblockReceiver = nullptr;
+        warmBlockSize = 0;
+        if (config.getInt("proto", 1) < 2) {
+            frameWriter.set(nullptr);
+            stft.set(nullptr);
+            stftReceiver = nullptr;
+            features.set(nullptr);
+            control.set(nullptr);
+            controlReceiver = nullptr;
+            consumes = Subscription::audio | Subscription::midi;
+            produces = Subscription::audio | Subscription::midi;
+            maxFrameBytes = (size_t)frameChannels * frameBlockSize * sizeof(int16) + 300;
+            return;
+        }
+        consumes = getConsumes(config);
+        produces = getProduces(config);
+        if (produces & Subscription::control) {
+            auto renderer = ControlRenderer::fromSpec(config.get("controls", "gain"));
+            renderer->prepare(frameSampleRate, frameChannels);
+            // same as stftReceiver, only replaced from this thread
+            controlReceiver = renderer.get();
+            control.set(std::move(renderer));
+        } else {
+            control.set(nullptr);
+            controlReceiver = nullptr;
+        }
+        if (consumes & Subscription::features) {
+            auto tap = std::make_unique<FeatureTap>();
+            auto fftSize = config.getInt("fft", 1024);
+            tap->prepare(frameBlockSize, frameSampleRate, fftSize, config.getInt("hop", fftSize / 2),
+                         config.getInt("mels", 40), FeatureTap::parseFeatures(config.get("features")));
+            maxFrameBytes = tap->getMaxMessageSize();
+            features.set(std::move(tap));
+            stft.set(nullptr);
+            stftReceiver = nullptr;
+            frameWriter.set(nullptr);
+            return;
+        }
+        features.set(nullptr);
+        if (config.get("transport") == "stft") {
+            auto spectral = std::make_unique<StftTransport>();
+            auto fftSize = config.getInt("fft", 1024);
+            spectral->prepare(frameChannels, frameBlockSize, fftSize, config.getInt("hop", fftSize / 4),
+                              config.get("window", "hann"), config.get("bins") == "magnitude");
+            // only ever replaced from this thread, so it outlives any reply we hand it
+            stftReceiver = spectral.get();
+            maxFrameBytes = spectral->getMaxMessageSize();
+            stft.set(std::move(spectral));
+            frameWriter.set(nullptr);
+            return;
+        }
+        stft.set(nullptr);
+        stftReceiver = nullptr;
+        auto writer = std::make_unique<FrameWriter>();
+        auto mainChannels = (consumes & Subscription::audio) ? frameChannels : 0;
+        auto sidechain = (consumes & Subscription::sidechain) ? frameSidechainChannels : 0;
+        auto aux = (consumes & Subscription::aux) ? frameAuxChannels : 0;
+        writer->setBuses(mainChannels, sidechain, frameChannels, aux, frameChannels + frameSidechainChannels, frameBlockSize);
+        auto channels = mainChannels + sidechain + aux;
+        auto blockSize = frameBlockSize;
+        auto workerRate = getWorkerRate(config, frameSampleRate);
+        if (channels > 0 && workerRate != frameSampleRate) {
+            auto converter = std::make_unique<RateConverter>();
+            converter->prepare(frameChannels, frameBlockSize, frameSampleRate, workerRate, channels);
+            blockSize = converter->getMaxWorkerBlock();
+            rate.set(std::move(converter));
+        }
+        auto quantum = config.getInt("quantum", 0);
+        if (channels > 0 && quantum > 0) {
+            auto quanta = std::make_unique<Reblocker>();
+            quanta->prepare(frameChannels, quantum, blockSize, channels);
+            // same as stftReceiver, only replaced from this thread
+            reblockReceiver = quanta.get();
+            reblock.set(std::move(quanta));
+            blockSize = quantum;
+        }
+        writer->prepare(channels, blockSize, config.getInt("history", 0), config.getInt("lookahead", 0));
+        writer->setSilenceThreshold(getSilenceThreshold(config));
+        warmMain = mainChannels;
+        warmSidechain = sidechain;
+        warmAux = aux;
+        warmBlockSize = blockSize;
+        maxFrameBytes = writer->getMaxMessageSize();
+        frameWriter.set(std::move(writer));
+    }
+
+    // a v2 reply: same slots as the raw frames, so process() doesn't care which it was
+    void receiveFrame(const juce::MemoryBlock& msg, const FrameHeader& header)
+    {
+        if (header.flags & FrameHeader::resync) keyframeRequested = true;
+        if ((int32)(header.seq - lastAcked.load()) > 0) lastAcked = header.seq;
+        auto& sent = sentAt[header.seq % roundTripSlots];
+        if (sent.seq.load() == header.seq) {
+            auto ticks = sent.ticks.exchange(0);
+            if (ticks != 0) {
+                roundTripMicros += juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - ticks) * 1.0e6;
+                roundTrips++;
+            }
+        }
+
+        auto src = (const uint8*)msg.getData() + header.headerBytes;
+        auto numValues = (int)(header.channels * header.samples);
+        auto midiSrc = src + header.getPayloadBytes() - header.midiBytes;
+
+        if (header.kind == FrameHeader::spectrum) {
+            // bins go to the overlap-add, the MIDI still goes through the slots
+            if (stftReceiver != nullptr) stftReceiver->receive(header, src);
+            numValues = 0;
+        }
+        if (header.kind == FrameHeader::control) {
+            if (controlReceiver != nullptr && (header.flags & FrameHeader::float32)) {
+                controlReceiver->receive((const float*)src, numValues);
+            }
+            numValues = 0;
+        }
+        // whatever wasn't subscribed to isn't unpacked, even if it was sent
+        auto subscribed = produces.load();
+        auto silent = (header.flags & FrameHeader::silent) != 0;
+        if (header.kind == FrameHeader::audio && reblockReceiver != nullptr) {
+            // audio goes back at its quantum's place, the MIDI through the slots
+            if (subscribed & Subscription::audio) {
+                reblockReceiver->receive(header.seq, src, (header.flags & FrameHeader::float32) != 0,
+                                         silent ? 0 : (int)header.channels, (int)header.samples);
+            }
+            numValues = 0;
+        }
+        if ((subscribed & Subscription::audio) == 0 || silent) numValues = 0;
+        tmp2->setSize(jmax(1, numValues) * sizeof(float), true);
+        tmpMidi2->setSize(300);
+        tmpMidi2->fillWith(0);
+        if (header.flags & FrameHeader::float32) memcpy(tmp2->getData(), src, numValues * sizeof(float));
+        else SampleConversion::toFloat((float*)tmp2->getData(), (const int16*)src, numValues);
+        if (subscribed & Subscription::midi) tmpMidi2->copyFrom(midiSrc, 0, jmin((int)header.midiBytes, 300));
+        if (cacheReceiver != nullptr && header.kind == FrameHeader::audio) {
+            cacheReceiver->store(header.seq, *tmp2, *tmpMidi2, silent);
+        }
+        audiomsg[seqnum++ % BUF_SIZE].set(*tmp2.get(), *tmpMidi2.get(), seqnum, silent);
+    }
+
     juce::WaitableEvent& stop_signal_;
-    std::unique_ptr<juce::MemoryBlock> memory_block_{ nullptr };
     std::unique_ptr<juce::MemoryBlock> midi_block_{ nullptr };
     std::unique_ptr<juce::MemoryBlock> tmp2{ nullptr };
     std::unique_ptr<juce::MemoryBlock> tmpMidi2{ nullptr };
@@ -155,6 +962,73 @@ private:
     int lastGot = 0;
     int BUF_SIZE = 100;
     std::string timecodeInfo = "";
+    WorkerConfig config;
+    std::function<void(const WorkerConfig&)> onHandshake;
+    Handoff<FrameWriter> frameWriter;
+    Handoff<StftTransport> stft;
+    StftTransport* stftReceiver = nullptr;
+    Handoff<ControlRenderer> control;
+    ControlRenderer* controlReceiver = nullptr;
+    Handoff<SidecarSender> sidecar;
+    size_t maxFrameBytes = 0;
+    Handoff<FeatureTap> features;
+    std::atomic<int> consumes{ Subscription::audio | Subscription::midi };
+    std::atomic<int> produces{ Subscription::audio | Subscription::midi };
+    const MidiBuffer noMidi;
+    std::atomic<bool> keyframeRequested{ false };
+    // deadlines: frameSeq after each block, by block; -1 grace is raw frames
+    enum { deadlineBlocks = 64 };
+    uint32 sentBy[deadlineBlocks] = {};
+    bool hitBy[deadlineBlocks] = {};
+    uint32 blockCount = 0;
+    bool pastDeadline = false;
+    std::atomic<int> replyGrace{ -1 };
+    int frameChannels = 2, frameBlockSize = 512;
+    int frameSidechainChannels = 0, frameAuxChannels = 0;
+    double frameSampleRate = 44100.0;
+    uint32 frameSeq = 0;
+    juce::String sessionId;
+    std::atomic<bool> resuming{ false };
+    std::atomic<uint32> resumeDeadline{ 0 };
+    std::atomic<int> resumeWindowMs{ -1 };          // -1 is no session to hold
+    std::atomic<uint32> socketGeneration{ 0 };      // sockets handed to this object after the first
+    uint32 madeGeneration = 0;                      // message thread, as connectionMade saw it
+    std::atomic<uint32> lastAcked{ ~(uint32)0 };
+    std::atomic<bool> resendRequested{ false };
+    Handoff<ResendBuffer> resend;
+    Pyaudio concealed;
+    float concealGain = 1.0f;
+    Pyaudio* lastReply = &tmp_audio; // whichever gotMsg handed out last
+    Handoff<RateConverter> rate;
+    Handoff<Reblocker> reblock;
+    Reblocker* reblockReceiver = nullptr;
+    Handoff<BlockCache> cache;
+    BlockCache* cacheReceiver = nullptr;
+    std::atomic<uint64> cacheTag{ 0 };
+    Pyaudio cacheHits[2];
+    bool hitPending = false, hitDue = false; // audio thread
+    int hitSlot = 0, dueSlot = 0;
+    Handoff<WireLog> capture;
+    WireLog* captureReceiver = nullptr;
+    Handoff<SharedMemoryLink> shm;
+    SharedMemoryLink* shmReceiver = nullptr;
+    Warmup warmup;
+    int warmMain = 0, warmSidechain = 0, warmAux = 0, warmBlockSize = 0; // the frames' shape, 0 is none
+    juce::File captureDirectory;
+    bool captureHeadersOnly = false;
+    WorkerConfig helloConfig; // as the worker said it, config is at qualityLevel
+    int qualityLevel = 0;
+    juce::String versionName;
+    // when each frame went out, by seq: written on the audio thread, matched
+    // against replies on the message thread
+    enum { roundTripSlots = 256 };
+    struct SentAt {
+        std::atomic<uint32> seq{ 0 };
+        std::atomic<int64> ticks{ 0 };
+    };
+    SentAt sentAt[roundTripSlots];
+    double roundTripMicros = 0.0;
+    int roundTrips = 0;
 protected:
     std::unique_ptr<Pyaudio[]> audiomsg;
 };
@@ -180,31 +1054,109 @@ public:
         if (!connection_) return false;
         return connection_->isConnected();
     }
+    // connected, or inside a session's resume window
+    bool isActive() {
+        return connection_ && connection_->isActive();
+    }
+    uint64 getVersionTag() {
+        return connection_ ? connection_->getVersionTag() : 0;
+    }
+    void requestKeyframe() {
+        if (connection_) connection_->requestKeyframe();
+    }
+    // message thread, null before any worker
+    const Warmup* getWarmup() {
+        return connection_ ? &connection_->getWarmup() : nullptr;
+    }
+    // message thread, see typhon_quality.h; whichever worker comes next starts there
+    WorkerConfig setQualityLevel(int level) {
+        qualityLevel = level;
+        return connection_ ? connection_->setQualityLevel(level) : WorkerConfig();
+    }
+    double takeRoundTripMs() {
+        return connection_ ? connection_->takeRoundTripMs() : -1.0;
+    }
+    void setCapture(const juce::File& directory, bool headersOnly) {
+        captureDirectory = directory;
+        captureHeadersOnly = headersOnly;
+        if (connection_) connection_->setCapture(captureDirectory, captureHeadersOnly);
+    }
     template <typename FloatType>
-    void transmit(AudioBuffer<FloatType>& buffer, MidiBuffer& midiBuffer) {
-        if (isConnected()) {
-            connection_->transmit(buffer, midiBuffer);
+    void transmit(AudioBuffer<FloatType>& buffer, MidiBuffer& midiBuffer, const TransportInfo* transport) {
+        if (isActive()) {
+            connection_->transmit(buffer, midiBuffer, transport);
         }
     }
+    bool renderReplyAudio(AudioBuffer<float>& buffer, int numChannels, int numSamples) {
+        return isActive() && connection_->renderReplyAudio(buffer, numChannels, numSamples);
+    }
+    bool missedDeadline() {
+        return isActive() && connection_->missedDeadline();
+    }
+    bool repliesWithMidi() {
+        return isActive() && connection_->repliesWithMidi();
+    }
     void saveTimecodeInfo(std::string info_) {
         info = info_;
     }
+    void setHandshakeCallback(std::function<void(const WorkerConfig&)> callback) {
+        onHandshake = callback;
+    }
+    // the connection object stays, the audio thread may still be looking at it
+    void disconnectWorker() {
+        if (connection_) connection_->disconnect();
+    }
+    // what prepareToPlay promised. Not every host calls that on the message
+    // thread, and the connection rebuilds its frame pipeline on that one, so
+    // from anywhere else it's posted over
+    void setBlockLayout(int numChannels_, int sidechainChannels_, int auxChannels_, int maxBlockSize_, double sampleRate_) {
+        if (!juce::MessageManager::existsAndIsCurrentThread()) {
+            juce::MessageManager::callAsync([server = juce::WeakReference<IPCServer>(this), numChannels_, sidechainChannels_,
+                                             auxChannels_, maxBlockSize_, sampleRate_] {
+                if (auto* s = server.get()) s->setBlockLayout(numChannels_, sidechainChannels_, auxChannels_, maxBlockSize_, sampleRate_);
+            });
+            return;
+        }
+        numChannels = numChannels_;
+        sidechainChannels = sidechainChannels_;
+        auxChannels = auxChannels_;
+        maxBlockSize = maxBlockSize_;
+        sampleRate = sampleRate_;
+        if (connection_) connection_->setBlockLayout(numChannels, sidechainChannels, auxChannels, maxBlockSize, sampleRate);
+    }
 private:
+    JUCE_DECLARE_WEAK_REFERENCEABLE(IPCServer)
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(IPCServer);
 protected:
     juce::InterprocessConnection* createConnectionObject() override
     {
+        // the same object picks up the socket, its HELO decides whether the
+        // session really carries on
+        if (connection_ && !connection_->isConnected() && connection_->claimForResume()) {
+            return connection_.get();
+        }
         if (connection_) {
             connection_->disconnect();
         }
-        connection_ = std::make_unique<Connection>(stop_signal_);
-        auto conn = connection_.get();
+        // set up before the message thread can see it through connection_
+        auto conn = std::make_unique<Connection>(stop_signal_);
         conn->saveTimecodeInfo(info);
-        return conn;
+        conn->setHandshakeCallback(onHandshake);
+        conn->setBlockLayout(numChannels, sidechainChannels, auxChannels, maxBlockSize, sampleRate);
+        conn->setCapture(captureDirectory, captureHeadersOnly);
+        conn->setQualityLevel(qualityLevel);
+        connection_ = std::move(conn);
+        return connection_.get();
     }
 
     juce::WaitableEvent& stop_signal_;
     std::unique_ptr<Connection> connection_;
     std::string info;
+    std::function<void(const WorkerConfig&)> onHandshake;
+    int numChannels = 2, sidechainChannels = 0, auxChannels = 0, maxBlockSize = 512;
+    double sampleRate = 44100.0;
+    juce::File captureDirectory;
+    bool captureHeadersOnly = false;
+    int qualityLevel = 0;
 };
 
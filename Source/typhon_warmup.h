@@ -0,0 +1,91 @@
+#pragma once
+
+// Warm-up. Torch allocates, compiles and loads kernels the first time it
+// runs, so the first blocks after play come back late. A v2 audio worker is
+// sent a few frames of quiet noise at its negotiated shape as soon as its
+// HELO is in, and again whenever prepareToPlay changes that shape, so the
+// first real block finds it ready:
+//   HELO proto=2;warmup=16;warmupms=10000
+// warmup is how many frames (default 8, 0 for none). They carry the warmup
+// flag and seqs from 0xfff00000 up, and their replies are thrown away; a
+// worker with a context window should leave them out of its ring, and gets a
+// keyframe after them either way. The worker is warm once it has answered
+// them all, or as soon as it says
+//   REDY
+// which a worker that warms itself up can send whenever it's done. If the
+// answers haven't come back within warmupms it's shown as cold.
+
+class Warmup {
+public:
+    enum Status { none, warming, warm, cold };
+    enum : uint32 { firstSeq = 0xfff00000u };
+
+    // message thread: sends `count` frames shaped by `writer` through `send`
+    template <typename Send>
+    void start(FrameWriter& writer, int channels, int blockSize, int count, int timeoutMs, Send&& send) {
+        sent = 0;
+        answered = 0;
+        deadline = Time::getMillisecondCounter() + (uint32)jmax(0, timeoutMs);
+        status = warming;
+        AudioBuffer<float> noise(jmax(1, channels), jmax(1, blockSize));
+        Random random;
+        for (int i = 0; i < count; i++) {
+            // about -40 dBFS, so it isn't sent as silence
+            for (int ch = 0; ch < noise.getNumChannels(); ch++) {
+                auto* data = noise.getWritePointer(ch);
+                for (int s = 0; s < noise.getNumSamples(); s++) data[s] = (random.nextFloat() * 2.0f - 1.0f) * 0.01f;
+            }
+            const auto& frame = writer.write(noise, MidiBuffer(), channels, blockSize, firstSeq + (uint32)i);
+            // the same frame, flagged
+            MemoryBlock message(frame.getData(), frame.getSize());
+            FrameHeader header;
+            FrameHeader::read(message, header);
+            header.flags |= FrameHeader::warmup;
+            header.write((uint8*)message.getData());
+            sent++;
+            send(message);
+        }
+    }
+
+    // message thread: true if `msg` answered a warm-up frame and is done
+    // with; `finished` says it was the last one
+    bool isReply(const MemoryBlock& msg, bool& finished) {
+        finished = false;
+        FrameHeader header;
+        if (!FrameHeader::read(msg, header)) return false;
+        if ((header.flags & FrameHeader::warmup) == 0 && header.seq - firstSeq >= (uint32)sent.load()) return false;
+        if (++answered == sent.load() && status.load() != warm) {
+            status = warm;
+            finished = true;
+        }
+        return true;
+    }
+
+    // "REDY" from the worker
+    static bool isReady(const MemoryBlock& msg) {
+        return msg.getSize() == 4 && memcmp(msg.getData(), "REDY", 4) == 0;
+    }
+
+    void ready() { status = warm; }
+
+    // nothing to warm, or nobody to warm it
+    void stop() {
+        status = none;
+        sent = 0;
+        answered = 0;
+    }
+
+    Status getStatus() const {
+        auto now = status.load();
+        if (now == warming && (int32)(Time::getMillisecondCounter() - deadline.load()) > 0) return cold;
+        return now;
+    }
+
+    int getNumSent() const { return sent.load(); }
+    int getNumAnswered() const { return answered.load(); }
+
+private:
+    std::atomic<Status> status{ none };
+    std::atomic<int> sent{ 0 }, answered{ 0 };
+    std::atomic<uint32> deadline{ 0 };
+};
@@ -0,0 +1,874 @@
+#pragma once
+
+// Worker SDK. Everything a native worker needs to talk to the plugin, in one
+// header with nothing to link but the platform's sockets: the EHLO/HELO
+// handshake, the socket framing, v2 frames read in place, replies built in
+// preallocated buffers, and the shared-memory frames from typhon_shm.h. It is
+// the other end of Connection/IPCServer in Source/typhon_utils.h and speaks
+// wire format v2 only (Source/typhon_protocol.h), so it always says proto=2.
+//
+//   typhon::WorkerConfig config;
+//   config.set("consumes", "audio").set("produces", "audio");
+//   typhon::Worker worker;
+//   if (!worker.connect(config)) return 1;
+//   typhon::FramePool pool(8, worker.getMaxMessageBytes());
+//   typhon::Reply reply(worker.getMaxMessageBytes());
+//   for (;;) {
+//       auto* message = pool.acquire();
+//       typhon::FrameView frame;
+//       auto got = worker.receive(*message, frame);
+//       if (got == typhon::Worker::closed) break;
+//       if (got == typhon::Worker::frame) {
+//           reply.begin(frame.header, frame.header.channels, frame.header.current);
+//           for (int ch = 0; ch < frame.header.channels; ch++) {
+//               frame.toFloat(ch, reply.channel(ch));  // then do something to it
+//           }
+//           worker.send(reply);
+//       }
+//       pool.release(message);
+//   }
+//
+// Nothing allocates once the pool and the reply are made, unless a frame
+// arrives bigger than the buffer it's read into, which then grows once.
+// A Worker is used from one thread; a FramePool from one thread that
+// acquires and one that releases.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#ifdef _WIN32
+  #ifndef NOMINMAX
+    #define NOMINMAX
+  #endif
+  #include <winsock2.h>
+  #include <ws2tcpip.h>
+  #include <windows.h>
+  #pragma comment(lib, "ws2_32.lib")
+#else
+  #include <fcntl.h>
+  #include <netdb.h>
+  #include <netinet/in.h>
+  #include <netinet/tcp.h>
+  #include <poll.h>
+  #include <sys/mman.h>
+  #include <sys/socket.h>
+  #include <sys/stat.h>
+  #include <sys/uio.h>
+  #include <unistd.h>
+#endif
+
+namespace typhon {
+
+// little-endian on the wire whatever this machine is
+namespace wire {
+    inline bool bigEndian() {
+        const uint16_t one = 1;
+        uint8_t first;
+        std::memcpy(&first, &one, 1);
+        return first == 0;
+    }
+    template <typename T> void put(uint8_t* dest, T value) {
+        uint8_t bytes[sizeof(T)];
+        std::memcpy(bytes, &value, sizeof(T));
+        for (size_t i = 0; i < sizeof(T); i++) dest[i] = bytes[bigEndian() ? sizeof(T) - 1 - i : i];
+    }
+    template <typename T> T get(const uint8_t* src) {
+        uint8_t bytes[sizeof(T)];
+        for (size_t i = 0; i < sizeof(T); i++) bytes[bigEndian() ? sizeof(T) - 1 - i : i] = src[i];
+        T value;
+        std::memcpy(&value, bytes, sizeof(T));
+        return value;
+    }
+    // what InterprocessConnection puts before every message
+    enum { magic = 15, prefixBytes = 8 };
+}
+
+// Host position, on frames to a worker that consumes transport.
+struct TransportInfo {
+    enum { size = 40 };
+    enum State { playing = 1, recording = 2, looping = 4 };
+
+    double bpm = 120.0, ppqPosition = 0.0, ppqPositionOfLastBarStart = 0.0;
+    int64_t timeInSamples = 0;
+    uint16_t numerator = 4, denominator = 4;
+    uint32_t state = 0;
+};
+
+// Which input buses the channels are, on frames to a worker that consumes
+// sidechain or aux: main, then sidechain, then aux.
+struct BusLayout {
+    enum { size = 8 };
+
+    uint16_t main = 0, sidechain = 0, aux = 0;
+};
+
+// The same header as the plugin's, field for field.
+struct FrameHeader {
+    enum Kind { audio = 0, spectrum = 1, features = 2, control = 3, batch = 4 };
+    enum Flags { keyframe = 1, resync = 2, float32 = 4, magnitudes = 8, transportInfo = 16, silent = 32, buses = 64, warmup = 128 };
+    enum { size = 44 };
+
+    uint16_t headerBytes = size;
+    uint16_t kind = audio;
+    uint32_t seq = 0;
+    uint16_t channels = 0;
+    uint16_t flags = 0;
+    uint32_t samples = 0;
+    uint32_t history = 0, current = 0, lookahead = 0;
+    int64_t windowOffset = 0;
+    uint32_t midiBytes = 0;
+    TransportInfo transport; // only with the transportInfo flag
+    BusLayout layout;        // only with the buses flag
+
+    int getBusesOffset() const {
+        return size + ((flags & transportInfo) ? (int)TransportInfo::size : 0);
+    }
+
+    // where the payload starts in what write() produces
+    int getHeaderBytes() const {
+        return getBusesOffset() + ((flags & buses) ? (int)BusLayout::size : 0);
+    }
+
+    uint64_t getPayloadBytes() const {
+        auto bytesPerSample = (flags & float32) ? sizeof(float) : sizeof(int16_t);
+        return (uint64_t)channels * samples * bytesPerSample + midiBytes;
+    }
+
+    void write(uint8_t* dest) const {
+        std::memcpy(dest, "TYFR", 4);
+        wire::put(dest + 4, (uint16_t)getHeaderBytes());
+        wire::put(dest + 6, kind);
+        wire::put(dest + 8, seq);
+        wire::put(dest + 12, channels);
+        wire::put(dest + 14, flags);
+        wire::put(dest + 16, samples);
+        wire::put(dest + 20, history);
+        wire::put(dest + 24, current);
+        wire::put(dest + 28, lookahead);
+        wire::put(dest + 32, windowOffset);
+        wire::put(dest + 40, midiBytes);
+        if (flags & transportInfo) {
+            auto t = dest + size;
+            wire::put(t, transport.bpm);
+            wire::put(t + 8, transport.ppqPosition);
+            wire::put(t + 16, transport.ppqPositionOfLastBarStart);
+            wire::put(t + 24, transport.timeInSamples);
+            wire::put(t + 32, transport.numerator);
+            wire::put(t + 34, transport.denominator);
+            wire::put(t + 36, transport.state);
+        }
+        if (flags & buses) {
+            auto b = dest + getBusesOffset();
+            wire::put(b, layout.main);
+            wire::put(b + 2, layout.sidechain);
+            wire::put(b + 4, layout.aux);
+            wire::put(b + 6, (uint16_t)0);
+        }
+    }
+
+    // false if this isn't a v2 frame or its sizes don't add up
+    bool read(const uint8_t* src, size_t bytes) {
+        if (bytes < size || std::memcmp(src, "TYFR", 4) != 0) return false;
+        headerBytes = wire::get<uint16_t>(src + 4);
+        kind = wire::get<uint16_t>(src + 6);
+        seq = wire::get<uint32_t>(src + 8);
+        channels = wire::get<uint16_t>(src + 12);
+        flags = wire::get<uint16_t>(src + 14);
+        samples = wire::get<uint32_t>(src + 16);
+        history = wire::get<uint32_t>(src + 20);
+        current = wire::get<uint32_t>(src + 24);
+        lookahead = wire::get<uint32_t>(src + 28);
+        windowOffset = wire::get<int64_t>(src + 32);
+        midiBytes = wire::get<uint32_t>(src + 40);
+        if ((flags & transportInfo) && headerBytes >= size + TransportInfo::size && bytes >= size + TransportInfo::size) {
+            auto t = src + size;
+            transport.bpm = wire::get<double>(t);
+            transport.ppqPosition = wire::get<double>(t + 8);
+            transport.ppqPositionOfLastBarStart = wire::get<double>(t + 16);
+            transport.timeInSamples = wire::get<int64_t>(t + 24);
+            transport.numerator = wire::get<uint16_t>(t + 32);
+            transport.denominator = wire::get<uint16_t>(t + 34);
+            transport.state = wire::get<uint32_t>(t + 36);
+        }
+        if ((flags & buses) && headerBytes >= getHeaderBytes() && bytes >= (size_t)getHeaderBytes()) {
+            auto b = src + getBusesOffset();
+            layout.main = wire::get<uint16_t>(b);
+            layout.sidechain = wire::get<uint16_t>(b + 2);
+            layout.aux = wire::get<uint16_t>(b + 4);
+        }
+        return headerBytes >= size && (uint64_t)headerBytes + getPayloadBytes() <= (uint64_t)bytes;
+    }
+};
+
+// What the worker says about itself, sent as "HELO key=value;..." after the
+// plugin's EHLO. The keys are the ones in the plugin's protocol docs.
+class WorkerConfig {
+public:
+    WorkerConfig& set(const std::string& key, const std::string& value) {
+        for (auto& pair : values) {
+            if (pair.first == key) {
+                pair.second = value;
+                return *this;
+            }
+        }
+        values.emplace_back(key, value);
+        return *this;
+    }
+    WorkerConfig& set(const std::string& key, long long value) { return set(key, std::to_string(value)); }
+
+    std::string get(const std::string& key, const std::string& fallback = {}) const {
+        for (auto& pair : values) {
+            if (pair.first == key) return pair.second;
+        }
+        return fallback;
+    }
+
+    std::string toMessage() const {
+        std::string text = "HELO ";
+        for (size_t i = 0; i < values.size(); i++) {
+            if (i > 0) text += ';';
+            text += values[i].first + '=' + values[i].second;
+        }
+        return text;
+    }
+
+private:
+    std::vector<std::pair<std::string, std::string>> values;
+};
+
+// One message as it came off the wire, in a buffer that's reused.
+class Message {
+public:
+    explicit Message(size_t capacity_ = 0) { reserve(capacity_); }
+
+    const uint8_t* data() const { return bytes.get(); }
+    uint8_t* data() { return bytes.get(); }
+    size_t size() const { return used; }
+    size_t capacity() const { return room; }
+
+    // only allocates if it has to grow
+    void resize(size_t size) {
+        reserve(size);
+        used = size;
+    }
+
+    void reserve(size_t size) {
+        if (size <= room) return;
+        auto grown = std::unique_ptr<uint8_t[]>(new uint8_t[size]);
+        if (used > 0) std::memcpy(grown.get(), bytes.get(), std::min(used, size));
+        bytes = std::move(grown);
+        room = size;
+    }
+
+    // text messages (RSUM, ..) as a string
+    std::string text() const { return std::string((const char*)data(), used); }
+
+private:
+    std::unique_ptr<uint8_t[]> bytes;
+    size_t used = 0, room = 0;
+};
+
+// Preallocated messages, so a worker that keeps a few frames in flight
+// (batching, a GPU queue) never allocates for them. One thread acquires and
+// one releases; acquire() is null when they're all out.
+class FramePool {
+public:
+    FramePool(int count, size_t capacity) : slots((size_t)count + 1) {
+        for (int i = 0; i < count; i++) {
+            messages.emplace_back(new Message(capacity));
+            slots[(size_t)i] = messages.back().get();
+        }
+        head = (size_t)count;
+    }
+
+    Message* acquire() {
+        auto t = tail.load(std::memory_order_relaxed);
+        if (t == head.load(std::memory_order_acquire)) return nullptr;
+        auto* message = slots[t];
+        tail.store((t + 1) % slots.size(), std::memory_order_release);
+        return message;
+    }
+
+    void release(Message* message) {
+        auto h = head.load(std::memory_order_relaxed);
+        slots[h] = message;
+        head.store((h + 1) % slots.size(), std::memory_order_release);
+    }
+
+private:
+    std::vector<std::unique_ptr<Message>> messages;
+    std::vector<Message*> slots;
+    std::atomic<size_t> head{ 0 }, tail{ 0 };
+};
+
+// A v2 frame read in place: the header is decoded, the samples and MIDI are
+// pointers into the message, which has to outlive the view.
+struct FrameView {
+    FrameHeader header;
+    const uint8_t* payload = nullptr;
+
+    bool parse(const Message& message) { return parse(message.data(), message.size()); }
+
+    bool parse(const uint8_t* data, size_t size) {
+        payload = nullptr;
+        if (!header.read(data, size)) return false;
+        payload = data + header.headerBytes;
+        return true;
+    }
+
+    bool isFloat() const { return (header.flags & FrameHeader::float32) != 0; }
+    bool isSilent() const { return (header.flags & FrameHeader::silent) != 0; }
+    bool isKeyframe() const { return (header.flags & FrameHeader::keyframe) != 0; }
+    // throwaway noise sent before any real audio, answer it like any other
+    bool isWarmup() const { return (header.flags & FrameHeader::warmup) != 0; }
+
+    // one channel's samples, null when they're the other type or not there
+    const int16_t* int16Channel(int ch) const {
+        if (isFloat() || ch >= header.channels || header.samples == 0) return nullptr;
+        return (const int16_t*)payload + (size_t)ch * header.samples;
+    }
+    const float* floatChannel(int ch) const {
+        if (!isFloat() || ch >= header.channels || header.samples == 0) return nullptr;
+        return (const float*)payload + (size_t)ch * header.samples;
+    }
+
+    // how many samples toFloat() writes: the payload's, or `current` zeros
+    // for a silent frame
+    uint32_t numSamples() const { return header.samples > 0 ? header.samples : header.current; }
+
+    // one channel as float. Without a context window that's the block.
+    void toFloat(int ch, float* dest) const {
+        if (auto* f = floatChannel(ch)) {
+            std::memcpy(dest, f, header.samples * sizeof(float));
+        } else if (auto* s = int16Channel(ch)) {
+            for (uint32_t i = 0; i < header.samples; i++) dest[i] = (float)s[i] * (1.0f / 32768.0f);
+        } else {
+            std::fill(dest, dest + numSamples(), 0.0f);
+        }
+    }
+
+    // 3-byte short messages, midiBytes of them
+    const uint8_t* midi() const { return payload + header.getPayloadBytes() - header.midiBytes; }
+    int numMidiEvents() const { return (int)(header.midiBytes / 3); }
+};
+
+// The history/lookahead window a worker asks for, kept the way the protocol
+// says: each frame's samples go in at windowOffset, keyframes fill the lot.
+class ContextWindow {
+public:
+    void prepare(int channels_, uint32_t history_, uint32_t maxBlock, uint32_t lookahead_) {
+        channels = channels_;
+        history = history_;
+        lookahead = lookahead_;
+        ringSize = (int64_t)history + lookahead + maxBlock;
+        ring.assign((size_t)channels * (size_t)ringSize, 0.0f);
+        scratch.resize((size_t)ringSize);
+        expected = -1;
+    }
+
+    // false if a frame went missing and the window can't be trusted; answer
+    // with Reply::requestResync() until the next keyframe
+    bool write(const FrameView& view) {
+        // warm-up noise stays out of the window, a keyframe follows it
+        if (view.isWarmup()) return true;
+        auto& h = view.header;
+        auto count = (int64_t)view.numSamples();
+        if (!view.isKeyframe() && h.windowOffset != expected) return false;
+        if (count > ringSize) return false;
+        for (int ch = 0; ch < channels; ch++) {
+            view.toFloat(ch, scratch.data());
+            auto* dest = &ring[(size_t)ch * (size_t)ringSize];
+            for (int64_t i = 0; i < count; i++) dest[wrap(h.windowOffset + i)] = scratch[(size_t)i];
+        }
+        expected = h.windowOffset + count;
+        end = expected;
+        current = h.current;
+        return true;
+    }
+
+    // history + current + lookahead samples of a channel, oldest first
+    uint32_t size() const { return history + current + lookahead; }
+
+    void read(int ch, float* dest) const {
+        auto* src = &ring[(size_t)ch * (size_t)ringSize];
+        auto start = end - (int64_t)size();
+        for (uint32_t i = 0; i < size(); i++) dest[i] = src[wrap(start + i)];
+    }
+
+private:
+    size_t wrap(int64_t position) const { return (size_t)(((position % ringSize) + ringSize) % ringSize); }
+
+    int channels = 0;
+    uint32_t history = 0, lookahead = 0, current = 0;
+    int64_t ringSize = 1, expected = -1, end = 0;
+    std::vector<float> ring, scratch;
+};
+
+// A reply built in place in one preallocated buffer, float32 planar samples
+// then 3-byte MIDI.
+class Reply {
+public:
+    enum { maxMidiBytes = 300 };
+
+    explicit Reply(size_t capacity) : message(capacity) {}
+
+    // answers `to` with this many channels and samples, zeroed
+    void begin(const FrameHeader& to, int channels, int samples) {
+        header = FrameHeader();
+        header.kind = to.kind;
+        header.seq = to.seq;
+        header.channels = (uint16_t)channels;
+        header.samples = (uint32_t)samples;
+        header.current = to.current;
+        header.windowOffset = to.windowOffset;
+        header.flags = FrameHeader::float32 | (to.flags & FrameHeader::warmup);
+        message.resize(FrameHeader::size + (size_t)channels * samples * sizeof(float) + maxMidiBytes);
+        std::memset(samplesStart(), 0, (size_t)channels * samples * sizeof(float));
+    }
+
+    float* channel(int ch) { return (float*)samplesStart() + (size_t)ch * header.samples; }
+
+    // no samples, the plugin clears the block
+    void setSilent() {
+        header.flags |= FrameHeader::silent;
+        header.channels = 0;
+        header.samples = 0;
+    }
+
+    // lost track of the context window, the next frame should be a keyframe
+    void requestResync() { header.flags |= FrameHeader::resync; }
+
+    bool addMidi(uint8_t status, uint8_t data1, uint8_t data2) {
+        if (header.midiBytes + 3 > maxMidiBytes) return false;
+        midiEvents[header.midiBytes] = status;
+        midiEvents[header.midiBytes + 1] = data1;
+        midiEvents[header.midiBytes + 2] = data2;
+        header.midiBytes += 3;
+        return true;
+    }
+
+    // the finished message, valid until the next begin()
+    const Message& finish() {
+        auto sampleBytes = (size_t)header.channels * header.samples * sizeof(float);
+        // a silent reply drops its samples, the MIDI moves up behind the header
+        std::memcpy(samplesStart() + sampleBytes, midiEvents, header.midiBytes);
+        message.resize(FrameHeader::size + sampleBytes + header.midiBytes);
+        header.write(message.data());
+        return message;
+    }
+
+    FrameHeader header;
+
+private:
+    uint8_t* samplesStart() { return message.data() + FrameHeader::size; }
+
+    Message message;
+    uint8_t midiEvents[maxMidiBytes];
+};
+
+// The plugin's socket: every message is u32 magic, u32 size, then the bytes.
+class Socket {
+public:
+#ifdef _WIN32
+    using Handle = SOCKET;
+    static constexpr Handle invalid = INVALID_SOCKET;
+#else
+    using Handle = int;
+    static constexpr Handle invalid = -1;
+#endif
+
+    Socket() {
+#ifdef _WIN32
+        WSADATA data;
+        WSAStartup(MAKEWORD(2, 2), &data);
+#endif
+    }
+
+    ~Socket() {
+        close();
+#ifdef _WIN32
+        WSACleanup();
+#endif
+    }
+
+    bool connect(const std::string& host, int port) {
+        close();
+        addrinfo hints{}, *found = nullptr;
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &found) != 0) return false;
+        for (auto* at = found; at != nullptr && handle == invalid; at = at->ai_next) {
+            handle = ::socket(at->ai_family, at->ai_socktype, at->ai_protocol);
+            if (handle == invalid) continue;
+            if (::connect(handle, at->ai_addr, (int)at->ai_addrlen) != 0) close();
+        }
+        freeaddrinfo(found);
+        if (handle == invalid) return false;
+        // frames are small and late ones are useless
+        int on = 1;
+        setsockopt(handle, IPPROTO_TCP, TCP_NODELAY, (const char*)&on, sizeof(on));
+        return true;
+    }
+
+    void close() {
+        if (handle == invalid) return;
+#ifdef _WIN32
+        closesocket(handle);
+#else
+        ::close(handle);
+#endif
+        handle = invalid;
+    }
+
+    bool isOpen() const { return handle != invalid; }
+
+    // the prefix and the message in one call, no copy
+    bool send(const uint8_t* data, size_t size) {
+        uint8_t prefix[wire::prefixBytes];
+        wire::put(prefix, (uint32_t)wire::magic);
+        wire::put(prefix + 4, (uint32_t)size);
+#ifdef _WIN32
+        WSABUF parts[2] = { { (ULONG)sizeof(prefix), (char*)prefix }, { (ULONG)size, (char*)data } };
+        DWORD sent = 0;
+        if (WSASend(handle, parts, 2, &sent, 0, nullptr, nullptr) != 0) return false;
+        size_t total = sent;
+#else
+        iovec parts[2] = { { prefix, sizeof(prefix) }, { (void*)data, size } };
+        auto sent = ::writev(handle, parts, 2);
+        if (sent < 0) return false;
+        auto total = (size_t)sent;
+#endif
+        // whatever didn't make it in one go
+        if (total < sizeof(prefix) && !sendAll(prefix + total, sizeof(prefix) - total)) return false;
+        auto done = total > sizeof(prefix) ? total - sizeof(prefix) : 0;
+        return sendAll(data + done, size - done);
+    }
+
+    // blocks for a whole message, false when the plugin has gone
+    bool receive(Message& message) {
+        uint8_t prefix[wire::prefixBytes];
+        if (!receiveAll(prefix, sizeof(prefix))) return false;
+        if (wire::get<uint32_t>(prefix) != (uint32_t)wire::magic) {
+            // out of step with the stream, nothing after this can be trusted
+            close();
+            return false;
+        }
+        message.resize(wire::get<uint32_t>(prefix + 4));
+        return receiveAll(message.data(), message.size());
+    }
+
+    // true if there's something to read within timeoutMs
+    bool waitForData(int timeoutMs) {
+#ifdef _WIN32
+        WSAPOLLFD fd{ handle, POLLRDNORM, 0 };
+        return WSAPoll(&fd, 1, timeoutMs) > 0;
+#else
+        pollfd fd{ handle, POLLIN, 0 };
+        return ::poll(&fd, 1, timeoutMs) > 0;
+#endif
+    }
+
+private:
+    bool sendAll(const uint8_t* data, size_t size) {
+        while (size > 0) {
+            auto sent = ::send(handle, (const char*)data, (int)size, 0);
+            if (sent <= 0) return false;
+            data += sent;
+            size -= (size_t)sent;
+        }
+        return true;
+    }
+
+    bool receiveAll(uint8_t* data, size_t size) {
+        while (size > 0) {
+            auto got = ::recv(handle, (char*)data, (int)size, 0);
+            if (got <= 0) {
+                close();
+                return false;
+            }
+            data += got;
+            size -= (size_t)got;
+        }
+        return true;
+    }
+
+    Handle handle = invalid;
+};
+
+// The worker's side of Source/typhon_shm.h: a file it creates and maps, one
+// ring of frames each way. Only the frames go through it, the socket still
+// carries the handshake and the text messages.
+class SharedMemory {
+public:
+    enum { headerBytes = 64, controlBytes = 128, format = 1 };
+    static constexpr uint32_t wrapMarker = 0xffffffffu;
+
+    ~SharedMemory() { close(); }
+
+    // somewhere in memory if the platform has it, the temp directory if not
+    static std::string defaultPath() {
+        auto name = "typhon-" + std::to_string(processId()) + "-" +
+                    std::to_string(std::chrono::steady_clock::now().time_since_epoch().count());
+#ifdef _WIN32
+        char dir[MAX_PATH + 1];
+        auto length = GetTempPathA(MAX_PATH, dir);
+        return std::string(dir, length) + name;
+#else
+        struct stat info;
+        if (stat("/dev/shm", &info) == 0) return "/dev/shm/" + name;
+        auto* dir = std::getenv("TMPDIR");
+        return std::string(dir != nullptr ? dir : "/tmp") + "/" + name;
+#endif
+    }
+
+    // a new file at `path`, ringBytes each way (rounded up to 8)
+    bool create(const std::string& path_, uint32_t ringBytes_) {
+        close();
+        path = path_;
+        ringBytes = (ringBytes_ + 7) & ~7u;
+        size = (size_t)headerBytes + 2 * ((size_t)controlBytes + ringBytes);
+#ifdef _WIN32
+        file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                           nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_TEMPORARY, nullptr);
+        if (file == INVALID_HANDLE_VALUE) return false;
+        mapping = CreateFileMappingA(file, nullptr, PAGE_READWRITE, (DWORD)((uint64_t)size >> 32), (DWORD)size, nullptr);
+        if (mapping == nullptr) return fail();
+        base = (uint8_t*)MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, size);
+        if (base == nullptr) return fail();
+#else
+        auto fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+        if (fd < 0) return false;
+        if (::ftruncate(fd, (off_t)size) != 0) {
+            ::close(fd);
+            return fail();
+        }
+        auto* mapped = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (mapped == MAP_FAILED) return fail();
+        base = (uint8_t*)mapped;
+#endif
+        std::memset(base, 0, size);
+        std::memcpy(base, "TYSH", 4);
+        wire::put(base + 4, (uint32_t)format);
+        wire::put(base + 8, ringBytes);
+        toWorker = ringAt(base + headerBytes);
+        fromWorker = ringAt(base + headerBytes + controlBytes + ringBytes);
+        return true;
+    }
+
+    // unmaps and removes the file
+    void close() {
+        if (base != nullptr) {
+#ifdef _WIN32
+            UnmapViewOfFile(base);
+#else
+            ::munmap(base, size);
+#endif
+            base = nullptr;
+        }
+#ifdef _WIN32
+        if (mapping != nullptr) CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+        mapping = nullptr;
+        file = INVALID_HANDLE_VALUE;
+        if (!path.empty()) DeleteFileA(path.c_str());
+#else
+        if (!path.empty()) ::unlink(path.c_str());
+#endif
+        path.clear();
+    }
+
+    bool isOpen() const { return base != nullptr; }
+    const std::string& getPath() const { return path; }
+    uint32_t getRingBytes() const { return ringBytes; }
+
+    // a reply to the plugin, false if its ring is full
+    bool send(const uint8_t* data, size_t bytes) {
+        auto& ring = fromWorker;
+        auto recordSize = recordBytes((uint32_t)bytes);
+        auto head = ring.head->load(std::memory_order_relaxed);
+        auto at = (uint32_t)(head % ringBytes);
+        auto skip = at + recordSize > ringBytes ? ringBytes - at : 0;
+        if (head + skip + recordSize - ring.tail->load(std::memory_order_acquire) > ringBytes) return false;
+        if (skip > 0) {
+            wire::put(ring.data + at, wrapMarker);
+            at = 0;
+        }
+        wire::put(ring.data + at, (uint32_t)bytes);
+        std::memcpy(ring.data + at + 4, data, bytes);
+        ring.head->store(head + skip + recordSize, std::memory_order_release);
+        return true;
+    }
+
+    // the next frame from the plugin if there is one, without waiting
+    bool receive(Message& message) {
+        auto& ring = toWorker;
+        auto head = ring.head->load(std::memory_order_acquire);
+        auto tail = ring.tail->load(std::memory_order_relaxed);
+        while (tail != head) {
+            auto at = (uint32_t)(tail % ringBytes);
+            auto bytes = wire::get<uint32_t>(ring.data + at);
+            if (bytes == wrapMarker) {
+                tail += ringBytes - at;
+                continue;
+            }
+            message.resize(bytes);
+            std::memcpy(message.data(), ring.data + at + 4, bytes);
+            ring.tail->store(tail + recordBytes(bytes), std::memory_order_release);
+            return true;
+        }
+        ring.tail->store(tail, std::memory_order_release);
+        return false;
+    }
+
+private:
+    struct Ring {
+        std::atomic<uint64_t>* head = nullptr;
+        std::atomic<uint64_t>* tail = nullptr;
+        uint8_t* data = nullptr;
+    };
+    static_assert(std::atomic<uint64_t>::is_always_lock_free, "the rings are shared with another process");
+
+    static Ring ringAt(uint8_t* at) {
+        return { reinterpret_cast<std::atomic<uint64_t>*>(at), reinterpret_cast<std::atomic<uint64_t>*>(at + 64), at + controlBytes };
+    }
+
+    static uint32_t recordBytes(uint32_t bytes) { return (4 + bytes + 7) & ~7u; }
+
+    static long long processId() {
+#ifdef _WIN32
+        return (long long)GetCurrentProcessId();
+#else
+        return (long long)::getpid();
+#endif
+    }
+
+    bool fail() {
+        close();
+        return false;
+    }
+
+    std::string path;
+    uint32_t ringBytes = 0;
+    size_t size = 0;
+    uint8_t* base = nullptr;
+    Ring toWorker, fromWorker;
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE, mapping = nullptr;
+#endif
+};
+
+// One worker connection, the other end of the plugin's Connection.
+class Worker {
+public:
+    enum Received { frame, text, closed };
+
+    struct Options {
+        std::string host = "127.0.0.1";
+        int port = 11586;
+        // frames through shared memory (typhon_shm.h) rather than the socket
+        bool sharedMemory = false;
+        uint32_t ringBytes = 4 << 20;
+        int spinMicros = 200;
+        // the biggest frame expected, for the pools; bigger ones still work
+        size_t maxMessageBytes = 64 << 10;
+    };
+
+    Worker() = default;
+    explicit Worker(Options options_) : options(std::move(options_)) {}
+
+    // connects, waits for the EHLO and answers with the config as HELO
+    bool connect(const WorkerConfig& config) {
+        if (!socket.connect(options.host, options.port)) return false;
+        Message hello(256);
+        if (!socket.receive(hello) || hello.size() < 4 || std::memcmp(hello.data(), "EHLO", 4) != 0) {
+            socket.close();
+            return false;
+        }
+        // EHLO<bpm>BYE
+        auto greeting = hello.text();
+        tempoInfo = greeting.substr(4, greeting.size() >= 7 ? greeting.size() - 7 : 0);
+
+        WorkerConfig sent = config;
+        sent.set("proto", 2);
+        if (options.sharedMemory && memory.create(SharedMemory::defaultPath(), options.ringBytes)) {
+            sent.set("shm", memory.getPath());
+            sent.set("shmspin", options.spinMicros);
+        }
+        return sendText(sent.toMessage());
+    }
+
+    void disconnect() {
+        socket.close();
+        memory.close();
+    }
+
+    bool isConnected() const { return socket.isOpen(); }
+    bool usesSharedMemory() const { return memory.isOpen(); }
+
+    // what the plugin put in its EHLO, the host's tempo
+    const std::string& getTempoInfo() const { return tempoInfo; }
+    size_t getMaxMessageBytes() const { return options.maxMessageBytes; }
+
+    // blocks for the next message; a frame is parsed into `view`, which
+    // points into `message`
+    Received receive(Message& message, FrameView& view) {
+        for (;;) {
+            if (!memory.isOpen()) {
+                if (!socket.receive(message)) return closed;
+                return view.parse(message) ? frame : text;
+            }
+            // frames from the file, the odd text message (RSUM) off the socket
+            if (memory.receive(message) && view.parse(message)) {
+                lastFrame = std::chrono::steady_clock::now();
+                return frame;
+            }
+            auto idle = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - lastFrame).count();
+            if (socket.waitForData(idle < options.spinMicros ? 0 : 1)) {
+                if (!socket.receive(message)) return closed;
+                return view.parse(message) ? frame : text;
+            }
+            if (!socket.isOpen()) return closed;
+            if (idle < options.spinMicros) std::this_thread::yield();
+        }
+    }
+
+    bool send(Reply& reply) {
+        auto& message = reply.finish();
+        return send(message.data(), message.size());
+    }
+
+    // a frame built some other way
+    bool send(const uint8_t* data, size_t size) {
+        if (memory.isOpen()) return memory.send(data, size);
+        return socket.send(data, size);
+    }
+
+    bool sendText(const std::string& message) {
+        return socket.send((const uint8_t*)message.data(), message.size());
+    }
+
+    // a deterministic worker's replies are cached under this, see typhon_cache.h
+    bool setVersion(const std::string& tag) { return sendText("VERS " + tag); }
+
+    // warmed up some other way than the plugin's warm-up frames, see typhon_warmup.h
+    bool sendReady() { return sendText("REDY"); }
+
+private:
+    Options options;
+    Socket socket;
+    SharedMemory memory;
+    std::string tempoInfo;
+    std::chrono::steady_clock::time_point lastFrame = std::chrono::steady_clock::now();
+};
+
+} // namespace typhon
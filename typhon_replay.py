@@ -0,0 +1,292 @@
+#!/usr/bin/env python3
+"""Replay a wire capture (.tycap, see Source/typhon_capture.h).
+
+    python typhon_replay.py info    capture.tycap
+    python typhon_replay.py worker  capture.tycap [--fast]
+    python typhon_replay.py plugin  capture.tycap [--fast --window 4]
+
+worker: stands in for the worker. Connects to the plugin like a notebook
+would and sends back what the worker sent, at the recorded times (or as
+soon as each frame it answers arrives with --fast). Reports how regularly
+the plugin's frames came in.
+
+plugin: stands in for the plugin. Listens where the plugin would, and when a
+worker connects sends it what the plugin sent, at the recorded times (or
+with --fast, the next frame as soon as fewer than --window are unanswered).
+Reports round-trip latency per frame and throughput.
+
+Only the standard library, so it runs next to any worker.
+"""
+
+import argparse
+import mmap
+import socket
+import struct
+import threading
+import time
+
+MAGIC = 15  # the plugin's InterprocessConnection magic number
+TO_WORKER, FROM_WORKER = 0, 1
+NOT_A_FRAME = 0xFFFF
+
+RECORD = struct.Struct('<IIqIHHB7x')
+FOOTER = struct.Struct('<4sIqII')
+
+
+class Record:
+    __slots__ = ('direction', 'micros', 'seq', 'kind', 'flags', 'wire_bytes', 'message')
+
+    def is_frame(self):
+        # v2 frames, or v1 raw audio; the text messages are never answered
+        return self.kind != NOT_A_FRAME or not self.message[:4].isalpha()
+
+
+def read_capture(path):
+    """Every record in the file, in order, plus the header fields."""
+    with open(path, 'rb') as f:
+        data = mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ)
+    if data[:4] != b'TYCP':
+        raise ValueError('%s is not a capture' % path)
+    fmt, start_ms, flags = struct.unpack_from('<IqI', data, 4)
+    headers_only = bool(flags & 1)
+
+    offsets, dropped = None, 0
+    if len(data) >= 64 + FOOTER.size:
+        tag, count, index, footer_dropped, _ = FOOTER.unpack_from(data, len(data) - FOOTER.size)
+        if tag == b'TYIX':
+            offsets = struct.unpack_from('<%dQ' % count, data, index)
+            dropped = footer_dropped
+    if offsets is None:
+        # never closed, walk the records until they stop making sense
+        offsets, at, end = [], 64, len(data)
+        while at + RECORD.size <= end:
+            stored = RECORD.unpack_from(data, at)[0]
+            if at + RECORD.size + stored > end:
+                break
+            offsets.append(at)
+            at += RECORD.size + stored + (-stored % 8)
+
+    records = []
+    for at in offsets:
+        stored, wire, micros, seq, kind, fl, direction = RECORD.unpack_from(data, at)
+        r = Record()
+        r.direction, r.micros, r.seq, r.kind, r.flags, r.wire_bytes = direction, micros, seq, kind, fl, wire
+        body = data[at + RECORD.size:at + RECORD.size + stored]
+        # a headers-only capture is padded back out to the size it was sent at
+        r.message = body + bytes(wire - stored) if stored < wire else body
+        records.append(r)
+    return {'format': fmt, 'start_ms': start_ms, 'headers_only': headers_only,
+            'dropped': dropped, 'records': records}
+
+
+def send(sock, message):
+    sock.sendall(struct.pack('<II', MAGIC, len(message)) + message)
+
+
+def receive(sock):
+    """One message, or None when the other side has gone."""
+    header = _read_exactly(sock, 8)
+    if header is None:
+        return None
+    magic, size = struct.unpack('<II', header)
+    if magic != MAGIC:
+        raise ValueError('lost sync with the other side')
+    return _read_exactly(sock, size)
+
+
+def _read_exactly(sock, n):
+    chunks = bytearray()
+    while len(chunks) < n:
+        chunk = sock.recv(n - len(chunks))
+        if not chunk:
+            return None
+        chunks += chunk
+    return bytes(chunks)
+
+
+def frame_seq(message):
+    if len(message) >= 12 and message[:4] == b'TYFR':
+        return struct.unpack_from('<I', message, 8)[0]
+    return None
+
+
+def percentiles(values, points=(50, 90, 99)):
+    if not values:
+        return {}
+    ordered = sorted(values)
+    out = {p: ordered[min(len(ordered) - 1, int(len(ordered) * p / 100))] for p in points}
+    out['max'] = ordered[-1]
+    return out
+
+
+def report(title, values_ms):
+    stats = percentiles(values_ms)
+    if not stats:
+        print('%s: none' % title)
+        return
+    print('%s: n=%d mean=%.3f p50=%.3f p90=%.3f p99=%.3f max=%.3f ms' % (
+        title, len(values_ms), sum(values_ms) / len(values_ms),
+        stats[50], stats[90], stats[99], stats['max']))
+
+
+def pace(t0, micros, fast):
+    if fast:
+        return
+    delay = t0 + micros / 1e6 - time.perf_counter()
+    if delay > 0:
+        time.sleep(delay)
+
+
+def info(capture):
+    records = capture['records']
+    print('format %d, %s, %d records, %d dropped while capturing' % (
+        capture['format'], 'headers only' if capture['headers_only'] else 'full',
+        len(records), capture['dropped']))
+    if not records:
+        return
+    print('%.3f s of traffic, starting %s' % (
+        (records[-1].micros - records[0].micros) / 1e6,
+        time.strftime('%Y-%m-%d %H:%M:%S', time.localtime(capture['start_ms'] / 1000))))
+    for direction, name in ((TO_WORKER, 'to worker'), (FROM_WORKER, 'from worker')):
+        mine = [r for r in records if r.direction == direction]
+        kinds = {}
+        for r in mine:
+            kinds[r.kind] = kinds.get(r.kind, 0) + 1
+        print('%s: %d messages, %d bytes, kinds %s' % (
+            name, len(mine), sum(r.wire_bytes for r in mine),
+            ', '.join('%s=%d' % ('text/raw' if k == NOT_A_FRAME else k, n) for k, n in sorted(kinds.items()))))
+        frames = [r for r in mine if r.is_frame()]
+        report('  %s interval' % name, [(b.micros - a.micros) / 1e3 for a, b in zip(frames, frames[1:])])
+
+
+def as_worker(capture, host, port, fast):
+    records = capture['records']
+    ours = [r for r in records if r.direction == FROM_WORKER]
+    sock = socket.create_connection((host, port))
+    sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+    hello = receive(sock)
+    if hello is None or not hello.startswith(b'EHLO'):
+        raise ValueError('expected EHLO from the plugin')
+    t0 = time.perf_counter()
+    origin = next((r.micros for r in records if r.direction == TO_WORKER), 0)
+
+    arrivals, arrived = [], threading.Semaphore(0)
+
+    def listen():
+        while True:
+            message = receive(sock)
+            if message is None:
+                return
+            arrivals.append(time.perf_counter())
+            arrived.release()
+
+    threading.Thread(target=listen, daemon=True).start()
+    sent = 0
+    for r in ours:
+        if fast and r.is_frame():
+            # one reply per frame the plugin sends
+            if not arrived.acquire(timeout=2.0):
+                break
+        pace(t0, r.micros - origin, fast)
+        send(sock, r.message)
+        sent += 1
+    time.sleep(0.2)
+    sock.close()
+
+    elapsed = (arrivals[-1] - arrivals[0]) if len(arrivals) > 1 else 0.0
+    print('sent %d of %d recorded replies, got %d frames from the plugin' % (sent, len(ours), len(arrivals)))
+    if elapsed > 0:
+        print('plugin sent %.1f frames/s' % ((len(arrivals) - 1) / elapsed))
+    report('plugin frame interval', [(b - a) * 1e3 for a, b in zip(arrivals, arrivals[1:])])
+
+
+def as_plugin(capture, host, port, fast, window, timeout):
+    records = capture['records']
+    ours = [r for r in records if r.direction == TO_WORKER]
+    server = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+    server.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    server.bind((host, port))
+    server.listen(1)
+    print('waiting for a worker on %s:%d' % (host, port))
+    sock, _ = server.accept()
+    sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+
+    lock = threading.Condition()
+    pending = {}      # seq (or position for v1) -> when it went out
+    unanswered = []   # v1 frames carry no seq, their replies come back in order
+    latencies, replies = [], [0]
+
+    def listen():
+        while True:
+            message = receive(sock)
+            if message is None:
+                with lock:
+                    lock.notify_all()
+                return
+            now = time.perf_counter()
+            seq = frame_seq(message)
+            with lock:
+                if seq is not None and seq in pending:
+                    latencies.append((now - pending.pop(seq)) * 1e3)
+                    replies[0] += 1
+                elif seq is None and unanswered and not message[:4].isalpha():
+                    latencies.append((now - pending.pop(unanswered.pop(0))) * 1e3)
+                    replies[0] += 1
+                lock.notify_all()
+
+    threading.Thread(target=listen, daemon=True).start()
+    t0 = time.perf_counter()
+    origin = ours[0].micros if ours else 0
+    frames = 0
+    for position, r in enumerate(ours):
+        if r.is_frame():
+            if fast:
+                with lock:
+                    lock.wait_for(lambda: len(pending) < window, timeout=timeout)
+                    # whatever never came back by now isn't going to
+                    if len(pending) >= window:
+                        pending.clear()
+                        unanswered.clear()
+            pace(t0, r.micros - origin, fast)
+            seq = frame_seq(r.message)
+            with lock:
+                key = seq if seq is not None else ('v1', position)
+                pending[key] = time.perf_counter()
+                if seq is None:
+                    unanswered.append(key)
+            frames += 1
+        else:
+            pace(t0, r.micros - origin, fast)
+        send(sock, r.message)
+    with lock:
+        lock.wait_for(lambda: not pending, timeout=timeout)
+    elapsed = time.perf_counter() - t0
+    sock.close()
+    server.close()
+
+    print('sent %d frames in %.3f s (%.1f frames/s), %d answered' % (frames, elapsed, frames / max(elapsed, 1e-9), replies[0]))
+    report('round trip', latencies)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('mode', choices=('info', 'worker', 'plugin'))
+    parser.add_argument('capture')
+    parser.add_argument('--host', default='localhost')
+    parser.add_argument('--port', type=int, default=11586)
+    parser.add_argument('--fast', action='store_true', help='as fast as the other side keeps up, not at the recorded times')
+    parser.add_argument('--window', type=int, default=1, help='plugin --fast: frames allowed in flight')
+    parser.add_argument('--timeout', type=float, default=2.0, help='seconds to wait for an answer')
+    args = parser.parse_args()
+
+    capture = read_capture(args.capture)
+    if args.mode == 'info':
+        info(capture)
+    elif args.mode == 'worker':
+        as_worker(capture, args.host, args.port, args.fast)
+    else:
+        as_plugin(capture, args.host, args.port, args.fast, max(1, args.window), args.timeout)
+
+
+if __name__ == '__main__':
+    main()